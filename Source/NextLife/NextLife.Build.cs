@@ -26,6 +26,7 @@ public class NextLife : ModuleRules
 	        new string[]
 	        {
 		        "Projects",
+		        "Json",
 	        }
         );
 	}
@@ -0,0 +1,151 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Actions/Benchmark/NLBenchmarkAction.h"
+#include "Behaviors/NLBenchmarkBehavior.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLBenchmarkAction::UNLBenchmarkAction()
+	: Depth(0)
+	, TransitionTime(0.0f)
+	, TransitionCount(0)
+{
+	// The update only reads the behavior settings and its own state
+	UpdateIsThreadSafe = true;
+	ActionShortDescription = TEXT("Benchmark");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLBenchmarkAction::OnStart_Implementation(UNLActionPayload* payload)
+{
+	const UNLBenchmarkAction* previous = Cast<UNLBenchmarkAction>(GetPreviousAction());
+	Depth = previous ? previous->Depth + 1 : 0;
+	TransitionTime = 0.0f;
+	return BuildStack();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLBenchmarkAction::OnUpdate_Implementation(const float deltaSeconds)
+{
+	const UNLBenchmarkBehavior* behavior = GetBenchmarkBehavior();
+	if(behavior->TransitionRate <= 0.0f)
+	{
+		return Continue();
+	}
+
+	TransitionTime += deltaSeconds;
+	if(TransitionTime < 1.0f / behavior->TransitionRate)
+	{
+		return Continue();
+	}
+	TransitionTime = 0.0f;
+
+	// The root action can't be done without ending the behavior
+	if(Depth == 0 || (++TransitionCount & 1) != 0)
+	{
+		return ChangeTo(GetClass(), nullptr, TEXT("Benchmark change"));
+	}
+	return Done(TEXT("Benchmark done"));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLBenchmarkAction::OnResume_Implementation(const UNLAction* resumedFromAction)
+{
+	return BuildStack();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLBenchmarkAction::BuildStack()
+{
+	if(Depth + 1 < GetBenchmarkBehavior()->StackDepth)
+	{
+		return SuspendFor(GetClass(), nullptr, TEXT("Benchmark stack"));
+	}
+	return Continue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::RespondToEvent()
+{
+	if(Depth == 0 && FMath::FRand() < GetBenchmarkBehavior()->EventResponseChance)
+	{
+		return TrySuspendFor(GetClass(), nullptr, ENLEventRequestPriority::IMPORTANT, TEXT("Benchmark event"), ENLSuspendBehavior::APPEND);
+	}
+	return TryContinue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+const UNLBenchmarkBehavior* UNLBenchmarkAction::GetBenchmarkBehavior() const
+{
+	const UNLBenchmarkBehavior* behavior = Cast<UNLBenchmarkBehavior>(GetBehavior());
+	return behavior ? behavior : GetDefault<UNLBenchmarkBehavior>();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::General_Message_Implementation(UNLGeneralMessage* message)
+{
+	return RespondToEvent();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::Sense_Sight_Implementation(APawn* subject, bool indirect)
+{
+	return RespondToEvent();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::Sense_SightLost_Implementation(APawn* subject)
+{
+	return RespondToEvent();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::Sense_Sound_Implementation(APawn* OtherActor, const FVector& Location, float Volume, int32 flags)
+{
+	return RespondToEvent();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::Sense_Contact_Implementation(AActor* other, const FHitResult& hitResult)
+{
+	return RespondToEvent();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::Movement_MoveTo_Implementation(const AActor* goal, const FVector& pos, float range)
+{
+	return RespondToEvent();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLBenchmarkAction::Movement_MoveToComplete_Implementation(FAIRequestID RequestID, const EPathFollowingResult::Type Result)
+{
+	return RespondToEvent();
+}
@@ -0,0 +1,50 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Actions/Benchmark/NLBenchmarkChainAction.h"
+#include "Behaviors/NLBenchmarkBehavior.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLBenchmarkChainAction::UNLBenchmarkChainAction()
+{
+	ActionShortDescription = TEXT("Benchmark Chain");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLBenchmarkChainAction::OnStart_Implementation(UNLActionPayload* payload)
+{
+	UNLBenchmarkBehavior* behavior = CastChecked<UNLBenchmarkBehavior>(GetBehavior());
+	if(behavior->ChainRemaining <= 0)
+	{
+		return Continue();
+	}
+
+	switch(behavior->ChainChange)
+	{
+		case ENLActionChangeType::CHANGE:
+			--behavior->ChainRemaining;
+			return ChangeTo(UNLBenchmarkChainAction::StaticClass(), nullptr);
+		case ENLActionChangeType::SUSPEND:
+			--behavior->ChainRemaining;
+			return SuspendFor(UNLBenchmarkChainAction::StaticClass(), nullptr);
+		default:
+			return Continue();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLBenchmarkChainAction::OnResume_Implementation(const UNLAction* resumedFromAction)
+{
+	UNLBenchmarkBehavior* behavior = CastChecked<UNLBenchmarkBehavior>(GetBehavior());
+	if(behavior->ChainRemaining > 0 && behavior->ChainChange == ENLActionChangeType::DONE)
+	{
+		--behavior->ChainRemaining;
+		return Done();
+	}
+	return Continue();
+}
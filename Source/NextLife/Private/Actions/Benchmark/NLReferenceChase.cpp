@@ -0,0 +1,84 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Actions/Benchmark/NLReferenceChase.h"
+#include "Behaviors/NLReferenceBehavior.h"
+
+#include "GameFramework/Pawn.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReferenceChase::UNLReferenceChase()
+	: TargetVisible(false)
+	, LastKnownLocation(FVector::ZeroVector)
+	, LostTime(0.0f)
+{
+	ActionShortDescription = TEXT("Chase");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLReferenceChase::OnStart_Implementation(UNLActionPayload* payload)
+{
+	const FNLReferenceChasePayload* chasePayload = GetStructPayload<FNLReferenceChasePayload>();
+	Target = chasePayload ? chasePayload->Target : nullptr;
+	if(!Target.IsValid())
+	{
+		return Done(TEXT("Nothing to chase"));
+	}
+
+	TargetVisible = true;
+	LastKnownLocation = Target->GetActorLocation();
+	LostTime = 0.0f;
+	return Continue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLReferenceChase::OnUpdate_Implementation(const float deltaSeconds)
+{
+	const FNLReferenceAISettings& settings = UNLReferenceBehavior::GetSettings(this);
+
+	if(TargetVisible && Target.IsValid())
+	{
+		LastKnownLocation = Target->GetActorLocation();
+	}
+	else
+	{
+		LostTime += deltaSeconds;
+		if(LostTime >= settings.GiveUpTime)
+		{
+			return Done(TEXT("Lost the target"));
+		}
+	}
+
+	settings.MoveTowards(GetPawnOwner(), LastKnownLocation, deltaSeconds);
+	return Continue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLReferenceChase::Sense_Sight_Implementation(APawn* subject, bool indirect)
+{
+	if(subject && subject == Target.Get())
+	{
+		TargetVisible = true;
+		LostTime = 0.0f;
+	}
+	return TryContinue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLReferenceChase::Sense_SightLost_Implementation(APawn* subject)
+{
+	if(subject && subject == Target.Get())
+	{
+		TargetVisible = false;
+	}
+	return TryContinue();
+}
@@ -0,0 +1,54 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Actions/Benchmark/NLReferencePatrol.h"
+#include "Actions/Benchmark/NLReferenceChase.h"
+#include "Behaviors/NLReferenceBehavior.h"
+
+#include "GameFramework/Pawn.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReferencePatrol::UNLReferencePatrol()
+	: Home(FVector::ZeroVector)
+	, PatrolIndex(0)
+{
+	ActionShortDescription = TEXT("Patrol");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLReferencePatrol::OnStart_Implementation(UNLActionPayload* payload)
+{
+	const APawn* pawn = GetPawnOwner();
+	Home = pawn ? pawn->GetActorLocation() : FVector::ZeroVector;
+	PatrolIndex = 0;
+	return Continue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLReferencePatrol::OnUpdate_Implementation(const float deltaSeconds)
+{
+	const FNLReferenceAISettings& settings = UNLReferenceBehavior::GetSettings(this);
+	if(settings.MoveTowards(GetPawnOwner(), settings.GetPatrolPoint(Home, PatrolIndex), deltaSeconds))
+	{
+		++PatrolIndex;
+	}
+	return Continue();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLReferencePatrol::Sense_Sight_Implementation(APawn* subject, bool indirect)
+{
+	// A chase already running handles sightings itself
+	if(subject && IsTopAction())
+	{
+		return TrySuspendFor<UNLReferenceChase>(FNLReferenceChasePayload(subject), ENLEventRequestPriority::IMPORTANT, TEXT("Saw a pawn"));
+	}
+	return TryContinue();
+}
@@ -3,6 +3,15 @@
 #include "Actions/Humanoid/NLHumanoidIdle.h"
 #include "NextLifeModule.h"
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLHumanoidIdle::UNLHumanoidIdle()
+{
+	// Idling does nothing in its update
+	UpdateIsThreadSafe = true;
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
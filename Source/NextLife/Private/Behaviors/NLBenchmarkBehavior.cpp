@@ -0,0 +1,18 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Behaviors/NLBenchmarkBehavior.h"
+#include "Actions/Benchmark/NLBenchmarkAction.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLBenchmarkBehavior::UNLBenchmarkBehavior()
+	: StackDepth(4)
+	, TransitionRate(1.0f)
+	, EventResponseChance(0.1f)
+	, ChainRemaining(0)
+	, ChainChange(ENLActionChangeType::NONE)
+{
+	InitialActionClass = UNLBenchmarkAction::StaticClass();
+	BehaviorShortName = TEXT("Benchmark");
+}
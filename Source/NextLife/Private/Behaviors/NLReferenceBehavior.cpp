@@ -0,0 +1,23 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Behaviors/NLReferenceBehavior.h"
+#include "Actions/Benchmark/NLReferencePatrol.h"
+#include "NLAction.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReferenceBehavior::UNLReferenceBehavior()
+{
+	InitialActionClass = UNLReferencePatrol::StaticClass();
+	BehaviorShortName = TEXT("Reference");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+const FNLReferenceAISettings& UNLReferenceBehavior::GetSettings(const UNLAction* action)
+{
+	const UNLReferenceBehavior* behavior = Cast<UNLReferenceBehavior>(action->GetBehavior());
+	return behavior ? behavior->Settings : GetDefault<UNLReferenceBehavior>()->Settings;
+}
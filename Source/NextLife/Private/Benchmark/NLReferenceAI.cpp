@@ -0,0 +1,38 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Benchmark/NLReferenceAI.h"
+
+#include "GameFramework/Pawn.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FVector FNLReferenceAISettings::GetPatrolPoint(const FVector& home, int32 patrolIndex) const
+{
+	static const FVector2D corners[] = { { 1.0f, 1.0f }, { -1.0f, 1.0f }, { -1.0f, -1.0f }, { 1.0f, -1.0f } };
+	const FVector2D& corner = corners[patrolIndex & 3];
+	return home + FVector(corner.X * PatrolExtent, corner.Y * PatrolExtent, 0.0f);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLReferenceAISettings::MoveTowards(APawn* pawn, const FVector& goal, float deltaTime) const
+{
+	if(!pawn)
+	{
+		return false;
+	}
+
+	const FVector location = pawn->GetActorLocation();
+	const FVector toGoal = goal - location;
+	const float distance = toGoal.Size();
+	if(distance <= AcceptanceRadius)
+	{
+		return true;
+	}
+
+	const float step = FMath::Min(MoveSpeed * deltaTime, distance);
+	pawn->SetActorLocation(location + toGoal * (step / distance));
+	return distance - step <= AcceptanceRadius;
+}
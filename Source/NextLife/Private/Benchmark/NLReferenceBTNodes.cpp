@@ -0,0 +1,191 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Benchmark/NLReferenceBTNodes.h"
+
+#include "AIController.h"
+#include "BehaviorTree/BehaviorTree.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Bool.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Int.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+#include "BehaviorTree/Composites/BTComposite_Selector.h"
+
+const FName FNLReferenceBlackboardKeys::Home(TEXT("Home"));
+const FName FNLReferenceBlackboardKeys::PatrolIndex(TEXT("PatrolIndex"));
+const FName FNLReferenceBlackboardKeys::Target(TEXT("Target"));
+const FName FNLReferenceBlackboardKeys::TargetVisible(TEXT("TargetVisible"));
+
+namespace
+{
+	// Chase state kept in the trees instance memory
+	struct FChaseMemory
+	{
+		FVector LastKnownLocation;
+		float LostTime;
+	};
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReferenceBTTask_Patrol::UNLReferenceBTTask_Patrol()
+{
+	NodeName = TEXT("Patrol");
+	bNotifyTick = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+EBTNodeResult::Type UNLReferenceBTTask_Patrol::ExecuteTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory)
+{
+	return EBTNodeResult::InProgress;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLReferenceBTTask_Patrol::TickTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory, float deltaSeconds)
+{
+	UBlackboardComponent* blackboard = ownerComp.GetBlackboardComponent();
+	const AAIController* controller = ownerComp.GetAIOwner();
+	if(!blackboard || !controller)
+	{
+		FinishLatentTask(ownerComp, EBTNodeResult::Failed);
+		return;
+	}
+
+	const int32 patrolIndex = blackboard->GetValueAsInt(FNLReferenceBlackboardKeys::PatrolIndex);
+	const FVector patrolPoint = Settings.GetPatrolPoint(blackboard->GetValueAsVector(FNLReferenceBlackboardKeys::Home), patrolIndex);
+	if(Settings.MoveTowards(controller->GetPawn(), patrolPoint, deltaSeconds))
+	{
+		blackboard->SetValueAsInt(FNLReferenceBlackboardKeys::PatrolIndex, patrolIndex + 1);
+		FinishLatentTask(ownerComp, EBTNodeResult::Succeeded);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReferenceBTTask_Chase::UNLReferenceBTTask_Chase()
+{
+	NodeName = TEXT("Chase");
+	bNotifyTick = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+uint16 UNLReferenceBTTask_Chase::GetInstanceMemorySize() const
+{
+	return sizeof(FChaseMemory);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+EBTNodeResult::Type UNLReferenceBTTask_Chase::ExecuteTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory)
+{
+	const UBlackboardComponent* blackboard = ownerComp.GetBlackboardComponent();
+	const AActor* target = blackboard ? Cast<AActor>(blackboard->GetValueAsObject(FNLReferenceBlackboardKeys::Target)) : nullptr;
+	if(!target)
+	{
+		return EBTNodeResult::Failed;
+	}
+
+	FChaseMemory* memory = reinterpret_cast<FChaseMemory*>(nodeMemory);
+	memory->LastKnownLocation = target->GetActorLocation();
+	memory->LostTime = 0.0f;
+	return EBTNodeResult::InProgress;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLReferenceBTTask_Chase::TickTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory, float deltaSeconds)
+{
+	UBlackboardComponent* blackboard = ownerComp.GetBlackboardComponent();
+	const AAIController* controller = ownerComp.GetAIOwner();
+	if(!blackboard || !controller)
+	{
+		FinishLatentTask(ownerComp, EBTNodeResult::Failed);
+		return;
+	}
+
+	FChaseMemory* memory = reinterpret_cast<FChaseMemory*>(nodeMemory);
+	const AActor* target = Cast<AActor>(blackboard->GetValueAsObject(FNLReferenceBlackboardKeys::Target));
+	if(target && blackboard->GetValueAsBool(FNLReferenceBlackboardKeys::TargetVisible))
+	{
+		memory->LastKnownLocation = target->GetActorLocation();
+		memory->LostTime = 0.0f;
+	}
+	else
+	{
+		memory->LostTime += deltaSeconds;
+		if(memory->LostTime >= Settings.GiveUpTime)
+		{
+			// Finished before clearing the target so the decorator doesn't abort the chase
+			FinishLatentTask(ownerComp, EBTNodeResult::Succeeded);
+			blackboard->ClearValue(FNLReferenceBlackboardKeys::Target);
+			return;
+		}
+	}
+
+	Settings.MoveTowards(controller->GetPawn(), memory->LastKnownLocation, deltaSeconds);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReferenceBTDecorator_HasTarget::UNLReferenceBTDecorator_HasTarget()
+{
+	NodeName = TEXT("Has Target");
+	BlackboardKey.SelectedKeyName = FNLReferenceBlackboardKeys::Target;
+	BasicOperation = static_cast<uint8>(EBasicKeyOperation::Set);
+	FlowAbortMode = EBTFlowAbortMode::LowerPriority;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UBehaviorTree* NLCreateReferenceBehaviorTree(UObject* outer, const FNLReferenceAISettings& settings)
+{
+	UBehaviorTree* tree = NewObject<UBehaviorTree>(outer);
+
+	UBlackboardData* blackboardData = NewObject<UBlackboardData>(tree);
+	auto addKey = [blackboardData](FName name, UBlackboardKeyType* keyType)
+	{
+		FBlackboardEntry entry;
+		entry.EntryName = name;
+		entry.KeyType = keyType;
+		blackboardData->Keys.Add(entry);
+	};
+	addKey(FNLReferenceBlackboardKeys::Home, NewObject<UBlackboardKeyType_Vector>(blackboardData));
+	addKey(FNLReferenceBlackboardKeys::PatrolIndex, NewObject<UBlackboardKeyType_Int>(blackboardData));
+	UBlackboardKeyType_Object* targetKeyType = NewObject<UBlackboardKeyType_Object>(blackboardData);
+	targetKeyType->BaseClass = AActor::StaticClass();
+	addKey(FNLReferenceBlackboardKeys::Target, targetKeyType);
+	addKey(FNLReferenceBlackboardKeys::TargetVisible, NewObject<UBlackboardKeyType_Bool>(blackboardData));
+	blackboardData->UpdateParentKeys();
+	blackboardData->UpdateKeyIDs();
+	tree->BlackboardAsset = blackboardData;
+
+	UNLReferenceBTTask_Chase* chase = NewObject<UNLReferenceBTTask_Chase>(tree);
+	chase->Settings = settings;
+	UNLReferenceBTTask_Patrol* patrol = NewObject<UNLReferenceBTTask_Patrol>(tree);
+	patrol->Settings = settings;
+
+	UBTComposite_Selector* root = NewObject<UBTComposite_Selector>(tree);
+
+	FBTCompositeChild& chaseChild = root->Children.AddDefaulted_GetRef();
+	chaseChild.ChildTask = chase;
+	chaseChild.Decorators.Add(NewObject<UNLReferenceBTDecorator_HasTarget>(tree));
+
+	FBTCompositeChild& patrolChild = root->Children.AddDefaulted_GetRef();
+	patrolChild.ChildTask = patrol;
+
+	tree->RootNode = root;
+	return tree;
+}
@@ -0,0 +1,363 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Commandlets/NLBenchmarkCommandlet.h"
+#include "NLCommandletWorld.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+#include "NextLifeTickManager.h"
+#include "Crowd/NLCrowdSubsystem.h"
+#include "Behaviors/NLBenchmarkBehavior.h"
+
+#include "AIController.h"
+#include "Dom/JsonObject.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace
+{
+	// The events sent to brains, in the order they are cycled through
+	enum class EBenchmarkEvent : uint8
+	{
+		GeneralMessage,
+		Sight,
+		SightLost,
+		Sound,
+		Contact,
+		MoveTo,
+		MoveToComplete,
+
+		Count
+	};
+
+	const int32 SubjectCount = 8;
+
+	// Sends a benchmark event to a crowd agent as the signal of the same name
+	void SendCrowdSignal(UNLCrowdSubsystem* crowd, FNLCrowdAgentHandle agent, EBenchmarkEvent benchmarkEvent, APawn* subject, UNLGeneralMessage* message)
+	{
+		switch(benchmarkEvent)
+		{
+			case EBenchmarkEvent::GeneralMessage:
+				crowd->SignalMessage(agent, message);
+				break;
+			case EBenchmarkEvent::Sight:
+				crowd->SignalSight(agent, subject, false);
+				break;
+			case EBenchmarkEvent::SightLost:
+				crowd->SignalSightLost(agent, subject);
+				break;
+			case EBenchmarkEvent::Sound:
+				crowd->SignalSound(agent, subject, subject->GetActorLocation(), 1.0f, 0);
+				break;
+			case EBenchmarkEvent::Contact:
+				crowd->SignalContact(agent, subject, FHitResult());
+				break;
+			case EBenchmarkEvent::MoveTo:
+				crowd->SignalMoveTo(agent, subject, subject->GetActorLocation(), 50.0f);
+				break;
+			case EBenchmarkEvent::MoveToComplete:
+				crowd->SignalMoveToComplete(agent, FAIRequestID::CurrentRequest, EPathFollowingResult::Success);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLBenchmarkCommandlet::UNLBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 brainCount = 1000;
+	int32 frameCount = 600;
+	int32 warmupFrames = 60;
+	int32 gcFrames = 60;
+	float deltaTime = 1.0f / 30.0f;
+	float eventRate = 2.0f;
+	FParse::Value(*Params, TEXT("Count="), brainCount);
+	FParse::Value(*Params, TEXT("Frames="), frameCount);
+	FParse::Value(*Params, TEXT("Warmup="), warmupFrames);
+	FParse::Value(*Params, TEXT("GCFrames="), gcFrames);
+	FParse::Value(*Params, TEXT("DeltaTime="), deltaTime);
+	FParse::Value(*Params, TEXT("EventRate="), eventRate);
+	const bool useCrowd = FParse::Param(*Params, TEXT("Crowd"));
+	brainCount = FMath::Max(brainCount, 1);
+	frameCount = FMath::Max(frameCount, 1);
+	warmupFrames = FMath::Max(warmupFrames, 0);
+
+	UClass* behaviorClass = UNLBenchmarkBehavior::StaticClass();
+	FString behaviorPath;
+	if(FParse::Value(*Params, TEXT("Behavior="), behaviorPath))
+	{
+		behaviorClass = LoadObject<UClass>(nullptr, *behaviorPath);
+		if(!behaviorClass || !behaviorClass->IsChildOf(UNLBenchmarkBehavior::StaticClass()))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("'%s' isn't a UNLBenchmarkBehavior class"), *behaviorPath);
+			return 1;
+		}
+	}
+
+	// Settings given on the command line override the behaviors defaults
+	UNLBenchmarkBehavior* behaviorDefaults = behaviorClass->GetDefaultObject<UNLBenchmarkBehavior>();
+	FParse::Value(*Params, TEXT("StackDepth="), behaviorDefaults->StackDepth);
+	FParse::Value(*Params, TEXT("TransitionRate="), behaviorDefaults->TransitionRate);
+	FParse::Value(*Params, TEXT("EventResponseChance="), behaviorDefaults->EventResponseChance);
+	if(FParse::Param(*Params, TEXT("PoolActions")))
+	{
+		behaviorDefaults->PoolActions = true;
+	}
+
+	// The same random choices every run
+	FMath::RandInit(0);
+	FMath::SRandInit(0);
+
+	FNLCommandletWorld benchmarkWorld(TEXT("NLBenchmark"));
+	UWorld* world = benchmarkWorld.Get();
+	const UNextLifeTickManager* tickManager = world->GetSubsystem<UNextLifeTickManager>();
+	UNLCrowdSubsystem* crowd = world->GetSubsystem<UNLCrowdSubsystem>();
+	if(useCrowd && !crowd)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("The benchmark world has no NextLife crowd"));
+		return 1;
+	}
+
+	FActorSpawnParameters spawnParameters;
+	spawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	TArray<APawn*> subjects;
+	for(int32 subjectIndex = 0; subjectIndex < SubjectCount; ++subjectIndex)
+	{
+		subjects.Add(world->SpawnActor<APawn>(APawn::StaticClass(), FVector(subjectIndex * 100.0f, 0.0f, 0.0f), FRotator::ZeroRotator, spawnParameters));
+	}
+
+	TArray<UNextLifeBrainComponent*> brains;
+	TArray<FNLCrowdAgentHandle> agents;
+	brains.Reserve(useCrowd ? 0 : brainCount);
+	agents.Reserve(useCrowd ? brainCount : 0);
+	for(int32 brainIndex = 0; brainIndex < brainCount; ++brainIndex)
+	{
+		const FVector location((brainIndex % 100) * 200.0f, (brainIndex / 100) * 200.0f, 0.0f);
+		if(useCrowd)
+		{
+			agents.Add(crowd->AddAgent(behaviorClass, location));
+			continue;
+		}
+
+		APawn* pawn = world->SpawnActor<APawn>(APawn::StaticClass(), location, FRotator::ZeroRotator, spawnParameters);
+		AAIController* controller = world->SpawnActor<AAIController>(AAIController::StaticClass(), location, FRotator::ZeroRotator, spawnParameters);
+		if(!pawn || !controller)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't spawn benchmark AI %d"), brainIndex);
+			return 1;
+		}
+		controller->Possess(pawn);
+
+		UNextLifeBrainComponent* brain = NewObject<UNextLifeBrainComponent>(controller);
+		brain->UseTickManager = true;
+		brain->RegisterComponent();
+		controller->BrainComponent = brain;
+		brain->AddBehavior(behaviorClass);
+		brain->StartLogic();
+		brains.Add(brain);
+	}
+
+	// A single message is reused so allocations count NextLife's own objects
+	UNLGeneralMessage* message = NewObject<UNLGeneralMessage>(GetTransientPackage());
+	message->MessageName = TEXT("Benchmark");
+	message->AddToRoot();
+
+	TArray<double> frameMs;
+	frameMs.Reserve(frameCount);
+	double tickManagerMs = 0.0;
+	double dispatchMs = 0.0;
+	double gcMs = 0.0;
+	double gcMaxMs = 0.0;
+	int32 gcCount = 0;
+	int64 transitionCount = 0;
+	int64 eventCount = 0;
+	int64 objectCount = 0;
+
+	float pendingEvents = 0.0f;
+	int32 nextBrain = 0;
+	int32 nextEvent = 0;
+
+	for(int32 frameIndex = 0; frameIndex < warmupFrames + frameCount; ++frameIndex)
+	{
+		const bool measure = frameIndex >= warmupFrames;
+
+		TUniquePtr<FNLObjectCreateCounter> objectCounter;
+		if(measure)
+		{
+			objectCounter = MakeUnique<FNLObjectCreateCounter>();
+		}
+
+		// Events arrive between frames, spread evenly over the brains
+		pendingEvents += eventRate * brainCount * deltaTime;
+		const int32 frameEvents = FMath::FloorToInt(pendingEvents);
+		pendingEvents -= frameEvents;
+
+		const double dispatchStart = FPlatformTime::Seconds();
+		for(int32 eventIndex = 0; eventIndex < frameEvents; ++eventIndex)
+		{
+			APawn* subject = subjects[eventIndex % SubjectCount];
+			if(useCrowd)
+			{
+				SendCrowdSignal(crowd, agents[nextBrain], static_cast<EBenchmarkEvent>(nextEvent), subject, message);
+				nextBrain = (nextBrain + 1) % agents.Num();
+				nextEvent = (nextEvent + 1) % static_cast<int32>(EBenchmarkEvent::Count);
+				continue;
+			}
+
+			UNextLifeBrainComponent* brain = brains[nextBrain];
+			nextBrain = (nextBrain + 1) % brains.Num();
+
+			switch(static_cast<EBenchmarkEvent>(nextEvent))
+			{
+				case EBenchmarkEvent::GeneralMessage:
+					brain->General_Message(message);
+					break;
+				case EBenchmarkEvent::Sight:
+					brain->Sense_Sight(subject, false);
+					break;
+				case EBenchmarkEvent::SightLost:
+					brain->Sense_SightLost(subject);
+					break;
+				case EBenchmarkEvent::Sound:
+					brain->Sense_Sound(subject, subject->GetActorLocation(), 1.0f, 0);
+					break;
+				case EBenchmarkEvent::Contact:
+					brain->Sense_Contact(subject, FHitResult());
+					break;
+				case EBenchmarkEvent::MoveTo:
+					brain->Movement_MoveTo(subject, subject->GetActorLocation(), 50.0f);
+					break;
+				case EBenchmarkEvent::MoveToComplete:
+					brain->Movement_MoveToComplete(FAIRequestID::CurrentRequest, EPathFollowingResult::Success);
+					break;
+				default:
+					break;
+			}
+			nextEvent = (nextEvent + 1) % static_cast<int32>(EBenchmarkEvent::Count);
+		}
+		const double frameDispatchMs = (FPlatformTime::Seconds() - dispatchStart) * 1000.0;
+
+		const double tickStart = FPlatformTime::Seconds();
+		benchmarkWorld.Tick(deltaTime);
+		const double tickMs = (FPlatformTime::Seconds() - tickStart) * 1000.0;
+
+		if(!measure)
+		{
+			continue;
+		}
+
+		objectCount += objectCounter->Count;
+		objectCounter.Reset();
+
+		frameMs.Add(tickMs);
+		dispatchMs += frameDispatchMs;
+		eventCount += frameEvents;
+		if(useCrowd)
+		{
+			tickManagerMs += crowd->GetLastTickTimeMs();
+			transitionCount += crowd->GetLastTickTransitionCount();
+		}
+		else
+		{
+			tickManagerMs += tickManager ? tickManager->GetLastTickTimeMs() : 0.0f;
+			for(const UNextLifeBrainComponent* brain : brains)
+			{
+				transitionCount += brain->GetTransitionsThisFrame();
+			}
+		}
+
+		if(gcFrames > 0 && (frameIndex - warmupFrames + 1) % gcFrames == 0)
+		{
+			const double gcStart = FPlatformTime::Seconds();
+			CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+			const double collectMs = (FPlatformTime::Seconds() - gcStart) * 1000.0;
+			gcMs += collectMs;
+			gcMaxMs = FMath::Max(gcMaxMs, collectMs);
+			++gcCount;
+		}
+	}
+
+	for(UNextLifeBrainComponent* brain : brains)
+	{
+		brain->StopLogic(TEXT("Benchmark finished"));
+	}
+	for(FNLCrowdAgentHandle agent : agents)
+	{
+		crowd->RemoveAgent(agent);
+	}
+	message->RemoveFromRoot();
+
+	double totalFrameMs = 0.0;
+	double maxFrameMs = 0.0;
+	for(double ms : frameMs)
+	{
+		totalFrameMs += ms;
+		maxFrameMs = FMath::Max(maxFrameMs, ms);
+	}
+
+	const double simulatedSeconds = frameCount * deltaTime;
+	TSharedRef<FJsonObject> metrics = MakeShared<FJsonObject>();
+	metrics->SetNumberField(TEXT("FrameMs"), totalFrameMs / frameCount);
+	metrics->SetNumberField(TEXT("FrameMsP95"), NLGetPercentile(frameMs, 0.95f));
+	metrics->SetNumberField(TEXT("FrameMsMax"), maxFrameMs);
+	metrics->SetNumberField(TEXT("TickManagerMs"), tickManagerMs / frameCount);
+	metrics->SetNumberField(TEXT("TickMsPerBrain"), totalFrameMs / frameCount / brainCount);
+	metrics->SetNumberField(TEXT("TransitionsPerSecond"), transitionCount / simulatedSeconds);
+	metrics->SetNumberField(TEXT("EventsPerSecond"), eventCount / simulatedSeconds);
+	metrics->SetNumberField(TEXT("EventDispatchUs"), eventCount > 0 ? dispatchMs * 1000.0 / eventCount : 0.0);
+	metrics->SetNumberField(TEXT("ObjectAllocationsPerFrame"), static_cast<double>(objectCount) / frameCount);
+	metrics->SetNumberField(TEXT("ObjectAllocationsPerTransition"), transitionCount > 0 ? static_cast<double>(objectCount) / transitionCount : 0.0);
+	metrics->SetNumberField(TEXT("GCMs"), gcCount > 0 ? gcMs / gcCount : 0.0);
+	metrics->SetNumberField(TEXT("GCMsMax"), gcMaxMs);
+
+	TSharedRef<FJsonObject> results = MakeShared<FJsonObject>();
+	results->SetStringField(TEXT("Benchmark"), TEXT("Crowd"));
+	results->SetStringField(TEXT("Behavior"), behaviorClass->GetPathName());
+	results->SetNumberField(TEXT("Count"), brainCount);
+	results->SetNumberField(TEXT("Frames"), frameCount);
+	results->SetNumberField(TEXT("DeltaTime"), deltaTime);
+	results->SetNumberField(TEXT("EventRate"), eventRate);
+	results->SetNumberField(TEXT("StackDepth"), behaviorDefaults->StackDepth);
+	results->SetNumberField(TEXT("TransitionRate"), behaviorDefaults->TransitionRate);
+	results->SetNumberField(TEXT("EventResponseChance"), behaviorDefaults->EventResponseChance);
+	results->SetBoolField(TEXT("PoolActions"), behaviorDefaults->PoolActions);
+	results->SetBoolField(TEXT("Crowd"), useCrowd);
+	results->SetObjectField(TEXT("Metrics"), metrics);
+
+	UE_LOG(LogNextLife, Display, TEXT("%d %s, %d frames: %.3fms per frame (p95 %.3fms, max %.3fms), tick manager %.3fms"),
+		   brainCount, useCrowd ? TEXT("crowd agents") : TEXT("brains"), frameCount, totalFrameMs / frameCount, NLGetPercentile(frameMs, 0.95f), maxFrameMs, tickManagerMs / frameCount);
+	UE_LOG(LogNextLife, Display, TEXT("%.0f transitions/s, %.0f events/s, %.3fus per event, %.1f objects per frame, GC %.3fms average %.3fms max"),
+		   transitionCount / simulatedSeconds, eventCount / simulatedSeconds, metrics->GetNumberField(TEXT("EventDispatchUs")),
+		   metrics->GetNumberField(TEXT("ObjectAllocationsPerFrame")), metrics->GetNumberField(TEXT("GCMs")), gcMaxMs);
+
+	FString outputPath;
+	if(FParse::Value(*Params, TEXT("Output="), outputPath))
+	{
+		FString json;
+		TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&json);
+		FJsonSerializer::Serialize(results, writer);
+		if(!FFileHelper::SaveStringToFile(json, *outputPath))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't write '%s'"), *outputPath);
+			return 1;
+		}
+		UE_LOG(LogNextLife, Display, TEXT("Wrote benchmark results to '%s'"), *outputPath);
+	}
+	return 0;
+}
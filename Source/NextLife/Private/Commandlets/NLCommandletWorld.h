@@ -0,0 +1,245 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "HAL/MemoryBase.h"
+#include "UObject/UObjectArray.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * An empty game world for commandlets to run brains in without rendering. Commandlets don't run the engine loop, so
+ * Tick advances GFrameCounter along with the world to keep per frame limits such as MaxTransitionsPerFrame working.
+ * The world is destroyed and garbage collected when this goes out of scope.
+ */
+class FNLCommandletWorld
+{
+public:
+	FNLCommandletWorld(const TCHAR* name)
+		: World(UWorld::CreateWorld(EWorldType::Game, false, name))
+	{
+		FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+		worldContext.SetCurrentWorld(World);
+		World->InitializeActorsForPlay(FURL());
+		World->BeginPlay();
+	}
+
+	~FNLCommandletWorld()
+	{
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	}
+
+	UWorld* Get() const
+	{
+		return World;
+	}
+
+	void Tick(float deltaTime)
+	{
+		++GFrameCounter;
+		World->Tick(LEVELTICK_All, deltaTime);
+	}
+
+	// Spawns a bare pawn given a scene root, which a pawn doesn't have by default, so it has a location and can move
+	APawn* SpawnPawn(const FVector& location)
+	{
+		FActorSpawnParameters spawnParameters;
+		spawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		APawn* pawn = World->SpawnActor<APawn>(APawn::StaticClass(), location, FRotator::ZeroRotator, spawnParameters);
+		if(pawn)
+		{
+			USceneComponent* root = NewObject<USceneComponent>(pawn, TEXT("Root"));
+			pawn->SetRootComponent(root);
+			root->RegisterComponent();
+			pawn->SetActorLocation(location);
+		}
+		return pawn;
+	}
+
+private:
+	UWorld* World;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Counts the UObjects created while it exists, and the size of their classes
+ */
+class FNLObjectCreateCounter : public FUObjectArray::FUObjectCreateListener
+{
+public:
+	FNLObjectCreateCounter()
+		: Count(0)
+		, Bytes(0)
+		, IsListening(true)
+	{
+		GUObjectArray.AddUObjectCreateListener(this);
+	}
+
+	virtual ~FNLObjectCreateCounter()
+	{
+		OnUObjectArrayShutdown();
+	}
+
+	virtual void NotifyUObjectCreated(const UObjectBase* object, int32 index) override
+	{
+		++Count;
+		Bytes += object->GetClass()->GetStructureSize();
+	}
+
+	virtual void OnUObjectArrayShutdown() override
+	{
+		if(IsListening)
+		{
+			GUObjectArray.RemoveUObjectCreateListener(this);
+			IsListening = false;
+		}
+	}
+
+	int64 Count;
+	int64 Bytes;
+
+private:
+	bool IsListening;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Counts the heap allocations made on the game thread while it exists. The first counter puts a forwarding allocator
+ * in front of GMalloc which stays there until the process exits, as other threads may be inside it at any time.
+ */
+class FNLHeapAllocationCounter
+{
+public:
+	FNLHeapAllocationCounter()
+		: StartCount(GetCountingMalloc().GameThreadAllocations)
+	{}
+
+	// Allocations and reallocations made since this was created
+	int64 GetCount() const
+	{
+		return GetCountingMalloc().GameThreadAllocations - StartCount;
+	}
+
+private:
+	class FCountingMalloc : public FMalloc
+	{
+	public:
+		FCountingMalloc()
+			: GameThreadAllocations(0)
+			, InnerMalloc(GMalloc)
+		{
+			GMalloc = this;
+		}
+
+		virtual void* Malloc(SIZE_T count, uint32 alignment) override
+		{
+			Count();
+			return InnerMalloc->Malloc(count, alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T count, uint32 alignment) override
+		{
+			Count();
+			return InnerMalloc->TryMalloc(count, alignment);
+		}
+
+		virtual void* Realloc(void* original, SIZE_T count, uint32 alignment) override
+		{
+			Count();
+			return InnerMalloc->Realloc(original, count, alignment);
+		}
+
+		virtual void* TryRealloc(void* original, SIZE_T count, uint32 alignment) override
+		{
+			Count();
+			return InnerMalloc->TryRealloc(original, count, alignment);
+		}
+
+		virtual void Free(void* original) override
+		{
+			InnerMalloc->Free(original);
+		}
+
+		virtual SIZE_T QuantizeSize(SIZE_T count, uint32 alignment) override
+		{
+			return InnerMalloc->QuantizeSize(count, alignment);
+		}
+
+		virtual bool GetAllocationSize(void* original, SIZE_T& sizeOut) override
+		{
+			return InnerMalloc->GetAllocationSize(original, sizeOut);
+		}
+
+		virtual void Trim(bool trimThreadCaches) override
+		{
+			InnerMalloc->Trim(trimThreadCaches);
+		}
+
+		virtual void SetupTLSCachesOnCurrentThread() override
+		{
+			InnerMalloc->SetupTLSCachesOnCurrentThread();
+		}
+
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override
+		{
+			InnerMalloc->ClearAndDisableTLSCachesOnCurrentThread();
+		}
+
+		virtual bool IsInternallyThreadSafe() const override
+		{
+			return InnerMalloc->IsInternallyThreadSafe();
+		}
+
+		virtual bool ValidateHeap() override
+		{
+			return InnerMalloc->ValidateHeap();
+		}
+
+		virtual const TCHAR* GetDescriptiveName() override
+		{
+			return InnerMalloc->GetDescriptiveName();
+		}
+
+		// Only the game thread writes this
+		int64 GameThreadAllocations;
+
+	private:
+		void Count()
+		{
+			if(IsInGameThread())
+			{
+				++GameThreadAllocations;
+			}
+		}
+
+		FMalloc* InnerMalloc;
+	};
+
+	static FCountingMalloc& GetCountingMalloc()
+	{
+		// Never destroyed, allocations made through it may be freed after static destruction
+		static FCountingMalloc* countingMalloc = new FCountingMalloc();
+		return *countingMalloc;
+	}
+
+	int64 StartCount;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Returns the value below which a percentile of values fall, 0 without values
+ */
+inline double NLGetPercentile(TArray<double> values, float percentile)
+{
+	if(values.Num() == 0)
+	{
+		return 0.0;
+	}
+	values.Sort();
+	return values[FMath::Clamp(FMath::CeilToInt(values.Num() * percentile) - 1, 0, values.Num() - 1)];
+}
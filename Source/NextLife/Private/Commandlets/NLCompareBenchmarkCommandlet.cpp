@@ -0,0 +1,421 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Commandlets/NLCompareBenchmarkCommandlet.h"
+#include "NLCommandletWorld.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+#include "Actions/Benchmark/NLReferenceChase.h"
+#include "Behaviors/NLReferenceBehavior.h"
+#include "Benchmark/NLReferenceBTNodes.h"
+
+#include "AIController.h"
+#include "Algo/IndexOf.h"
+#include "BehaviorTree/BehaviorTree.h"
+#include "BehaviorTree/BehaviorTreeComponent.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "Dom/JsonObject.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace
+{
+	// The AI systems compared. None runs the same pawns and controllers without AI to measure the AI's share of a frame.
+	enum class EReferenceSystem : uint8
+	{
+		None,
+		NextLife,
+		BehaviorTree,
+
+		Count
+	};
+
+	const TCHAR* SystemNames[] = { TEXT("None"), TEXT("NextLife"), TEXT("BehaviorTree") };
+	static_assert(UE_ARRAY_COUNT(SystemNames) == static_cast<int32>(EReferenceSystem::Count), "A name is needed for every system");
+
+	const int32 SubjectCount = 8;
+
+	// An agent running the reference AI and the sightings sent to it
+	struct FReferenceAgent
+	{
+		AAIController* Controller;
+		APawn* Subject;
+
+		// NextLife
+		UNextLifeBrainComponent* Brain;
+		const UNLBehavior* Behavior;
+
+		// Behavior Tree
+		UBehaviorTreeComponent* TreeComponent;
+		UBlackboardComponent* Blackboard;
+
+		float NextSightTime;
+		float SightLostTime;
+		bool SubjectVisible;
+
+		// The frame sight was delivered on while waiting for the agent to react, INDEX_NONE otherwise
+		int32 SightFrame;
+	};
+
+	struct FRunSettings
+	{
+		int32 FrameCount;
+		int32 WarmupFrames;
+		float DeltaTime;
+		float SightPeriod;
+		float SightDuration;
+	};
+
+	struct FRunResult
+	{
+		double FrameMs;
+		double ObjectsPerAgent;
+		double ObjectBytesPerAgent;
+		double MemoryBytesPerAgent;
+		TArray<double> ReactionFrames;
+		int32 Sightings;
+		int32 Unreacted;
+	};
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	bool IsChasing(EReferenceSystem system, const FReferenceAgent& agent)
+	{
+		switch(system)
+		{
+			case EReferenceSystem::NextLife:
+				return agent.Behavior && agent.Behavior->GetActionOfClass(UNLReferenceChase::StaticClass()) != nullptr;
+			case EReferenceSystem::BehaviorTree:
+			{
+				const UBTNode* activeNode = agent.TreeComponent ? agent.TreeComponent->GetActiveNode() : nullptr;
+				return activeNode && activeNode->IsA<UNLReferenceBTTask_Chase>();
+			}
+			default:
+				return false;
+		}
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Delivers sight or loss of sight of an agents subject the way the system is usually fed by perception
+	*/
+	void DeliverSight(EReferenceSystem system, FReferenceAgent& agent, bool visible)
+	{
+		agent.SubjectVisible = visible;
+		switch(system)
+		{
+			case EReferenceSystem::NextLife:
+				if(visible)
+				{
+					agent.Brain->Sense_Sight(agent.Subject, false);
+				}
+				else
+				{
+					agent.Brain->Sense_SightLost(agent.Subject);
+				}
+				break;
+			case EReferenceSystem::BehaviorTree:
+				if(visible)
+				{
+					agent.Blackboard->SetValueAsObject(FNLReferenceBlackboardKeys::Target, agent.Subject);
+				}
+				agent.Blackboard->SetValueAsBool(FNLReferenceBlackboardKeys::TargetVisible, visible);
+				break;
+			default:
+				break;
+		}
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Runs one system with a number of agents in a new world
+	*/
+	bool RunSystem(EReferenceSystem system, int32 agentCount, const FRunSettings& settings, FRunResult& result)
+	{
+		FNLCommandletWorld benchmarkWorld(TEXT("NLCompareBenchmark"));
+		UWorld* world = benchmarkWorld.Get();
+
+		TArray<APawn*> subjects;
+		for(int32 subjectIndex = 0; subjectIndex < SubjectCount; ++subjectIndex)
+		{
+			subjects.Add(benchmarkWorld.SpawnPawn(FVector(subjectIndex * 2000.0f, -2000.0f, 0.0f)));
+		}
+
+		TArray<FReferenceAgent> agents;
+		agents.Reserve(agentCount);
+		for(int32 agentIndex = 0; agentIndex < agentCount; ++agentIndex)
+		{
+			const FVector location((agentIndex % 100) * 200.0f, (agentIndex / 100) * 200.0f, 0.0f);
+			APawn* pawn = benchmarkWorld.SpawnPawn(location);
+			AAIController* controller = world->SpawnActor<AAIController>(AAIController::StaticClass(), location, FRotator::ZeroRotator);
+			if(!pawn || !controller)
+			{
+				UE_LOG(LogNextLife, Error, TEXT("Couldn't spawn reference AI %d"), agentIndex);
+				return false;
+			}
+			controller->Possess(pawn);
+
+			FReferenceAgent& agent = agents.AddZeroed_GetRef();
+			agent.Controller = controller;
+			agent.Subject = subjects[agentIndex % SubjectCount];
+			agent.NextSightTime = settings.SightPeriod * agentIndex / agentCount;
+			agent.SightFrame = INDEX_NONE;
+		}
+
+		// Shared by every agent, like the NextLife behavior and action classes
+		UBehaviorTree* tree = system == EReferenceSystem::BehaviorTree
+							? NLCreateReferenceBehaviorTree(GetTransientPackage(), GetDefault<UNLReferenceBehavior>()->Settings)
+							: nullptr;
+
+		// Only setting the AI up is measured for memory, the pawns and controllers are the same for every system
+		const uint64 usedMemoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+		{
+			FNLObjectCreateCounter objectCounter;
+			for(FReferenceAgent& agent : agents)
+			{
+				if(system == EReferenceSystem::NextLife)
+				{
+					agent.Brain = NewObject<UNextLifeBrainComponent>(agent.Controller);
+					agent.Brain->UseTickManager = true;
+					agent.Brain->RegisterComponent();
+					agent.Controller->BrainComponent = agent.Brain;
+					agent.Brain->AddBehavior(UNLReferenceBehavior::StaticClass());
+					agent.Brain->StartLogic();
+					agent.Behavior = agent.Brain->FindBehavior(UNLReferenceBehavior::StaticClass());
+				}
+				else if(system == EReferenceSystem::BehaviorTree)
+				{
+					agent.Controller->RunBehaviorTree(tree);
+					agent.TreeComponent = Cast<UBehaviorTreeComponent>(agent.Controller->GetBrainComponent());
+					agent.Blackboard = agent.Controller->GetBlackboardComponent();
+					if(!agent.TreeComponent || !agent.Blackboard)
+					{
+						UE_LOG(LogNextLife, Error, TEXT("Couldn't run the reference Behavior Tree"));
+						return false;
+					}
+					agent.Blackboard->SetValueAsVector(FNLReferenceBlackboardKeys::Home, agent.Controller->GetPawn()->GetActorLocation());
+				}
+			}
+			result.ObjectsPerAgent = static_cast<double>(objectCounter.Count) / agentCount;
+			result.ObjectBytesPerAgent = static_cast<double>(objectCounter.Bytes) / agentCount;
+		}
+		result.MemoryBytesPerAgent = (static_cast<double>(FPlatformMemory::GetStats().UsedPhysical) - usedMemoryBefore) / agentCount;
+
+		double totalFrameMs = 0.0;
+		for(int32 frameIndex = 0; frameIndex < settings.WarmupFrames + settings.FrameCount; ++frameIndex)
+		{
+			const bool measure = frameIndex >= settings.WarmupFrames;
+			const float time = frameIndex * settings.DeltaTime;
+
+			// Sightings arrive between frames, spread evenly over the agents
+			for(FReferenceAgent& agent : agents)
+			{
+				if(!agent.SubjectVisible && time >= agent.NextSightTime)
+				{
+					DeliverSight(system, agent, true);
+					agent.SightFrame = frameIndex;
+					agent.SightLostTime = time + settings.SightDuration;
+					agent.NextSightTime += settings.SightPeriod;
+				}
+				else if(agent.SubjectVisible && time >= agent.SightLostTime)
+				{
+					DeliverSight(system, agent, false);
+					if(agent.SightFrame >= settings.WarmupFrames)
+					{
+						++result.Unreacted;
+					}
+					agent.SightFrame = INDEX_NONE;
+				}
+			}
+
+			const double tickStart = FPlatformTime::Seconds();
+			benchmarkWorld.Tick(settings.DeltaTime);
+			if(measure)
+			{
+				totalFrameMs += (FPlatformTime::Seconds() - tickStart) * 1000.0;
+			}
+
+			if(system == EReferenceSystem::None)
+			{
+				continue;
+			}
+
+			for(FReferenceAgent& agent : agents)
+			{
+				if(agent.SightFrame != INDEX_NONE && IsChasing(system, agent))
+				{
+					if(agent.SightFrame >= settings.WarmupFrames)
+					{
+						result.ReactionFrames.Add(frameIndex - agent.SightFrame + 1);
+						++result.Sightings;
+					}
+					agent.SightFrame = INDEX_NONE;
+				}
+			}
+		}
+		result.FrameMs = totalFrameMs / settings.FrameCount;
+		result.Sightings += result.Unreacted;
+
+		for(FReferenceAgent& agent : agents)
+		{
+			if(agent.Brain)
+			{
+				agent.Brain->StopLogic(TEXT("Benchmark finished"));
+			}
+			else if(agent.TreeComponent)
+			{
+				agent.TreeComponent->StopTree();
+			}
+		}
+		return true;
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	bool ParseList(const FString& Params, const TCHAR* name, TArray<FString>& values)
+	{
+		FString list;
+		if(!FParse::Value(*Params, name, list, false))
+		{
+			return false;
+		}
+		list.ParseIntoArray(values, TEXT(","));
+		return true;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLCompareBenchmarkCommandlet::UNLCompareBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLCompareBenchmarkCommandlet::Main(const FString& Params)
+{
+	FRunSettings settings;
+	settings.FrameCount = 600;
+	settings.WarmupFrames = 120;
+	settings.DeltaTime = 1.0f / 30.0f;
+	settings.SightPeriod = 4.0f;
+	settings.SightDuration = 1.5f;
+	FParse::Value(*Params, TEXT("Frames="), settings.FrameCount);
+	FParse::Value(*Params, TEXT("Warmup="), settings.WarmupFrames);
+	FParse::Value(*Params, TEXT("DeltaTime="), settings.DeltaTime);
+	FParse::Value(*Params, TEXT("SightPeriod="), settings.SightPeriod);
+	FParse::Value(*Params, TEXT("SightDuration="), settings.SightDuration);
+	settings.FrameCount = FMath::Max(settings.FrameCount, 1);
+	settings.WarmupFrames = FMath::Max(settings.WarmupFrames, 0);
+	settings.SightPeriod = FMath::Max(settings.SightPeriod, settings.DeltaTime * 2.0f);
+	settings.SightDuration = FMath::Min(settings.SightDuration, settings.SightPeriod * 0.5f);
+
+	TArray<int32> counts = { 100, 500, 1000, 2000 };
+	TArray<FString> listValues;
+	if(ParseList(Params, TEXT("Counts="), listValues))
+	{
+		counts.Reset();
+		for(const FString& countString : listValues)
+		{
+			counts.Add(FMath::Max(FCString::Atoi(*countString), 1));
+		}
+	}
+
+	TArray<EReferenceSystem> systems = { EReferenceSystem::NextLife, EReferenceSystem::BehaviorTree };
+	if(ParseList(Params, TEXT("Systems="), listValues))
+	{
+		systems.Reset();
+		for(const FString& systemName : listValues)
+		{
+			const int32 systemIndex = Algo::IndexOfByPredicate(SystemNames, [&systemName](const TCHAR* name) { return systemName == name; });
+			if(systemIndex == INDEX_NONE || systemIndex == static_cast<int32>(EReferenceSystem::None))
+			{
+				UE_LOG(LogNextLife, Error, TEXT("Unknown system '%s', expected NextLife or BehaviorTree"), *systemName);
+				return 1;
+			}
+			systems.Add(static_cast<EReferenceSystem>(systemIndex));
+		}
+	}
+
+	TArray<TSharedPtr<FJsonValue>> results;
+	for(int32 count : counts)
+	{
+		FRunResult noneResult = {};
+		if(!RunSystem(EReferenceSystem::None, count, settings, noneResult))
+		{
+			return 1;
+		}
+
+		for(EReferenceSystem system : systems)
+		{
+			FRunResult runResult = {};
+			if(!RunSystem(system, count, settings, runResult))
+			{
+				return 1;
+			}
+
+			double reactionFrames = 0.0;
+			for(double frames : runResult.ReactionFrames)
+			{
+				reactionFrames += frames;
+			}
+			reactionFrames = runResult.ReactionFrames.Num() > 0 ? reactionFrames / runResult.ReactionFrames.Num() : 0.0;
+			const double frameToMs = settings.DeltaTime * 1000.0;
+			const double aiUsPerAgent = (runResult.FrameMs - noneResult.FrameMs) * 1000.0 / count;
+
+			TSharedRef<FJsonObject> result = MakeShared<FJsonObject>();
+			result->SetStringField(TEXT("System"), SystemNames[static_cast<int32>(system)]);
+			result->SetNumberField(TEXT("Count"), count);
+			result->SetNumberField(TEXT("FrameMs"), runResult.FrameMs);
+			result->SetNumberField(TEXT("NoAIFrameMs"), noneResult.FrameMs);
+			result->SetNumberField(TEXT("AIUsPerAgent"), aiUsPerAgent);
+			result->SetNumberField(TEXT("ObjectsPerAgent"), runResult.ObjectsPerAgent);
+			result->SetNumberField(TEXT("ObjectBytesPerAgent"), runResult.ObjectBytesPerAgent);
+			result->SetNumberField(TEXT("MemoryBytesPerAgent"), runResult.MemoryBytesPerAgent);
+			result->SetNumberField(TEXT("Sightings"), runResult.Sightings);
+			result->SetNumberField(TEXT("Unreacted"), runResult.Unreacted);
+			result->SetNumberField(TEXT("ReactionFrames"), reactionFrames);
+			result->SetNumberField(TEXT("ReactionMs"), reactionFrames * frameToMs);
+			result->SetNumberField(TEXT("ReactionMsP95"), NLGetPercentile(runResult.ReactionFrames, 0.95f) * frameToMs);
+			result->SetNumberField(TEXT("ReactionMsMax"), NLGetPercentile(runResult.ReactionFrames, 1.0f) * frameToMs);
+			results.Add(MakeShared<FJsonValueObject>(result));
+
+			UE_LOG(LogNextLife, Display, TEXT("%-12s %5d agents: %8.3fms per frame, %7.3fus AI per agent, %5.1f objects %8.0f bytes per agent (%8.0f bytes used), reaction %.2f frames (p95 %.1fms), %d of %d sightings unreacted"),
+				   SystemNames[static_cast<int32>(system)], count, runResult.FrameMs, aiUsPerAgent, runResult.ObjectsPerAgent,
+				   runResult.ObjectBytesPerAgent, runResult.MemoryBytesPerAgent, reactionFrames,
+				   NLGetPercentile(runResult.ReactionFrames, 0.95f) * frameToMs, runResult.Unreacted, runResult.Sightings);
+		}
+	}
+
+	FString outputPath;
+	if(FParse::Value(*Params, TEXT("Output="), outputPath))
+	{
+		TSharedRef<FJsonObject> output = MakeShared<FJsonObject>();
+		output->SetStringField(TEXT("Benchmark"), TEXT("Compare"));
+		output->SetNumberField(TEXT("Frames"), settings.FrameCount);
+		output->SetNumberField(TEXT("DeltaTime"), settings.DeltaTime);
+		output->SetNumberField(TEXT("SightPeriod"), settings.SightPeriod);
+		output->SetNumberField(TEXT("SightDuration"), settings.SightDuration);
+		output->SetArrayField(TEXT("Results"), results);
+
+		FString json;
+		TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&json);
+		FJsonSerializer::Serialize(output, writer);
+		if(!FFileHelper::SaveStringToFile(json, *outputPath))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't write '%s'"), *outputPath);
+			return 1;
+		}
+		UE_LOG(LogNextLife, Display, TEXT("Wrote comparison results to '%s'"), *outputPath);
+	}
+	return 0;
+}
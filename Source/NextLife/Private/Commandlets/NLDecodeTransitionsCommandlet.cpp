@@ -0,0 +1,53 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Commandlets/NLDecodeTransitionsCommandlet.h"
+#include "NextLifeModule.h"
+#include "NLTransitionRecorder.h"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLDecodeTransitionsCommandlet::UNLDecodeTransitionsCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLDecodeTransitionsCommandlet::Main(const FString& Params)
+{
+	FString inputPath;
+	if(!FParse::Value(*Params, TEXT("File="), inputPath))
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Usage: -run=NLDecodeTransitions -File=<file.nltr> [-Output=<file.txt>]"));
+		return 1;
+	}
+
+	FString outputPath;
+	if(!FParse::Value(*Params, TEXT("Output="), outputPath))
+	{
+		outputPath = FPaths::ChangeExtension(inputPath, TEXT("txt"));
+	}
+
+	FString decoded;
+	if(!FNLTransitionRecorder::DecodeFile(inputPath, decoded))
+	{
+		return 1;
+	}
+
+	if(!FFileHelper::SaveStringToFile(decoded, *outputPath))
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Couldn't write '%s'"), *outputPath);
+		return 1;
+	}
+
+	UE_LOG(LogNextLife, Display, TEXT("Decoded '%s' to '%s'"), *inputPath, *outputPath);
+	return 0;
+}
@@ -0,0 +1,365 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Commandlets/NLPerfGateCommandlet.h"
+#include "Commandlets/NLBenchmarkCommandlet.h"
+#include "Commandlets/NLStackBenchmarkCommandlet.h"
+#include "NextLifeModule.h"
+
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace
+{
+	const TCHAR* CrowdBenchmark = TEXT("Crowd");
+	const TCHAR* ActionStackBenchmark = TEXT("ActionStack");
+
+	// A metric gated by the default baselines
+	struct FDefaultMetric
+	{
+		const TCHAR* Name;
+		double Tolerance;
+		double AbsoluteTolerance;
+	};
+
+	// Tick cost, event dispatch latency and allocations per transition of a 1000 AI crowd
+	const FDefaultMetric DefaultCrowdMetrics[] =
+	{
+		{ TEXT("FrameMs"), 0.15, 0.05 },
+		{ TEXT("TickManagerMs"), 0.15, 0.05 },
+		{ TEXT("TickMsPerBrain"), 0.15, 0.0001 },
+		{ TEXT("EventDispatchUs"), 0.2, 0.05 },
+		{ TEXT("ObjectAllocationsPerTransition"), 0.05, 0.01 },
+		{ TEXT("GCMs"), 0.25, 0.5 },
+	};
+
+	// Every action stack result is gated with these tolerances
+	const double DefaultStackTolerance = 0.2;
+	const double DefaultStackAbsoluteTolerance = 5.0;
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	TSharedPtr<FJsonObject> LoadJson(const FString& path)
+	{
+		FString json;
+		TSharedPtr<FJsonObject> object;
+		if(FFileHelper::LoadFileToString(json, *path))
+		{
+			FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(json), object);
+		}
+		return object;
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	bool SaveJson(const TSharedRef<FJsonObject>& object, const FString& path)
+	{
+		FString json;
+		FJsonSerializer::Serialize(object, TJsonWriterFactory<>::Create(&json));
+		return FFileHelper::SaveStringToFile(json, *path);
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Runs a benchmark commandlet in this process, outputting its metrics by name
+	*/
+	bool RunBenchmark(const FString& benchmark, const FString& args, TMap<FString, double>& metricsOut)
+	{
+		UClass* commandletClass = nullptr;
+		if(benchmark == CrowdBenchmark)
+		{
+			commandletClass = UNLBenchmarkCommandlet::StaticClass();
+		}
+		else if(benchmark == ActionStackBenchmark)
+		{
+			commandletClass = UNLStackBenchmarkCommandlet::StaticClass();
+		}
+		else
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Unknown benchmark '%s'"), *benchmark);
+			return false;
+		}
+
+		const FString outputPath = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("NLPerfGate"), TEXT(".json"));
+		UCommandlet* commandlet = NewObject<UCommandlet>(GetTransientPackage(), commandletClass);
+		const int32 result = commandlet->Main(FString::Printf(TEXT("%s -Output=\"%s\""), *args, *outputPath));
+		TSharedPtr<FJsonObject> output = result == 0 ? LoadJson(outputPath) : nullptr;
+		IFileManager::Get().Delete(*outputPath);
+		if(!output)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Benchmark '%s %s' failed"), *benchmark, *args);
+			return false;
+		}
+
+		if(benchmark == CrowdBenchmark)
+		{
+			const TSharedPtr<FJsonObject>* metrics = nullptr;
+			if(output->TryGetObjectField(TEXT("Metrics"), metrics))
+			{
+				for(const TPair<FString, TSharedPtr<FJsonValue>>& metric : (*metrics)->Values)
+				{
+					metricsOut.Add(metric.Key, metric.Value->AsNumber());
+				}
+			}
+		}
+		else
+		{
+			const TArray<TSharedPtr<FJsonValue>>* results = nullptr;
+			if(output->TryGetArrayField(TEXT("Results"), results))
+			{
+				for(const TSharedPtr<FJsonValue>& resultValue : *results)
+				{
+					const TSharedPtr<FJsonObject>& stackResult = resultValue->AsObject();
+					const FString name = FString::Printf(TEXT("%s@%d"), *stackResult->GetStringField(TEXT("Name")),
+														 static_cast<int32>(stackResult->GetNumberField(TEXT("Depth"))));
+					metricsOut.Add(name, stackResult->GetNumberField(TEXT("NsPerOp")));
+				}
+			}
+		}
+		return true;
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	double GetMedian(TArray<double> values)
+	{
+		check(values.Num() > 0);
+		values.Sort();
+		const int32 middle = values.Num() / 2;
+		return (values.Num() & 1) ? values[middle] : (values[middle - 1] + values[middle]) * 0.5;
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Creates the gated metrics of a new baseline from measured values
+	*/
+	TSharedRef<FJsonObject> CreateDefaultMetrics(const FString& benchmark, const TMap<FString, double>& measured)
+	{
+		TSharedRef<FJsonObject> metrics = MakeShared<FJsonObject>();
+		auto addMetric = [&metrics](const FString& name, double value, double tolerance, double absoluteTolerance)
+		{
+			TSharedRef<FJsonObject> metric = MakeShared<FJsonObject>();
+			metric->SetNumberField(TEXT("Baseline"), value);
+			metric->SetNumberField(TEXT("Tolerance"), tolerance);
+			metric->SetNumberField(TEXT("AbsoluteTolerance"), absoluteTolerance);
+			metrics->SetObjectField(name, metric);
+		};
+
+		if(benchmark == CrowdBenchmark)
+		{
+			for(const FDefaultMetric& defaultMetric : DefaultCrowdMetrics)
+			{
+				if(const double* value = measured.Find(defaultMetric.Name))
+				{
+					addMetric(defaultMetric.Name, *value, defaultMetric.Tolerance, defaultMetric.AbsoluteTolerance);
+				}
+			}
+		}
+		else
+		{
+			for(const TPair<FString, double>& value : measured)
+			{
+				addMetric(value.Key, value.Value, DefaultStackTolerance, DefaultStackAbsoluteTolerance);
+			}
+		}
+		return metrics;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLPerfGateCommandlet::UNLPerfGateCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLPerfGateCommandlet::Main(const FString& Params)
+{
+	FString baselineDir;
+	if(!FParse::Value(*Params, TEXT("Baselines="), baselineDir))
+	{
+		TSharedPtr<IPlugin> plugin = IPluginManager::Get().FindPlugin(TEXT("NextLife"));
+		baselineDir = plugin.IsValid() ? plugin->GetBaseDir() / TEXT("Benchmarks") / TEXT("Baselines") : FString();
+	}
+
+	int32 runCount = 3;
+	FParse::Value(*Params, TEXT("Runs="), runCount);
+	runCount = FMath::Max(runCount, 1);
+	const bool updateBaselines = FParse::Param(*Params, TEXT("UpdateBaseline"));
+
+	// Baseline file paths and contents
+	TArray<TPair<FString, TSharedPtr<FJsonObject>>> baselines;
+	TArray<FString> baselineFiles;
+	IFileManager::Get().FindFiles(baselineFiles, *(baselineDir / TEXT("*.json")), true, false);
+	for(const FString& baselineFile : baselineFiles)
+	{
+		const FString path = baselineDir / baselineFile;
+		TSharedPtr<FJsonObject> baseline = LoadJson(path);
+		if(!baseline)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't read baseline '%s'"), *path);
+			return 1;
+		}
+		baselines.Emplace(path, baseline);
+	}
+
+	if(baselines.Num() == 0)
+	{
+		if(!updateBaselines)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("No baselines in '%s', create them on the gate machine with -UpdateBaseline"), *baselineDir);
+			return 1;
+		}
+
+		TSharedRef<FJsonObject> crowd = MakeShared<FJsonObject>();
+		crowd->SetStringField(TEXT("Benchmark"), CrowdBenchmark);
+		crowd->SetStringField(TEXT("Args"), TEXT("-Count=1000 -Frames=300"));
+		baselines.Emplace(baselineDir / TEXT("Crowd.json"), crowd);
+
+		TSharedRef<FJsonObject> actionStack = MakeShared<FJsonObject>();
+		actionStack->SetStringField(TEXT("Benchmark"), ActionStackBenchmark);
+		actionStack->SetStringField(TEXT("Args"), TEXT("-Depths=1,4,10,16,64 -Iterations=20000"));
+		baselines.Emplace(baselineDir / TEXT("ActionStack.json"), actionStack);
+	}
+
+	bool passed = true;
+	TArray<TSharedPtr<FJsonValue>> reportResults;
+
+	for(const TPair<FString, TSharedPtr<FJsonObject>>& baselineEntry : baselines)
+	{
+		const FString& path = baselineEntry.Key;
+		const TSharedPtr<FJsonObject>& baseline = baselineEntry.Value;
+		const FString benchmark = baseline->GetStringField(TEXT("Benchmark"));
+		const FString args = baseline->GetStringField(TEXT("Args"));
+
+		// Median of each metric over the runs
+		TMap<FString, TArray<double>> runValues;
+		for(int32 runIndex = 0; runIndex < runCount; ++runIndex)
+		{
+			TMap<FString, double> runMetrics;
+			if(!RunBenchmark(benchmark, args, runMetrics))
+			{
+				return 1;
+			}
+			for(const TPair<FString, double>& runMetric : runMetrics)
+			{
+				runValues.FindOrAdd(runMetric.Key).Add(runMetric.Value);
+			}
+		}
+
+		TMap<FString, double> measured;
+		for(const TPair<FString, TArray<double>>& values : runValues)
+		{
+			measured.Add(values.Key, GetMedian(values.Value));
+		}
+
+		const TSharedPtr<FJsonObject>* metrics = nullptr;
+		if(updateBaselines)
+		{
+			if(baseline->TryGetObjectField(TEXT("Metrics"), metrics))
+			{
+				for(const TPair<FString, TSharedPtr<FJsonValue>>& metric : (*metrics)->Values)
+				{
+					if(const double* value = measured.Find(metric.Key))
+					{
+						metric.Value->AsObject()->SetNumberField(TEXT("Baseline"), *value);
+					}
+				}
+			}
+			else
+			{
+				baseline->SetObjectField(TEXT("Metrics"), CreateDefaultMetrics(benchmark, measured));
+			}
+
+			if(!SaveJson(baseline.ToSharedRef(), path))
+			{
+				UE_LOG(LogNextLife, Error, TEXT("Couldn't write baseline '%s'"), *path);
+				return 1;
+			}
+			UE_LOG(LogNextLife, Display, TEXT("Updated baseline '%s'"), *path);
+			continue;
+		}
+
+		if(!baseline->TryGetObjectField(TEXT("Metrics"), metrics))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Baseline '%s' has no metrics"), *path);
+			return 1;
+		}
+
+		for(const TPair<FString, TSharedPtr<FJsonValue>>& metric : (*metrics)->Values)
+		{
+			const TSharedPtr<FJsonObject>& gate = metric.Value->AsObject();
+			const double baselineValue = gate->GetNumberField(TEXT("Baseline"));
+			double tolerance = 0.0;
+			double absoluteTolerance = 0.0;
+			gate->TryGetNumberField(TEXT("Tolerance"), tolerance);
+			gate->TryGetNumberField(TEXT("AbsoluteTolerance"), absoluteTolerance);
+			const double limit = baselineValue * (1.0 + tolerance) + absoluteTolerance;
+
+			const double* value = measured.Find(metric.Key);
+			const bool metricPassed = value && *value <= limit;
+			passed &= metricPassed;
+
+			if(value)
+			{
+				const double change = baselineValue != 0.0 ? (*value / baselineValue - 1.0) * 100.0 : 0.0;
+				UE_LOG(LogNextLife, Display, TEXT("%s %-36s %12.4f baseline %12.4f (%+6.1f%%, limit %.4f)"),
+					   metricPassed ? TEXT("PASS") : TEXT("FAIL"), *FString::Printf(TEXT("%s.%s"), *benchmark, *metric.Key),
+					   *value, baselineValue, change, limit);
+			}
+			else
+			{
+				UE_LOG(LogNextLife, Error, TEXT("FAIL %s.%s wasn't measured"), *benchmark, *metric.Key);
+			}
+
+			TSharedRef<FJsonObject> reportResult = MakeShared<FJsonObject>();
+			reportResult->SetStringField(TEXT("Benchmark"), benchmark);
+			reportResult->SetStringField(TEXT("Metric"), metric.Key);
+			reportResult->SetNumberField(TEXT("Baseline"), baselineValue);
+			reportResult->SetNumberField(TEXT("Measured"), value ? *value : -1.0);
+			reportResult->SetNumberField(TEXT("Limit"), limit);
+			reportResult->SetBoolField(TEXT("Passed"), metricPassed);
+			reportResults.Add(MakeShared<FJsonValueObject>(reportResult));
+		}
+	}
+
+	if(updateBaselines)
+	{
+		return 0;
+	}
+
+	FString reportPath;
+	if(FParse::Value(*Params, TEXT("Report="), reportPath))
+	{
+		TSharedRef<FJsonObject> report = MakeShared<FJsonObject>();
+		report->SetBoolField(TEXT("Passed"), passed);
+		report->SetArrayField(TEXT("Results"), reportResults);
+		if(!SaveJson(report, reportPath))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't write '%s'"), *reportPath);
+		}
+	}
+
+	if(!passed)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("NextLife performance regressed beyond the baseline tolerances"));
+		return 1;
+	}
+	UE_LOG(LogNextLife, Display, TEXT("NextLife performance is within the baseline tolerances"));
+	return 0;
+}
@@ -0,0 +1,177 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Commandlets/NLReplayEventsCommandlet.h"
+#include "NLCommandletWorld.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+#include "NLEventRecorder.h"
+
+#include "AIController.h"
+#include "Misc/FileHelper.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLReplayEventsCommandlet::UNLReplayEventsCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLReplayEventsCommandlet::Main(const FString& Params)
+{
+	FString inputPath;
+	if(!FParse::Value(*Params, TEXT("File="), inputPath))
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Usage: -run=NLReplayEvents -File=<file.nlev> [-Updates=<count>] [-Repeat=<count>] [-Csv=<file.csv>]"));
+		return 1;
+	}
+
+	FNLEventReplay replay;
+	if(!replay.LoadFile(inputPath))
+	{
+		return 1;
+	}
+
+	int32 maxUpdates = replay.GetUpdateCount();
+	FParse::Value(*Params, TEXT("Updates="), maxUpdates);
+	int32 repeatCount = 1;
+	FParse::Value(*Params, TEXT("Repeat="), repeatCount);
+	repeatCount = FMath::Max(repeatCount, 1);
+
+	// Best time of each update over all repeats
+	TArray<double> updateMs;
+	TArray<int32> updateEvents;
+
+	for(int32 repeatIndex = 0; repeatIndex < repeatCount; ++repeatIndex)
+	{
+		FNLCommandletWorld replayWorld(TEXT("NLReplayEvents"));
+		UWorld* world = replayWorld.Get();
+
+		UClass* pawnClass = replay.GetPawnClass();
+		APawn* pawn = world->SpawnActor<APawn>(pawnClass ? pawnClass : APawn::StaticClass());
+		AAIController* controller = world->SpawnActor<AAIController>();
+		if(!pawn || !controller)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't spawn the replay pawn and controller"));
+			return 1;
+		}
+		if(pawn->GetController())
+		{
+			pawn->GetController()->UnPossess();
+		}
+		controller->Possess(pawn);
+
+		// Actions using the global random streams make the same choices every replay
+		FMath::RandInit(0);
+		FMath::SRandInit(0);
+
+		UNextLifeBrainComponent* brain = replay.CreateBrain(controller);
+
+		// Recorded actors don't exist here, stand-ins follow their recorded locations
+		TMap<int32, APawn*> standIns;
+		auto resolveSubject = [world, &standIns](int32 subjectIndex, const FVector& location) -> AActor*
+		{
+			APawn*& standIn = standIns.FindOrAdd(subjectIndex);
+			if(!standIn)
+			{
+				FActorSpawnParameters spawnParameters;
+				spawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+				standIn = world->SpawnActor<APawn>(APawn::StaticClass(), location, FRotator::ZeroRotator, spawnParameters);
+			}
+			else
+			{
+				standIn->SetActorLocation(location);
+			}
+			return standIn;
+		};
+
+		int32 updateIndex = 0;
+		int32 eventsBeforeUpdate = 0;
+		for(const FNLRecordedEvent& recordedEvent : replay.GetEvents())
+		{
+			if(updateIndex >= maxUpdates)
+			{
+				break;
+			}
+
+			if(recordedEvent.Type != ENLRecordedEventType::Update)
+			{
+				replay.Deliver(*brain, recordedEvent, resolveSubject);
+				++eventsBeforeUpdate;
+				continue;
+			}
+
+			// Advance world time and everything else first so only the brain update is timed
+			replayWorld.Tick(recordedEvent.DeltaTime);
+
+			const double startTime = FPlatformTime::Seconds();
+			brain->TickBrain(recordedEvent.DeltaTime);
+			const double elapsedMs = (FPlatformTime::Seconds() - startTime) * 1000.0;
+
+			if(repeatIndex == 0)
+			{
+				updateMs.Add(elapsedMs);
+				updateEvents.Add(eventsBeforeUpdate);
+			}
+			else
+			{
+				updateMs[updateIndex] = FMath::Min(updateMs[updateIndex], elapsedMs);
+			}
+			eventsBeforeUpdate = 0;
+			++updateIndex;
+		}
+
+		brain->StopLogic(TEXT("Replay finished"));
+	}
+
+	// Report the slowest updates with the frame they were recorded on, so a spike can be found in the recording
+	const TArray<FNLRecordedEvent>& events = replay.GetEvents();
+	TArray<uint32> updateFrames;
+	for(const FNLRecordedEvent& recordedEvent : events)
+	{
+		if(recordedEvent.Type == ENLRecordedEventType::Update && updateFrames.Num() < updateMs.Num())
+		{
+			updateFrames.Add(recordedEvent.Frame);
+		}
+	}
+
+	double totalMs = 0.0;
+	int32 slowestIndex = INDEX_NONE;
+	FString csv = TEXT("Update,Frame,Events,Ms") LINE_TERMINATOR;
+	for(int32 updateIndex = 0; updateIndex < updateMs.Num(); ++updateIndex)
+	{
+		totalMs += updateMs[updateIndex];
+		if(slowestIndex == INDEX_NONE || updateMs[updateIndex] > updateMs[slowestIndex])
+		{
+			slowestIndex = updateIndex;
+		}
+		csv += FString::Printf(TEXT("%d,%u,%d,%.4f"), updateIndex, updateFrames[updateIndex], updateEvents[updateIndex], updateMs[updateIndex]);
+		csv += LINE_TERMINATOR;
+	}
+
+	UE_LOG(LogNextLife, Display, TEXT("Replayed %d updates of '%s' %d times, %.3fms total, %.4fms average"), updateMs.Num(),
+		   *inputPath, repeatCount, totalMs, updateMs.Num() > 0 ? totalMs / updateMs.Num() : 0.0);
+	if(slowestIndex != INDEX_NONE)
+	{
+		UE_LOG(LogNextLife, Display, TEXT("Slowest update %d (recorded frame %u, %d events) took %.4fms"), slowestIndex,
+			   updateFrames[slowestIndex], updateEvents[slowestIndex], updateMs[slowestIndex]);
+	}
+
+	FString csvPath;
+	if(FParse::Value(*Params, TEXT("Csv="), csvPath))
+	{
+		if(!FFileHelper::SaveStringToFile(csv, *csvPath))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't write '%s'"), *csvPath);
+			return 1;
+		}
+		UE_LOG(LogNextLife, Display, TEXT("Wrote update timings to '%s'"), *csvPath);
+	}
+	return 0;
+}
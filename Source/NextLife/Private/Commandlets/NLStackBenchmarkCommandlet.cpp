@@ -0,0 +1,320 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Commandlets/NLStackBenchmarkCommandlet.h"
+#include "NLCommandletWorld.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+#include "Behaviors/NLBenchmarkBehavior.h"
+#include "Actions/Benchmark/NLBenchmarkAction.h"
+#include "Actions/Benchmark/NLBenchmarkChainAction.h"
+#include "NLEventOverrides.h"
+
+#include "AIController.h"
+#include "Dom/JsonObject.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace
+{
+	// Keeps the results of timed calls alive so they aren't optimized away
+	volatile int64 ResultSink = 0;
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Returns the average nanoseconds of an operation, after a short warm up
+	*/
+	template<typename TOperation>
+	double TimeOperation(int32 iterations, TOperation&& operation)
+	{
+		for(int32 iteration = 0; iteration < FMath::Max(iterations / 10, 1); ++iteration)
+		{
+			operation();
+		}
+
+		const double startTime = FPlatformTime::Seconds();
+		for(int32 iteration = 0; iteration < iterations; ++iteration)
+		{
+			operation();
+		}
+		return (FPlatformTime::Seconds() - startTime) * 1.0e9 / iterations;
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Returns the average nanoseconds of an operation which needs untimed setup or cleanup around each run
+	*/
+	template<typename TSetup, typename TOperation, typename TCleanup>
+	double TimeOperation(int32 iterations, TSetup&& setup, TOperation&& operation, TCleanup&& cleanup)
+	{
+		uint64 totalCycles = 0;
+		for(int32 iteration = 0; iteration < iterations; ++iteration)
+		{
+			setup();
+			const uint64 startCycles = FPlatformTime::Cycles64();
+			operation();
+			totalCycles += FPlatformTime::Cycles64() - startCycles;
+			cleanup();
+		}
+		return FPlatformTime::ToSeconds64(totalCycles) * 1.0e9 / iterations;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLStackBenchmarkCommandlet::UNLStackBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLStackBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 iterations = 20000;
+	FParse::Value(*Params, TEXT("Iterations="), iterations);
+	iterations = FMath::Max(iterations, 1);
+
+	TArray<int32> depths = { 1, 4, 10, 16, 64 };
+	FString depthsParam;
+	if(FParse::Value(*Params, TEXT("Depths="), depthsParam, false))
+	{
+		TArray<FString> depthStrings;
+		depthsParam.ParseIntoArray(depthStrings, TEXT(","));
+		depths.Reset();
+		for(const FString& depthString : depthStrings)
+		{
+			depths.Add(FMath::Max(FCString::Atoi(*depthString), 1));
+		}
+	}
+
+	FNLCommandletWorld benchmarkWorld(TEXT("NLStackBenchmark"));
+	UWorld* world = benchmarkWorld.Get();
+
+	// Actions rely on a valid pawn
+	APawn* pawn = world->SpawnActor<APawn>();
+	AAIController* controller = world->SpawnActor<AAIController>();
+	if(!pawn || !controller)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Couldn't spawn the benchmark pawn and controller"));
+		return 1;
+	}
+	controller->Possess(pawn);
+
+	UNextLifeBrainComponent* brain = NewObject<UNextLifeBrainComponent>(controller);
+	brain->MaxTransitionsPerFrame = 0;
+	brain->RegisterComponent();
+	controller->BrainComponent = brain;
+	brain->AddBehavior(UNLBenchmarkBehavior::StaticClass());
+
+	UNLBenchmarkBehavior* behavior = Cast<UNLBenchmarkBehavior>(brain->FindBehavior(UNLBenchmarkBehavior::StaticClass()));
+	check(behavior);
+	behavior->TransitionRate = 0.0f;
+	behavior->EventResponseChance = 0.0f;
+	behavior->PoolActions = FParse::Param(*Params, TEXT("PoolActions"));
+
+	UClass* stackClass = UNLBenchmarkAction::StaticClass();
+	UClass* chainClass = UNLBenchmarkChainAction::StaticClass();
+
+	TArray<TSharedPtr<FJsonValue>> results;
+	auto addResult = [&results](const TCHAR* name, int32 depth, int32 resultIterations, double nsPerOp, int32 transitions)
+	{
+		TSharedRef<FJsonObject> result = MakeShared<FJsonObject>();
+		result->SetStringField(TEXT("Name"), name);
+		result->SetNumberField(TEXT("Depth"), depth);
+		result->SetNumberField(TEXT("Iterations"), resultIterations);
+		result->SetNumberField(TEXT("NsPerOp"), nsPerOp);
+		if(transitions > 0)
+		{
+			result->SetNumberField(TEXT("NsPerTransition"), nsPerOp / transitions);
+		}
+		results.Add(MakeShared<FJsonValueObject>(result));
+		UE_LOG(LogNextLife, Display, TEXT("%-24s depth %3d: %10.1fns"), name, depth, nsPerOp);
+	};
+
+	// Dispatching an event and handling the responses to it is meant to be free of heap allocations, the benchmark fails
+	// if an operation allocates once it has run the first time
+	bool allocationFree = true;
+	auto checkAllocations = [&allocationFree, iterations](const TCHAR* name, int32 depth, TFunctionRef<void()> operation)
+	{
+		operation();
+		FNLHeapAllocationCounter allocationCounter;
+		for(int32 iteration = 0; iteration < iterations; ++iteration)
+		{
+			operation();
+		}
+		const int64 allocations = allocationCounter.GetCount();
+		if(allocations > 0)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("%s depth %d made %lld heap allocations in %d runs"), name, depth, allocations, iterations);
+			allocationFree = false;
+		}
+	};
+
+	// Builds a stack of benchmark actions depth deep
+	auto buildStack = [behavior](int32 depth)
+	{
+		behavior->StopBehavior(false);
+		behavior->StackDepth = depth;
+		behavior->ChainRemaining = 0;
+		behavior->BeginBehavior();
+	};
+
+	auto popTop = [behavior]()
+	{
+		behavior->BenchmarkApplyActionResult(FNLActionResult(ENLActionChangeType::DONE, nullptr, NAME_None));
+	};
+
+	for(int32 depth : depths)
+	{
+		buildStack(depth);
+
+		const TArrayView<UNLAction* const> stackView = behavior->GetActionStackView();
+		if(stackView.Num() != depth)
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Built a stack %d deep instead of %d"), stackView.Num(), depth);
+			return 1;
+		}
+		UNLAction* root = stackView[0];
+		UNLAction* top = stackView.Last();
+
+		// Queries
+		TArray<UNLAction*> stack;
+		addResult(TEXT("GetActionStack"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			ResultSink += behavior->GetActionStack(stack) ? stack.Num() : 0;
+		}), 0);
+		addResult(TEXT("GetActionStackView"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			ResultSink += behavior->GetActionStackView().Num();
+		}), 0);
+		addResult(TEXT("GetActionOfClass"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			ResultSink += behavior->GetActionOfClass(chainClass) != nullptr;
+		}), 0);
+		// The class queries used to walk the stack, kept as the reference the class index is measured against
+		addResult(TEXT("ClassScanReference"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			const TArrayView<UNLAction* const> scanView = behavior->GetActionStackView();
+			UNLAction* found = nullptr;
+			for(int32 stackIndex = scanView.Num() - 1; stackIndex >= 0 && !found; --stackIndex)
+			{
+				found = scanView[stackIndex]->GetClass()->IsChildOf(chainClass) ? scanView[stackIndex] : nullptr;
+			}
+			ResultSink += found != nullptr;
+		}), 0);
+		addResult(TEXT("IsBelowMe"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			ResultSink += top->IsBelowMe(root);
+		}), 0);
+		addResult(TEXT("IsActionClassBelowMe"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			ResultSink += top->IsActionClassBelowMe(chainClass);
+		}), 0);
+		addResult(TEXT("IsActionClassAboveMe"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			ResultSink += root->IsActionClassAboveMe(chainClass);
+		}), 0);
+
+		// A TRY response from the root is collected, refused by the top action and dropped, leaving the stack as it was.
+		// Responding with the stacks own action class makes every action above the root a takeover candidate.
+		auto applyPendingEvents = [&]()
+		{
+			behavior->BenchmarkStoreEventResponse(root, FNLEventResponse(ENLActionChangeType::SUSPEND, ENLEventRequestPriority::TRY, chainClass, NAME_None));
+			ResultSink += behavior->BenchmarkApplyPendingEvents() != nullptr;
+		};
+		addResult(TEXT("ApplyPendingEvents"), depth, iterations, TimeOperation(iterations, applyPendingEvents), 0);
+		checkAllocations(TEXT("ApplyPendingEvents"), depth, applyPendingEvents);
+		addResult(TEXT("TakeoverScan"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			behavior->BenchmarkStoreEventResponse(root, FNLEventResponse(ENLActionChangeType::SUSPEND, ENLEventRequestPriority::TRY, stackClass, NAME_None));
+			ResultSink += behavior->BenchmarkApplyPendingEvents() != nullptr;
+		}), 0);
+
+		// A sight event offered to every action on the stack, none of which respond to it
+		auto dispatchEvent = [&]()
+		{
+			ResultSink += NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sight, pawn, false).IsNone();
+		};
+		addResult(TEXT("EventDispatch"), depth, iterations, TimeOperation(iterations, dispatchEvent), 0);
+		checkAllocations(TEXT("EventDispatch"), depth, dispatchEvent);
+
+		// An appended suspend from the root is accepted by the top action and pushed, then popped untimed
+		addResult(TEXT("RequestAccepted"), depth, iterations, TimeOperation(iterations, [&]()
+		{
+			behavior->BenchmarkStoreEventResponse(root, FNLEventResponse(ENLActionChangeType::SUSPEND, ENLEventRequestPriority::IMPORTANT, chainClass,
+																		 NAME_None, nullptr, ENLSuspendBehavior::APPEND));
+		}, [&]()
+		{
+			ResultSink += behavior->BenchmarkApplyPendingEvents() != nullptr;
+		}, popTop), 1);
+
+		// Transition chains depth long, started from a single result on a one action stack
+		buildStack(1);
+		const int32 chainIterations = FMath::Max(iterations / depth, 100);
+		const FNLActionResult suspendForChain(ENLActionChangeType::SUSPEND, chainClass, NAME_None);
+
+		addResult(TEXT("ChangeChain"), depth, chainIterations, TimeOperation(chainIterations, [&]()
+		{
+			behavior->ChainChange = ENLActionChangeType::CHANGE;
+			behavior->ChainRemaining = depth - 1;
+		}, [&]()
+		{
+			ResultSink += behavior->BenchmarkApplyActionResult(FNLActionResult(suspendForChain)) != nullptr;
+		}, [&]()
+		{
+			behavior->ChainRemaining = 0;
+			popTop();
+		}), depth);
+
+		auto pushSuspendChain = [&]()
+		{
+			behavior->ChainChange = ENLActionChangeType::SUSPEND;
+			behavior->ChainRemaining = depth - 1;
+			ResultSink += behavior->BenchmarkApplyActionResult(FNLActionResult(suspendForChain)) != nullptr;
+		};
+		auto popDoneChain = [&]()
+		{
+			behavior->ChainChange = ENLActionChangeType::DONE;
+			behavior->ChainRemaining = depth - 1;
+			popTop();
+		};
+
+		addResult(TEXT("SuspendChain"), depth, chainIterations, TimeOperation(chainIterations, []() {}, pushSuspendChain, popDoneChain), depth);
+		addResult(TEXT("DoneChain"), depth, chainIterations, TimeOperation(chainIterations, pushSuspendChain, popDoneChain, []() {}), depth);
+	}
+
+	behavior->StopBehavior(false);
+
+	if(!allocationFree)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Event dispatch made heap allocations"));
+		return 1;
+	}
+
+	FString outputPath;
+	if(FParse::Value(*Params, TEXT("Output="), outputPath))
+	{
+		TSharedRef<FJsonObject> output = MakeShared<FJsonObject>();
+		output->SetStringField(TEXT("Benchmark"), TEXT("ActionStack"));
+		output->SetNumberField(TEXT("Iterations"), iterations);
+		output->SetBoolField(TEXT("PoolActions"), behavior->PoolActions);
+		output->SetArrayField(TEXT("Results"), results);
+
+		FString json;
+		TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&json);
+		FJsonSerializer::Serialize(output, writer);
+		if(!FFileHelper::SaveStringToFile(json, *outputPath))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't write '%s'"), *outputPath);
+			return 1;
+		}
+		UE_LOG(LogNextLife, Display, TEXT("Wrote action stack benchmark results to '%s'"), *outputPath);
+	}
+	return 0;
+}
@@ -0,0 +1,518 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "Crowd/NLCrowdSubsystem.h"
+#include "NextLifeModule.h"
+#include "NLBehavior.h"
+
+#include "GameFramework/Pawn.h"
+
+DECLARE_CYCLE_STAT(TEXT("Crowd Tick"), STAT_NextLife_CrowdTick, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Crowd Signals"), STAT_NextLife_CrowdSignals, STATGROUP_NextLife);
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLCrowdTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if(Crowd && TickType != LEVELTICK_ViewportsOnly)
+	{
+		Crowd->TickAgents(DeltaTime);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FString FNLCrowdTickFunction::DiagnosticMessage()
+{
+	return TEXT("FNLCrowdTickFunction");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLCrowdSubsystem::UNLCrowdSubsystem()
+	: MaxTransitionsPerFrame(64)
+	, IsTicking(false)
+	, AgentCount(0)
+	, TransitionsThisTick(0)
+	, LastTickChunkCount(0)
+	, LastTickSignalCount(0)
+	, LastTickTransitionCount(0)
+	, LastTickTimeMs(0.0f)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::Deinitialize()
+{
+	if(TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+	TickFunction.Crowd = nullptr;
+
+	for(int32 agentIndex = 0; agentIndex < AgentBehaviors.Num(); ++agentIndex)
+	{
+		if(AgentBehaviors[agentIndex])
+		{
+			RemoveAgentNow(FNLCrowdAgentHandle(agentIndex, AgentSerials[agentIndex]));
+		}
+	}
+
+	PendingSignals.Reset();
+	PendingMessages.Reset();
+	PendingHitResults.Reset();
+	PendingAdds.Reset();
+	PendingRemovals.Reset();
+
+	Super::Deinitialize();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLCrowdAgentHandle UNLCrowdSubsystem::AddAgent(TSubclassOf<UNLBehavior> behaviorClass, const FVector& location, APawn* pawn)
+{
+	if(!behaviorClass)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Trying to add a crowd agent without a behavior class"));
+		return FNLCrowdAgentHandle();
+	}
+
+	int32 agentIndex = INDEX_NONE;
+	if(FreeAgents.Num() > 0)
+	{
+		agentIndex = FreeAgents.Pop(false);
+	}
+	else
+	{
+		agentIndex = AgentBehaviors.AddZeroed();
+		AgentPawns.AddZeroed();
+		AgentLocations.AddUninitialized();
+		AgentSerials.Add(0);
+		AgentRunning.Add(false);
+		AgentChunks.Add(INDEX_NONE);
+		AgentChunkSlots.Add(INDEX_NONE);
+	}
+
+	const FNLCrowdAgentHandle agent(agentIndex, ++AgentSerials[agentIndex]);
+
+	UNLBehavior* behavior = NewObject<UNLBehavior>(this, behaviorClass);
+	behavior->CrowdAgent = agent;
+	behavior->OnBehaviorEnded.AddDynamic(this, &UNLCrowdSubsystem::OnAgentBehaviorEnded);
+
+	AgentBehaviors[agentIndex] = behavior;
+	AgentPawns[agentIndex] = pawn;
+	AgentLocations[agentIndex] = location;
+	AgentRunning[agentIndex] = true;
+	++AgentCount;
+
+	if(IsTicking)
+	{
+		// Can't grow the chunks while they are being iterated, the agent joins a chunk after the tick
+		PendingAdds.Add(agent);
+	}
+	else
+	{
+		AddAgentToChunk(agentIndex, behaviorClass);
+	}
+
+	// Register the tick function when the first agent shows up
+	if(!TickFunction.IsTickFunctionRegistered())
+	{
+		UWorld* world = GetWorld();
+		check(world && world->PersistentLevel);
+
+		TickFunction.Crowd = this;
+		TickFunction.bCanEverTick = true;
+		TickFunction.bTickEvenWhenPaused = false;
+		TickFunction.TickGroup = TG_DuringPhysics;
+		TickFunction.RegisterTickFunction(world->PersistentLevel);
+	}
+
+	return agent;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::RemoveAgent(FNLCrowdAgentHandle agent)
+{
+	if(!IsAgentValid(agent))
+	{
+		return;
+	}
+
+	if(IsTicking)
+	{
+		// Can't shuffle the chunks while they are being iterated, remove it after the tick
+		PendingRemovals.AddUnique(agent);
+		return;
+	}
+
+	RemoveAgentNow(agent);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::RemoveAgentNow(FNLCrowdAgentHandle agent)
+{
+	check(IsAgentValid(agent) && !IsTicking);
+
+	const int32 agentIndex = agent.Index;
+	UNLBehavior* behavior = AgentBehaviors[agentIndex];
+
+	// The agent stays valid while its actions end
+	behavior->OnBehaviorEnded.RemoveDynamic(this, &UNLCrowdSubsystem::OnAgentBehaviorEnded);
+	behavior->StopBehavior(false);
+	behavior->CrowdAgent = FNLCrowdAgentHandle();
+
+	// Agents added while ticking aren't in a chunk until the tick ends
+	if(AgentChunks[agentIndex] != INDEX_NONE)
+	{
+		RemoveAgentFromChunk(agentIndex);
+	}
+	AgentBehaviors[agentIndex] = nullptr;
+	AgentPawns[agentIndex] = nullptr;
+	AgentRunning[agentIndex] = false;
+	FreeAgents.Add(agentIndex);
+	--AgentCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::AddAgentToChunk(int32 agentIndex, UClass* behaviorClass)
+{
+	TArray<int32>& openChunks = OpenChunksByClass.FindOrAdd(behaviorClass);
+	if(openChunks.Num() == 0)
+	{
+		FChunk& newChunk = Chunks.AddDefaulted_GetRef();
+		newChunk.BehaviorClass = behaviorClass;
+		newChunk.Agents.Reserve(AgentsPerChunk);
+		openChunks.Add(Chunks.Num() - 1);
+	}
+
+	const int32 chunkIndex = openChunks.Last();
+	FChunk& chunk = Chunks[chunkIndex];
+	AgentChunks[agentIndex] = chunkIndex;
+	AgentChunkSlots[agentIndex] = chunk.Agents.Add(agentIndex);
+
+	if(chunk.Agents.Num() >= AgentsPerChunk)
+	{
+		openChunks.Pop(false);
+		if(openChunks.Num() == 0)
+		{
+			OpenChunksByClass.Remove(behaviorClass);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::RemoveAgentFromChunk(int32 agentIndex)
+{
+	const int32 chunkIndex = AgentChunks[agentIndex];
+	FChunk& chunk = Chunks[chunkIndex];
+	const bool wasFull = chunk.Agents.Num() >= AgentsPerChunk;
+
+	// Move the last agent of the chunk into the slot
+	const int32 slot = AgentChunkSlots[agentIndex];
+	chunk.Agents.RemoveAtSwap(slot, 1, false);
+	if(chunk.Agents.IsValidIndex(slot))
+	{
+		AgentChunkSlots[chunk.Agents[slot]] = slot;
+	}
+	AgentChunks[agentIndex] = INDEX_NONE;
+	AgentChunkSlots[agentIndex] = INDEX_NONE;
+
+	if(chunk.Agents.Num() == 0)
+	{
+		RemoveChunk(chunkIndex);
+	}
+	else if(wasFull)
+	{
+		OpenChunksByClass.FindOrAdd(chunk.BehaviorClass).Add(chunkIndex);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::RemoveChunk(int32 chunkIndex)
+{
+	check(Chunks[chunkIndex].Agents.Num() == 0 && !IsTicking);
+
+	const TWeakObjectPtr<UClass> behaviorClass = Chunks[chunkIndex].BehaviorClass;
+	if(TArray<int32>* openChunks = OpenChunksByClass.Find(behaviorClass))
+	{
+		openChunks->RemoveSingleSwap(chunkIndex, false);
+		if(openChunks->Num() == 0)
+		{
+			OpenChunksByClass.Remove(behaviorClass);
+		}
+	}
+
+	// The last chunk moves into the removed chunks index, point its agents and open entry at the new index
+	const int32 lastChunkIndex = Chunks.Num() - 1;
+	if(chunkIndex != lastChunkIndex)
+	{
+		const FChunk& movedChunk = Chunks[lastChunkIndex];
+		for(int32 agentIndex : movedChunk.Agents)
+		{
+			AgentChunks[agentIndex] = chunkIndex;
+		}
+
+		if(TArray<int32>* openChunks = OpenChunksByClass.Find(movedChunk.BehaviorClass))
+		{
+			const int32 openIndex = openChunks->Find(lastChunkIndex);
+			if(openIndex != INDEX_NONE)
+			{
+				(*openChunks)[openIndex] = chunkIndex;
+			}
+		}
+	}
+
+	Chunks.RemoveAtSwap(chunkIndex, 1, false);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::OnAgentBehaviorEnded(UNLBehavior* behavior)
+{
+	if(behavior && IsAgentValid(behavior->CrowdAgent))
+	{
+		// The agent stays in the crowd, idle, until it is removed
+		AgentRunning[behavior->CrowdAgent.Index] = false;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLCrowdSignal* UNLCrowdSubsystem::AddSignal(FNLCrowdAgentHandle agent, ENLCrowdSignalType type)
+{
+	if(!IsAgentRunning(agent))
+	{
+		return nullptr;
+	}
+
+	FNLCrowdSignal& signal = PendingSignals.AddDefaulted_GetRef();
+	signal.Agent = agent;
+	signal.Type = type;
+	return &signal;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalMessage(FNLCrowdAgentHandle agent, UNLGeneralMessage* message)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::General_Message))
+	{
+		signal->PayloadIndex = PendingMessages.Add(message);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalSight(FNLCrowdAgentHandle agent, APawn* subject, bool indirect)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::Sense_Sight))
+	{
+		signal->Subject = subject;
+		signal->Indirect = indirect;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalSightLost(FNLCrowdAgentHandle agent, APawn* subject)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::Sense_SightLost))
+	{
+		signal->Subject = subject;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalSound(FNLCrowdAgentHandle agent, APawn* subject, const FVector& location, float volume, int32 flags)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::Sense_Sound))
+	{
+		signal->Subject = subject;
+		signal->Location = location;
+		signal->Value = volume;
+		signal->Flags = flags;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalContact(FNLCrowdAgentHandle agent, AActor* other, const FHitResult& hitResult)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::Sense_Contact))
+	{
+		signal->Subject = other;
+		signal->PayloadIndex = PendingHitResults.Add(hitResult);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalMoveTo(FNLCrowdAgentHandle agent, const AActor* goal, const FVector& pos, float range)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::Movement_MoveTo))
+	{
+		signal->Subject = const_cast<AActor*>(goal);
+		signal->Location = pos;
+		signal->Value = range;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::SignalMoveToComplete(FNLCrowdAgentHandle agent, FAIRequestID requestID, EPathFollowingResult::Type result)
+{
+	if(FNLCrowdSignal* signal = AddSignal(agent, ENLCrowdSignalType::Movement_MoveToComplete))
+	{
+		signal->RequestID = requestID;
+		signal->MoveResult = result;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::DeliverSignal(const FNLCrowdSignal& signal, const TArray<UNLGeneralMessage*>& messages, const TArray<FHitResult>& hitResults)
+{
+	// The agent could have been removed or finished since the signal was sent
+	if(!IsAgentRunning(signal.Agent))
+	{
+		return;
+	}
+
+	UNLBehavior* behavior = AgentBehaviors[signal.Agent.Index];
+	if(!behavior->HasBehaviorBegun())
+	{
+		return;
+	}
+
+	switch(signal.Type)
+	{
+		case ENLCrowdSignalType::General_Message:
+			NL_CALL_EVENT(INLGeneralEvents, behavior, General_Message, messages[signal.PayloadIndex]);
+			break;
+		case ENLCrowdSignalType::Sense_Sight:
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sight, Cast<APawn>(signal.Subject.Get()), signal.Indirect);
+			break;
+		case ENLCrowdSignalType::Sense_SightLost:
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_SightLost, Cast<APawn>(signal.Subject.Get()));
+			break;
+		case ENLCrowdSignalType::Sense_Sound:
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sound, Cast<APawn>(signal.Subject.Get()), signal.Location, signal.Value, signal.Flags);
+			break;
+		case ENLCrowdSignalType::Sense_Contact:
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Contact, signal.Subject.Get(), hitResults[signal.PayloadIndex]);
+			break;
+		case ENLCrowdSignalType::Movement_MoveTo:
+			NL_CALL_EVENT(INLMovementEvents, behavior, Movement_MoveTo, signal.Subject.Get(), signal.Location, signal.Value);
+			break;
+		case ENLCrowdSignalType::Movement_MoveToComplete:
+			NL_CALL_EVENT(INLMovementEvents, behavior, Movement_MoveToComplete, signal.RequestID, signal.MoveResult);
+			break;
+		default:
+			break;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLCrowdSubsystem::TickAgents(float deltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_CrowdTick);
+
+	const double startTime = FPlatformTime::Seconds();
+	IsTicking = true;
+	TransitionsThisTick = 0;
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_NextLife_CrowdSignals);
+
+		// Signals sent while delivering are queued with fresh payloads and delivered on the next tick
+		const TArray<FNLCrowdSignal> signals = MoveTemp(PendingSignals);
+		const TArray<UNLGeneralMessage*> messages = MoveTemp(PendingMessages);
+		const TArray<FHitResult> hitResults = MoveTemp(PendingHitResults);
+		for(const FNLCrowdSignal& signal : signals)
+		{
+			DeliverSignal(signal, messages, hitResults);
+		}
+		LastTickSignalCount = signals.Num();
+	}
+
+	LastTickChunkCount = 0;
+	for(const FChunk& chunk : Chunks)
+	{
+		if(chunk.Agents.Num() == 0)
+		{
+			continue;
+		}
+
+		++LastTickChunkCount;
+		for(int32 agentIndex : chunk.Agents)
+		{
+			if(!AgentRunning[agentIndex])
+			{
+				continue;
+			}
+
+			UNLBehavior* behavior = AgentBehaviors[agentIndex];
+			if(!behavior->HasBehaviorBegun())
+			{
+				behavior->BeginBehavior();
+			}
+			else
+			{
+				behavior->RunBehavior(deltaTime);
+			}
+		}
+	}
+
+	IsTicking = false;
+
+	// Added agents join their chunks first, so agents added and removed during the tick leave them again
+	for(const FNLCrowdAgentHandle& addedAgent : PendingAdds)
+	{
+		if(IsAgentValid(addedAgent))
+		{
+			AddAgentToChunk(addedAgent.Index, AgentBehaviors[addedAgent.Index]->GetClass());
+		}
+	}
+	PendingAdds.Reset();
+
+	for(const FNLCrowdAgentHandle& removedAgent : PendingRemovals)
+	{
+		if(IsAgentValid(removedAgent))
+		{
+			RemoveAgentNow(removedAgent);
+		}
+	}
+	PendingRemovals.Reset();
+
+	LastTickTransitionCount = TransitionsThisTick;
+	LastTickTimeMs = static_cast<float>((FPlatformTime::Seconds() - startTime) * 1000.0);
+}
@@ -5,24 +5,55 @@
 #include "AIController.h"
 #include "NLBehavior.h"
 #include "NextLifeBrainComponent.h"
+#include "Crowd/NLCrowdSubsystem.h"
 #include "BehaviorTree/BlackboardComponent.h"
+#include "NLTrace.h"
+#include "Engine/BlueprintGeneratedClass.h"
+
+DECLARE_CYCLE_STAT(TEXT("Action Start"), STAT_NextLife_ActionStart, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Action Update"), STAT_NextLife_ActionUpdate, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Action Suspend"), STAT_NextLife_ActionSuspend, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Action Resume"), STAT_NextLife_ActionResume, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Action Done"), STAT_NextLife_ActionDone, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Action Reset"), STAT_NextLife_ActionReset, STATGROUP_NextLife);
 
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
 UNLAction::UNLAction()
-	: HasStarted(false)
+	: UpdateIsThreadSafe(false)
+	, HasStarted(false)
+	, StackDepth(INDEX_NONE)
+	, PreviousAction_DEPRECATED(nullptr)
+	, DirectEvents(ENLOverridableEvents::NONE)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLAction::PostInitProperties()
 {
+	Super::PostInitProperties();
 
+	if(!IsTemplate())
+	{
+		DirectEvents = FNLEventOverrides::GetDirectEvents(GetClass());
+	}
 }
 
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
-FNLActionResult UNLAction::InvokeOnStart(UNLActionPayload* payload)
+FNLActionResult UNLAction::InvokeOnStart(UNLActionPayload* payload, FNLStructPayload&& structPayload)
 {
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionStart);
+	NEXTLIFE_TRACE_SCOPE("Start", this);
+
+	StartStructPayload = MoveTemp(structPayload);
 	HasStarted = true;
-	return OnStart(payload);
+	return CallsEventDirectly(ENLOverridableEvents::OnStart) ? OnStart_Implementation(payload) : OnStart(payload);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -30,8 +61,26 @@ FNLActionResult UNLAction::InvokeOnStart(UNLActionPayload* payload)
 */
 FNLActionResult UNLAction::InvokeUpdate(float deltaSeconds)
 {
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionUpdate);
+	NEXTLIFE_TRACE_SCOPE("Update", this);
+
+	checkf(HasStarted, TEXT("Invoking an update on an action which has no started?"));
+	return CallsEventDirectly(ENLOverridableEvents::OnUpdate) ? OnUpdate_Implementation(deltaSeconds) : OnUpdate(deltaSeconds);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLAction::InvokeUpdateOffGameThread(float deltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionUpdate);
+	NEXTLIFE_TRACE_SCOPE("Update", this);
+
 	checkf(HasStarted, TEXT("Invoking an update on an action which has no started?"));
-	return OnUpdate(deltaSeconds);
+	checkf(CanUpdateOffGameThread(), TEXT("Invoking an off game thread update on an action which is not thread safe"));
+
+	// Skip the blueprint event thunk, there is no blueprint override for thread safe actions
+	return OnUpdate_Implementation(deltaSeconds);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -39,8 +88,11 @@ FNLActionResult UNLAction::InvokeUpdate(float deltaSeconds)
 */
 bool UNLAction::InvokeOnSuspend(const UNLAction *interruptingAction)
 {
-	checkf(!NextAction, TEXT("Suspending an already suspended action?"));
-	return OnSuspend(interruptingAction);
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionSuspend);
+	NEXTLIFE_TRACE_SCOPE("Suspend", this);
+
+	checkf(!GetNextAction(), TEXT("Suspending an already suspended action?"));
+	return CallsEventDirectly(ENLOverridableEvents::OnSuspend) ? OnSuspend_Implementation(interruptingAction) : OnSuspend(interruptingAction);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -48,7 +100,10 @@ bool UNLAction::InvokeOnSuspend(const UNLAction *interruptingAction)
 */
 FNLActionResult UNLAction::InvokeOnResume(const UNLAction *resumingFrom)
 {
-	return OnResume(resumingFrom);
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionResume);
+	NEXTLIFE_TRACE_SCOPE("Resume", this);
+
+	return CallsEventDirectly(ENLOverridableEvents::OnResume) ? OnResume_Implementation(resumingFrom) : OnResume(resumingFrom);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -56,13 +111,219 @@ FNLActionResult UNLAction::InvokeOnResume(const UNLAction *resumingFrom)
 */
 void UNLAction::InvokeOnDone(const UNLAction* nextAction)
 {
-	OnDone(nextAction);
-	if(NextAction)
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionDone);
+	NEXTLIFE_TRACE_SCOPE("Done", this);
+
+	if(CallsEventDirectly(ENLOverridableEvents::OnDone))
+	{
+		OnDone_Implementation(nextAction);
+	}
+	else
+	{
+		OnDone(nextAction);
+	}
+
+	UNLBehavior* behavior = GetBehavior();
+	if(behavior)
+	{
+		behavior->UnregisterActionListener(this);
+
+		// End the actions above first, leaving this action on top of the stack to be removed
+		if(UNLAction* aboveAction = GetNextAction())
+		{
+			aboveAction->InvokeOnDone(nextAction);
+		}
+		behavior->PopAction(this);
+	}
+	StackDepth = INDEX_NONE;
+	StartStructPayload.Reset();
+
+	if(behavior)
 	{
-		NextAction->InvokeOnDone(nextAction);
-		NextAction = nullptr;
+		behavior->ReleaseAction(this);
 	}
-	PreviousAction = nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLAction::InvokeOnReset()
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ActionReset);
+	NEXTLIFE_TRACE_SCOPE("Reset", this);
+
+	HasStarted = false;
+	StackDepth = INDEX_NONE;
+	StartStructPayload.Reset();
+	if(CallsEventDirectly(ENLOverridableEvents::OnReset))
+	{
+		OnReset_Implementation();
+	}
+	else
+	{
+		OnReset();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::InvokeOnRequestEvent(const FNLEventResponse& eventRequested, UNLAction* requester)
+{
+	switch(RequestEventPolicy.Mode)
+	{
+		case ENLRequestPolicyMode::ACCEPT:
+			return true;
+		case ENLRequestPolicyMode::REJECT:
+			return false;
+		case ENLRequestPolicyMode::FILTER:
+			return RequestEventPolicy.Filter.Passes(eventRequested);
+		default:
+			break;
+	}
+
+	return CallsEventDirectly(ENLOverridableEvents::OnRequestEvent) ? OnRequestEvent_Implementation(eventRequested, requester)
+																	: OnRequestEvent(eventRequested, requester);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::InvokeOnRequestTakeover(const FNLEventResponse& eventRequested, UNLAction* requester, bool& keepChildActions)
+{
+	if(RequestTakeoverPolicy.Mode != ENLRequestPolicyMode::CUSTOM)
+	{
+		if(!RequestTakeoverPolicy.TakesOver(eventRequested, requester->GetClass()))
+		{
+			return false;
+		}
+		keepChildActions = RequestTakeoverPolicy.KeepChildActions;
+		return true;
+	}
+
+	return CallsEventDirectly(ENLOverridableEvents::OnRequestTakeover) ? OnRequestTakeover_Implementation(eventRequested, requester, keepChildActions)
+																	   : OnRequestTakeover(eventRequested, requester, keepChildActions);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLAction::OnReset_Implementation()
+{
+	const UNLAction* defaultAction = GetClass()->GetDefaultObject<UNLAction>();
+
+	for(TFieldIterator<FProperty> propertyIt(GetClass()); propertyIt; ++propertyIt)
+	{
+		FProperty* property = *propertyIt;
+
+		// The base action state is reset by InvokeOnReset
+		if(property->GetOwnerClass() == UNLAction::StaticClass())
+		{
+			continue;
+		}
+
+		// Instanced objects belong to the default object
+		if(property->HasAnyPropertyFlags(CPF_InstancedReference | CPF_ContainsInstancedReference))
+		{
+			continue;
+		}
+
+#if USE_UBER_GRAPH_PERSISTENT_FRAME
+		// The blueprint event graph frame belongs to this instance
+		const UBlueprintGeneratedClass* blueprintClass = Cast<UBlueprintGeneratedClass>(property->GetOwnerClass());
+		if(blueprintClass && property == blueprintClass->UberGraphFramePointerProperty)
+		{
+			continue;
+		}
+#endif
+
+		property->CopyCompleteValue_InContainer(this, defaultAction);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLAction* UNLAction::GetPreviousAction() const
+{
+	const UNLBehavior* behavior = GetBehavior();
+	return behavior && StackDepth > 0 ? behavior->ActionStack[StackDepth - 1] : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLAction* UNLAction::GetNextAction() const
+{
+	const UNLBehavior* behavior = GetBehavior();
+	return behavior && StackDepth != INDEX_NONE && StackDepth + 1 < behavior->ActionStack.Num() ? behavior->ActionStack[StackDepth + 1] : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::IsTopAction() const
+{
+	return GetNextAction() == nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::IsBelowMe(const UNLAction* otherAction) const
+{
+	const UNLBehavior* behavior = GetBehavior();
+	if(!behavior || !otherAction || otherAction->StackDepth == INDEX_NONE || otherAction->StackDepth >= StackDepth)
+	{
+		return false;
+	}
+	return behavior->ActionStack[otherAction->StackDepth] == otherAction;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::IsActionClassBelowMe(TSubclassOf<UNLAction> actionClass) const
+{
+	const UNLBehavior* behavior = GetBehavior();
+	if(!behavior || !actionClass || StackDepth == INDEX_NONE)
+	{
+		return false;
+	}
+
+	// Positions are sorted, the lowest one tells if any is below
+	const FNLActionClassPositions* positions = behavior->FindActionClassPositions(actionClass);
+	return positions && (*positions)[0] < StackDepth;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::IsAboveMe(const UNLAction* otherAction) const
+{
+	const UNLBehavior* behavior = GetBehavior();
+	if(!behavior || !otherAction || StackDepth == INDEX_NONE || otherAction->StackDepth <= StackDepth ||
+	   otherAction->StackDepth >= behavior->ActionStack.Num())
+	{
+		return false;
+	}
+	return behavior->ActionStack[otherAction->StackDepth] == otherAction;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLAction::IsActionClassAboveMe(TSubclassOf<UNLAction> actionClass) const
+{
+	const UNLBehavior* behavior = GetBehavior();
+	if(!behavior || !actionClass || StackDepth == INDEX_NONE)
+	{
+		return false;
+	}
+
+	// Positions are sorted, the highest one tells if any is above
+	const FNLActionClassPositions* positions = behavior->FindActionClassPositions(actionClass);
+	return positions && positions->Last() > StackDepth;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -76,6 +337,14 @@ APawn* UNLAction::GetPawnOwner() const
 		return AIController->GetPawn();
 	}
 
+	// Crowd agents have no AI controller, they may have a pawn
+	const UNLBehavior* myBehavior = GetBehavior();
+	const UNLCrowdSubsystem* crowd = myBehavior ? myBehavior->GetCrowd() : nullptr;
+	if(crowd && crowd->IsAgentValid(myBehavior->GetCrowdAgent()))
+	{
+		return crowd->GetAgentPawn(myBehavior->GetCrowdAgent());
+	}
+
 	return nullptr;
 }
 
@@ -105,6 +374,28 @@ UNLBehavior* UNLAction::GetBehavior() const
 	return Cast<UNLBehavior>(GetOuter());
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FName UNLAction::MakeReason(const FString& reason) const
+{
+#if NEXTLIFE_WITH_REASONS
+	if(reason.IsEmpty())
+	{
+		return NAME_None;
+	}
+
+	// Names are never freed, don't add one for every formatted reason nobody looks at
+	const UNLBehavior* behavior = GetBehavior();
+	const UNextLifeBrainComponent* brain = behavior ? behavior->GetBrainComponent() : nullptr;
+	if(brain && (brain->LogState || brain->GetTransitionRecorder()))
+	{
+		return FName(*reason);
+	}
+#endif
+	return NAME_None;
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
@@ -116,6 +407,12 @@ float UNLAction::GetWorldTimeSeconds() const
 		return AIController->GetWorld()->GetTimeSeconds();
 	}
 
+	const UNLBehavior* myBehavior = GetBehavior();
+	if(myBehavior)
+	{
+		return myBehavior->GetWorldTimeSeconds();
+	}
+
 	return -1.0f;
 }
 
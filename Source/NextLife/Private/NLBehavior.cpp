@@ -5,16 +5,63 @@
 #include "AIController.h"
 #include "NextLifeModule.h"
 #include "NLAction.h"
+#include "NLTrace.h"
+#include "NLTransitionRecorder.h"
+#include "Crowd/NLCrowdSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Begin Behavior"), STAT_NextLife_BeginBehavior, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Run Behavior"), STAT_NextLife_RunBehavior, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Apply Pending Events"), STAT_NextLife_ApplyPendingEvents, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Apply Action Result"), STAT_NextLife_ApplyActionResult, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event General_Message"), STAT_NextLife_Event_GeneralMessage, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event Sense_Sight"), STAT_NextLife_Event_SenseSight, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event Sense_SightLost"), STAT_NextLife_Event_SenseSightLost, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event Sense_Sound"), STAT_NextLife_Event_SenseSound, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event Sense_Contact"), STAT_NextLife_Event_SenseContact, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event Movement_MoveTo"), STAT_NextLife_Event_MovementMoveTo, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Event Movement_MoveToComplete"), STAT_NextLife_Event_MovementMoveToComplete, STATGROUP_NextLife);
+
+// Event names, created once so dispatching an event doesn't look them up
+static const FName NAME_General_Message(TEXT("General_Message"));
+static const FName NAME_Sense_Sight(TEXT("Sense_Sight"));
+static const FName NAME_Sense_SightLost(TEXT("Sense_SightLost"));
+static const FName NAME_Sense_Sound(TEXT("Sense_Sound"));
+static const FName NAME_Sense_Contact(TEXT("Sense_Contact"));
+static const FName NAME_Movement_MoveTo(TEXT("Movement_MoveTo"));
+static const FName NAME_Movement_MoveToComplete(TEXT("Movement_MoveToComplete"));
 
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
 UNLBehavior::UNLBehavior()
-	: EventsPaused(false)
+	: PoolActions(false)
+	, MaxPooledActionsPerClass(4)
+	, LowPriority(false)
+	, EventsPaused(false)
+	, HasDeferredResult(false)
+	, DeferredResultFromRequest(false)
+	, TransitionFrame(0)
+	, TransitionsThisFrame(0)
+	, ActionPoolHits(0)
+	, ActionPoolMisses(0)
+	, DirectEvents(ENLOverridableEvents::NONE)
 {
 
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	if(!IsTemplate())
+	{
+		DirectEvents = FNLEventOverrides::GetDirectEvents(GetClass());
+	}
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
@@ -32,6 +79,14 @@ UNextLifeBrainComponent* UNLBehavior::GetBrainComponent() const
 	return Cast<UNextLifeBrainComponent>(GetOuter());
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLCrowdSubsystem* UNLBehavior::GetCrowd() const
+{
+	return Cast<UNLCrowdSubsystem>(GetOuter());
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
@@ -45,6 +100,10 @@ float UNLBehavior::GetWorldTimeSeconds() const
 			return brainComponent->GetAIOwner()->GetWorld()->GetTimeSeconds();
 		}
 	}
+	else if(UNLCrowdSubsystem* crowd = GetCrowd())
+	{
+		return crowd->GetWorld()->GetTimeSeconds();
+	}
 
 	return -1.0f;
 }
@@ -54,15 +113,42 @@ float UNLBehavior::GetWorldTimeSeconds() const
 */
 void UNLBehavior::OnSaveRestored()
 {
-	UNLAction* curAction = Action;
-	while(curAction)
+	// Saves made before the stack was kept only have the top action, linked to the actions below it
+	if(ActionStack.Num() == 0 && Action)
 	{
-		if(curAction->PreviousAction)
+		for(UNLAction* linkedAction = Action; linkedAction && !ActionStack.Contains(linkedAction); linkedAction = linkedAction->PreviousAction_DEPRECATED)
 		{
-			curAction->PreviousAction->NextAction = curAction;
+			ActionStack.Insert(linkedAction, 0);
 		}
-		curAction->OnSaveRestored();
-		curAction = curAction->PreviousAction;
+		UE_LOG(LogNextLife, Log, TEXT("%s rebuilt an action stack %d deep from a save made before action stacks were saved"), *GetName(), ActionStack.Num());
+	}
+
+	// The stack is saved, rebuild the slots, stack depths and event listeners from the root up
+	ActionStack.Remove(nullptr);
+	ActionSlots.Reset();
+	ActionClassPositions.Reset();
+	ClearActionListeners();
+	for(int32 stackIndex = 0; stackIndex < ActionStack.Num(); ++stackIndex)
+	{
+		UNLAction* restoredAction = ActionStack[stackIndex];
+		restoredAction->StackDepth = stackIndex;
+		restoredAction->PreviousAction_DEPRECATED = nullptr;
+		ActionSlots.Emplace(restoredAction->GetClass());
+		IndexActionClass(restoredAction->GetClass(), stackIndex);
+		RegisterActionListener(restoredAction);
+	}
+	Action = ActionStack.Num() > 0 ? ActionStack.Last() : nullptr;
+
+	// Responses of actions which didn't make it back onto the stack are dropped. Saves made before the pending response
+	// table kept responses in the actions, those responses aren't loaded.
+	PendingResponses.RemoveAll([this](const FNLPendingEventResponse& pending)
+	{
+		return !pending.Action || !ActionStack.IsValidIndex(pending.Action->StackDepth) || ActionStack[pending.Action->StackDepth] != pending.Action;
+	});
+
+	for(int32 stackIndex = ActionStack.Num() - 1; stackIndex >= 0; --stackIndex)
+	{
+		ActionStack[stackIndex]->OnSaveRestored();
 	}
 }
 
@@ -77,11 +163,9 @@ bool UNLBehavior::GetActionStack(TArray<UNLAction*>& actionStackOut) const
 		return false;
 	}
 
-	UNLAction* nextAction = Action;
-	while(nextAction)
+	for(int32 stackIndex = Action->StackDepth; stackIndex >= 0; --stackIndex)
 	{
-		actionStackOut.Add(nextAction);
-		nextAction = nextAction->PreviousAction;
+		actionStackOut.Add(ActionStack[stackIndex]);
 	}
 
 	return true;
@@ -92,6 +176,9 @@ bool UNLBehavior::GetActionStack(TArray<UNLAction*>& actionStackOut) const
 */
 void UNLBehavior::BeginBehavior()
 {
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_BeginBehavior);
+	NEXTLIFE_TRACE_SCOPE("Begin Behavior", this);
+
 	if(!InitialActionClass)
 	{
 		UE_LOG(LogNextLife, Error, TEXT("Trying to start a behavior which has no initial action class? Set InitialActionClass in behavior '%s'"), *GetName());
@@ -99,12 +186,14 @@ void UNLBehavior::BeginBehavior()
 	}
 
 	// Create the initial action
-	Action = NewObject<UNLAction>(this, InitialActionClass);
+	Action = nullptr;
+	ResetActionStack();
+	PushAction(CreateAction(InitialActionClass));
 	check(Action);
+	RecordTransition(ENLTransitionRecordType::BehaviorBegin, nullptr, Action->GetClass());
 
 	// The action hasn't started yet, start it and apply the result
-	const FNLActionResult actionResult = Action->InvokeOnStart(nullptr);
-	Action = ApplyActionResult(actionResult, false);
+	Action = ApplyActionResult(Action->InvokeOnStart(nullptr), false);
 
 	if(!Action)
 	{
@@ -117,10 +206,42 @@ void UNLBehavior::BeginBehavior()
 */
 void UNLBehavior::RunBehavior(float deltaSeconds)
 {
+	if(!BeginRunBehavior())
+	{
+		return;
+	}
+
+	// Frame Update the current action and apply its result
+	FinishRunBehavior(Action->InvokeUpdate(deltaSeconds));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLBehavior::BeginRunBehavior()
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_RunBehavior);
+	NEXTLIFE_TRACE_SCOPE("Run Behavior", this);
+
 	if(!Action || !Action->HasStarted)
 	{
 		// This is an error case, but the error message would have been thrown by now.
-		return;
+		return false;
+	}
+
+	// Finish transitions which didn't fit in the last frame first
+	if(HasDeferredResult)
+	{
+		FNLActionResult deferredResult = MoveTemp(DeferredResult);
+		DeferredResult = FNLActionResult();
+		HasDeferredResult = false;
+
+		Action = ApplyActionResult(MoveTemp(deferredResult), DeferredResultFromRequest);
+		if(!Action)
+		{
+			OnBehaviorEnded.Broadcast(this);
+			return false;
+		}
 	}
 
 	// Apply pending events which could modify the current action
@@ -128,12 +249,22 @@ void UNLBehavior::RunBehavior(float deltaSeconds)
 	if(!Action)
 	{
 		OnBehaviorEnded.Broadcast(this);
-		return;
+		return false;
 	}
 
-	// Frame Update the current action and apply its result
-	const FNLActionResult actionResult = Action->InvokeUpdate(deltaSeconds);
-	Action = ApplyActionResult(actionResult, false);
+	// Don't update an action whose result is still waiting to be applied
+	return !HasDeferredResult;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::FinishRunBehavior(FNLActionResult&& updateResult)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_RunBehavior);
+	NEXTLIFE_TRACE_SCOPE("Finish Behavior", this);
+
+	Action = ApplyActionResult(MoveTemp(updateResult), false);
 
 	if(!Action)
 	{
@@ -146,54 +277,160 @@ void UNLBehavior::RunBehavior(float deltaSeconds)
 */
 UNLAction* UNLBehavior::GetActionOfClass(TSubclassOf<UNLAction> actionClass) const
 {
-	if(!Action)
+	if(!Action || !actionClass)
+	{
+		return nullptr;
+	}
+
+	const FNLActionClassPositions* positions = FindActionClassPositions(actionClass);
+	if(!positions)
 	{
 		return nullptr;
 	}
 
-	TArray<UNLAction*> actionStackOut;
-	GetActionStack(actionStackOut);
-	for(UNLAction* action : actionStackOut)
+	// Topmost first, skipping actions above the TOP action which are ending
+	for(int32 positionIndex = positions->Num() - 1; positionIndex >= 0; --positionIndex)
 	{
-		if(action && action->GetClass()->IsChildOf(actionClass))
+		const int32 stackIndex = (*positions)[positionIndex];
+		if(stackIndex <= Action->StackDepth)
 		{
-			return action;
+			return ActionStack[stackIndex];
 		}
 	}
 
 	return nullptr;
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 UNLBehavior::GetPooledActionCount() const
+{
+	int32 count = 0;
+	for(const TPair<UClass*, FNLActionPoolEntry>& poolPair : ActionPool)
+	{
+		count += poolPair.Value.Actions.Num();
+	}
+	return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLAction* UNLBehavior::CreateAction(TSubclassOf<UNLAction> actionClass, const FNLNativeActionType* nativeType)
+{
+	if(actionClass == UNLNativeActionHost::StaticClass())
+	{
+		UNLNativeActionHost* host = nullptr;
+		if(NativeActionHosts.Num() > 0)
+		{
+			host = NativeActionHosts.Pop(false);
+			host->InvokeOnReset();
+		}
+		else
+		{
+			host = NewObject<UNLNativeActionHost>(this);
+		}
+
+		// Without a type the host is done as soon as it starts
+		if(nativeType)
+		{
+			host->BindNativeAction(NativeActionArena.Construct(nativeType));
+		}
+		return host;
+	}
+
+	if(PoolActions)
+	{
+		FNLActionPoolEntry* poolEntry = ActionPool.Find(actionClass);
+		if(poolEntry && poolEntry->Actions.Num() > 0)
+		{
+			++ActionPoolHits;
+			UNLAction* pooledAction = poolEntry->Actions.Pop(false);
+			pooledAction->InvokeOnReset();
+			return pooledAction;
+		}
+		++ActionPoolMisses;
+	}
+
+	return NewObject<UNLAction>(this, actionClass);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::ReleaseAction(UNLAction* action)
+{
+	check(action);
+
+	if(UNLNativeActionHost* host = Cast<UNLNativeActionHost>(action))
+	{
+		// Native actions are destroyed right away, nothing but the host can see them after they are done
+		host->DestroyNativeAction(NativeActionArena);
+		if(host->GetOuter() == this && !NativeActionHosts.Contains(host))
+		{
+			NativeActionHosts.Add(host);
+		}
+		return;
+	}
+
+	if(!PoolActions || action->GetOuter() != this)
+	{
+		// GC will get it
+		return;
+	}
+
+	FNLActionPoolEntry& poolEntry = ActionPool.FindOrAdd(action->GetClass());
+	if(poolEntry.Actions.Num() < MaxPooledActionsPerClass && !poolEntry.Actions.Contains(action))
+	{
+		// The action is reset when it is reused, not now, so the action resuming from it can still look at its state
+		poolEntry.Actions.Add(action);
+	}
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
 void UNLBehavior::StopBehavior(bool callBehaviorEnded)
 {
+	HasDeferredResult = false;
+	DeferredResult = FNLActionResult();
+
 	if(!Action || !Action->HasStarted)
 	{
 		// Already in an ended state
 		Action = nullptr;
+		ResetActionStack();
+		ClearActionListeners();
 		return;
 	}
 
 	// Get the root action
-	UNLAction* rootAction = Action;
-	while(rootAction->PreviousAction)
-	{
-		rootAction = rootAction->PreviousAction;
-	}
+	UNLAction* rootAction = ActionStack[0];
 
 	// End it
 	// NOTE: OnDone is not called if the owning pawn is gone (important rule, action functons can always rely on the owner pawn being valid)
 	//		 In the case of the pawn being destroyed, OnDone is not called, the action stack is just destroyed.
 	// NOTE: If unreachable (torn down because of natural garbage collection) then do not perform done either.
-	if(rootAction->GetPawnOwner() != nullptr && !IsUnreachable())
+	// NOTE: Crowd agents may not have a pawn, their actions are done as long as the agent is still in the crowd.
+	const UNLCrowdSubsystem* crowd = GetCrowd();
+	const bool ownerValid = crowd ? crowd->IsAgentValid(CrowdAgent) : rootAction->GetPawnOwner() != nullptr;
+	if(ownerValid && !IsUnreachable())
 	{
 		rootAction->InvokeOnDone(nullptr);
 	}
 
+	const UClass* topActionClass = Action ? Action->GetClass() : nullptr;
+
 	// GC will get all the actions
 	Action = nullptr;
+	ResetActionStack();
+	ClearActionListeners();
+
+	if(!IsUnreachable())
+	{
+		RecordTransition(ENLTransitionRecordType::BehaviorStop, topActionClass, nullptr);
+	}
 
 	if(callBehaviorEnded)
 	{
@@ -204,167 +441,407 @@ void UNLBehavior::StopBehavior(bool callBehaviorEnded)
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
-UNLAction* UNLBehavior::ApplyActionResult(const FNLActionResult& result, bool fromRequest)
+void UNLBehavior::PushAction(UNLAction* newAction)
+{
+	check(newAction);
+	checkf(!Action || Action == ActionStack.Last(), TEXT("Pushing an action while actions above the TOP action haven't ended"));
+
+	newAction->StackDepth = ActionStack.Num();
+	ActionStack.Add(newAction);
+	ActionSlots.Emplace(newAction->GetClass());
+	IndexActionClass(newAction->GetClass(), newAction->StackDepth);
+	Action = newAction;
+
+	RegisterActionListener(newAction);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::PopAction(UNLAction* endingAction)
+{
+	// Actions which aren't on the stack can still be ended, there is nothing to remove then
+	if(ActionStack.Num() > 0 && ActionStack.Last() == endingAction)
+	{
+		UnindexActionClass(ActionSlots.Last().Class, ActionStack.Num() - 1);
+		ActionStack.Pop(false);
+		ActionSlots.Pop(false);
+		SetEventResponse(endingAction, FNLEventResponse());
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::ResetActionStack()
+{
+	// Actions torn down without being ended still have to give their native actions back
+	for(UNLAction* stackAction : ActionStack)
+	{
+		if(UNLNativeActionHost* host = Cast<UNLNativeActionHost>(stackAction))
+		{
+			host->DestroyNativeAction(NativeActionArena);
+		}
+	}
+
+	ActionStack.Reset();
+	ActionSlots.Reset();
+	ActionClassPositions.Reset();
+	PendingResponses.Reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::IndexActionClass(const UClass* actionClass, int32 stackIndex)
+{
+	for(const UClass* indexClass = actionClass; indexClass; indexClass = indexClass->GetSuperClass())
+	{
+		ActionClassPositions.FindOrAdd(indexClass).Add(stackIndex);
+		if(indexClass == UNLAction::StaticClass())
+		{
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::UnindexActionClass(const UClass* actionClass, int32 stackIndex)
+{
+	for(const UClass* indexClass = actionClass; indexClass; indexClass = indexClass->GetSuperClass())
+	{
+		FNLActionClassPositions* positions = ActionClassPositions.Find(indexClass);
+		if(positions && positions->Num() > 0 && positions->Last() == stackIndex)
+		{
+			positions->Pop(false);
+		}
+		if(indexClass == UNLAction::StaticClass())
+		{
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::SetEventResponse(UNLAction* action, FNLEventResponse&& response)
+{
+	const int32 pendingIndex = PendingResponses.IndexOfByPredicate([action](const FNLPendingEventResponse& pending) { return pending.Action == action; });
+	if(response.IsNone())
+	{
+		if(pendingIndex != INDEX_NONE)
+		{
+			PendingResponses.RemoveAtSwap(pendingIndex, 1, false);
+		}
+	}
+	else if(pendingIndex != INDEX_NONE)
+	{
+		PendingResponses[pendingIndex].Response = MoveTemp(response);
+	}
+	else
+	{
+		checkf(ActionStack.IsValidIndex(action->StackDepth) && ActionStack[action->StackDepth] == action, TEXT("Storing an event response in an action which isn't on the stack"));
+		PendingResponses.Emplace(action, MoveTemp(response));
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::RegisterActionListener(UNLAction* action)
 {
+	if(action->ListensTo(UNLGeneralEvents::StaticClass()))
+	{
+		GeneralEventListeners.Add(action);
+	}
+	if(action->ListensTo(UNLSensingEvents::StaticClass()))
+	{
+		SensingEventListeners.Add(action);
+	}
+	if(action->ListensTo(UNLMovementEvents::StaticClass()))
+	{
+		MovementEventListeners.Add(action);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::UnregisterActionListener(UNLAction* action)
+{
+	// Ending actions are at or near the top of the stack, search from the end
+	auto removeFromList = [action](FNLActionListenerList& listeners)
+	{
+		for(int32 listenerIndex = listeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
+		{
+			if(listeners[listenerIndex] == action)
+			{
+				listeners.RemoveAt(listenerIndex, 1, false);
+				return;
+			}
+		}
+	};
+
+	removeFromList(GeneralEventListeners);
+	removeFromList(SensingEventListeners);
+	removeFromList(MovementEventListeners);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLBehavior::IsActiveListener(const UNLAction* listener) const
+{
+	return Action && listener->StackDepth <= Action->StackDepth;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::ClearActionListeners()
+{
+	GeneralEventListeners.Reset();
+	SensingEventListeners.Reset();
+	MovementEventListeners.Reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLAction* UNLBehavior::ApplyActionResult(FNLActionResult&& result, bool fromRequest)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ApplyActionResult);
+	NEXTLIFE_TRACE_SCOPE("Apply Action Result", this);
+
 	//checkf(Action, TEXT("ApplyActionResult should not be made without a valid action stack!"));
 	if(!Action)
 	{
 		return nullptr;
 	}
-	checkf(!Action->NextAction, TEXT("The TOP action should not have a NextAction set, something bad happened"));
-	
-	if(GetBrainComponent()->LogState && result.Change != ENLActionChangeType::NONE)
+
+	// Crowd behaviors have no brain, they use the crowds limit and never log their state
+	UNextLifeBrainComponent* brain = GetBrainComponent();
+	UNLCrowdSubsystem* crowd = brain ? nullptr : GetCrowd();
+	const int32 maxTransitions = brain ? brain->MaxTransitionsPerFrame : (crowd ? crowd->MaxTransitionsPerFrame : 0);
+	const bool logState = brain && brain->LogState;
+
+	if(TransitionFrame != GFrameCounter)
 	{
-		SET_WARN_COLOR(COLOR_WHITE);
-		UE_LOG(LogNextLife, Warning, TEXT("%s : %s:%s: "),
-									  fromRequest ? TEXT("ApplyActionEventResponse") : TEXT("ApplyActionResult"),
-									  *GetBrainComponent()->GetAIOwner()->GetName(), 
-									  *GetName());
-		CLEAR_WARN_COLOR();
+		TransitionFrame = GFrameCounter;
+		TransitionsThisFrame = 0;
 	}
-	
-	switch(result.Change)
+
+	// Starting or resuming an action gives another result to apply. Apply them in turn until an action settles instead
+	// of recursing, so long chains don't grow the stack and ping-ponging actions can't stall the frame.
+	FNLActionResult currentResult = MoveTemp(result);
+	int32 chainLength = 0;
+	while(Action && currentResult.Change != ENLActionChangeType::NONE)
 	{
-		case ENLActionChangeType::CHANGE:
+		checkf(Action == ActionStack.Last(), TEXT("The TOP action should be the last action on the stack, something bad happened"));
+
+		if(maxTransitions > 0 && TransitionsThisFrame >= maxTransitions)
+		{
+			// Out of transitions for this frame, pick up from here on the next run
+			if(logState)
 			{
-				if(!result.Action)
-				{
-					UE_LOG(LogNextLife, Error, TEXT("CHANGE to a nullptr Action"));
-					return Action;
-				}
+				SET_WARN_COLOR(COLOR_RED);
+				UE_LOG(LogNextLife, Warning, TEXT("%s:%s: hit %d transitions this frame, deferring %s"),
+											  *brain->GetAIOwner()->GetName(),
+											  *GetName(),
+											  maxTransitions,
+											  *UEnum::GetValueAsString(currentResult.Change));
+				CLEAR_WARN_COLOR();
+			}
+
+			RecordTransition(ENLTransitionRecordType::Deferred, Action->GetClass(), currentResult.Action, NAME_None,
+							 currentResult.Reason, currentResult.Change);
+
+			DeferredResult = MoveTemp(currentResult);
+			DeferredResultFromRequest = fromRequest;
+			HasDeferredResult = true;
+			if(brain)
+			{
+				brain->RecordTransitionDeferral();
+			}
+			break;
+		}
+
+		if(logState)
+		{
+			SET_WARN_COLOR(COLOR_WHITE);
+			UE_LOG(LogNextLife, Warning, TEXT("%s : %s:%s: "),
+										  fromRequest ? TEXT("ApplyActionEventResponse") : TEXT("ApplyActionResult"),
+										  *brain->GetAIOwner()->GetName(), 
+										  *GetName());
+			CLEAR_WARN_COLOR();
+		}
 
-				if(GetBrainComponent()->LogState)
+		switch(currentResult.Change)
+		{
+			case ENLActionChangeType::CHANGE:
 				{
-					SET_WARN_COLOR(COLOR_GREEN);
-					UE_LOG(LogNextLife, Warning, TEXT("%s CHANGE to %s : %s"), *Action->GetName(), 
-																		  *result.Action->GetName(),
-																		  *result.Reason);
-					CLEAR_WARN_COLOR();
-				}
+					if(!currentResult.Action)
+					{
+						UE_LOG(LogNextLife, Error, TEXT("CHANGE to a nullptr Action"));
+						currentResult = FNLActionResult();
+						break;
+					}
 
-				// Create the new action
-				UNLAction* newAction = NewObject<UNLAction>(this, result.Action);
-				check(newAction);
+					if(logState)
+					{
+						SET_WARN_COLOR(COLOR_GREEN);
+						UE_LOG(LogNextLife, Warning, TEXT("%s CHANGE to %s : %s"), *Action->GetName(), 
+																			  *currentResult.Action->GetName(),
+																			  *currentResult.Reason.ToString());
+						CLEAR_WARN_COLOR();
+					}
 
-				// Swap to previous action while we invoke done (so events don't hit the ending action)
-				UNLAction* oldAction = Action;
-				Action = Action->PreviousAction;
+					// Create the new action
+					UNLAction* newAction = CreateAction(currentResult.Action, currentResult.NativeType);
+					check(newAction);
 
-				// End the current action
-				oldAction->InvokeOnDone(newAction);
+					// Swap to previous action while we invoke done (so events don't hit the ending action)
+					UNLAction* oldAction = Action;
+					const UClass* oldActionClass = oldAction->GetClass();
+					Action = GetActionBelow(Action);
 
-				// Ensure that the previous actions would accept being suspended, otherwise end them to
-				while(Action && !Action->InvokeOnSuspend(newAction))
-				{
-					UNLAction* previousAction = Action->PreviousAction;
-					// End this previous action
-					Action->InvokeOnDone(newAction);
-					// Iterate to the next previous in line
-					Action = previousAction;
-					if(Action)
+					// End the current action
+					oldAction->InvokeOnDone(newAction);
+
+					// Ensure that the previous actions would accept being suspended, otherwise end them to
+					while(Action && !Action->InvokeOnSuspend(newAction))
 					{
-						// Clear the next action which we just ended
-						Action->NextAction = nullptr;
+						UNLAction* previousAction = GetActionBelow(Action);
+						// End this previous action, removing it from the stack
+						Action->InvokeOnDone(newAction);
+						// Iterate to the next previous in line
+						Action = previousAction;
 					}
+					
+					// Put the new action as the head
+					PushAction(newAction);
+					RecordTransition(ENLTransitionRecordType::Change, oldActionClass, newAction->GetClass(), NAME_None,
+									 currentResult.Reason, ENLActionChangeType::CHANGE);
+
+					// Start the new action, moving the struct payload into it. Its result is applied next.
+					++TransitionsThisFrame;
+					++chainLength;
+					currentResult = Action->InvokeOnStart(currentResult.Payload, MoveTemp(currentResult.StructPayload));
+					break;
 				}
-				
-				// Put the new action as the head
-				newAction->PreviousAction = Action;
-				Action = newAction;
-				// If there is still a previous action set its next to us
-				if(Action->PreviousAction)
-				{
-					Action->PreviousAction->NextAction = Action;
-				}
-
-				// Start the new action and apply the result which could cause several actions to start via the recursion.
-				const FNLActionResult newActionResult = Action->InvokeOnStart(result.Payload);
-				return ApplyActionResult(newActionResult, fromRequest);
-			}
-		case ENLActionChangeType::SUSPEND:
-			{
-				if(result.Action == nullptr)
+			case ENLActionChangeType::SUSPEND:
 				{
-					UE_LOG(LogNextLife, Error, TEXT("SUSPEND to a nullptr Action"));
-					return Action;
-				}
+					if(currentResult.Action == nullptr)
+					{
+						UE_LOG(LogNextLife, Error, TEXT("SUSPEND to a nullptr Action"));
+						currentResult = FNLActionResult();
+						break;
+					}
 
-				if(GetBrainComponent()->LogState)
-				{
-					SET_WARN_COLOR(COLOR_YELLOW);
-					UE_LOG(LogNextLife, Warning, TEXT("%s SUSPEND for %s : %s"), *Action->GetName(), 
-																		    *result.Action->GetName(),
-																		    *result.Reason);
-					CLEAR_WARN_COLOR();
-				}
+					if(logState)
+					{
+						SET_WARN_COLOR(COLOR_YELLOW);
+						UE_LOG(LogNextLife, Warning, TEXT("%s SUSPEND for %s : %s"), *Action->GetName(), 
+																				*currentResult.Action->GetName(),
+																				*currentResult.Reason.ToString());
+						CLEAR_WARN_COLOR();
+					}
 
-				// Create the new action
-				UNLAction* newAction = NewObject<UNLAction>(this, result.Action);
-				check(newAction);
+					// Create the new action
+					UNLAction* newAction = CreateAction(currentResult.Action, currentResult.NativeType);
+					check(newAction);
 
-				// Suspend actions underneath until an action accepts the suspend
-				while(Action && !Action->InvokeOnSuspend(newAction))
-				{
-					UNLAction* previousAction = Action->PreviousAction;
-					// End this previous action
-					Action->InvokeOnDone(newAction);
-					// Iterate to the next previous in line
-					Action = previousAction;
-					if(Action)
+					// Suspend actions underneath until an action accepts the suspend
+					const UClass* suspendedActionClass = Action->GetClass();
+					while(Action && !Action->InvokeOnSuspend(newAction))
 					{
-						// Clear the next action which we just ended
-						Action->NextAction = nullptr;
+						UNLAction* previousAction = GetActionBelow(Action);
+						// End this previous action, removing it from the stack
+						Action->InvokeOnDone(newAction);
+						// Iterate to the next previous in line
+						Action = previousAction;
 					}
-				}
 
-				// Put the new action as the head
-				newAction->PreviousAction = Action;
-				Action = newAction;
-				// If there is still a previous action set its next to us
-				if(Action->PreviousAction)
-				{
-					Action->PreviousAction->NextAction = Action;
-				}
+					// Put the new action as the head
+					PushAction(newAction);
+					RecordTransition(ENLTransitionRecordType::Suspend, suspendedActionClass, newAction->GetClass(), NAME_None,
+									 currentResult.Reason, ENLActionChangeType::SUSPEND);
 
-				// Start the new action and apply the result which could cause several actions to start via the recursion.
-				const FNLActionResult newActionResult = Action->InvokeOnStart(result.Payload);
-				return ApplyActionResult(newActionResult, fromRequest);
-			}
-		case ENLActionChangeType::DONE:
-			{
-				if(GetBrainComponent()->LogState)
-				{
-					SET_WARN_COLOR(COLOR_RED);
-					UE_LOG(LogNextLife, Warning, TEXT("%s DONE : %s"), *Action->GetName(), *result.Reason);
-					CLEAR_WARN_COLOR();
+					// Start the new action, moving the struct payload into it. Its result is applied next.
+					++TransitionsThisFrame;
+					++chainLength;
+					currentResult = Action->InvokeOnStart(currentResult.Payload, MoveTemp(currentResult.StructPayload));
+					break;
 				}
+			case ENLActionChangeType::DONE:
+				{
+					if(logState)
+					{
+						SET_WARN_COLOR(COLOR_RED);
+						UE_LOG(LogNextLife, Warning, TEXT("%s DONE : %s"), *Action->GetName(), *currentResult.Reason.ToString());
+						CLEAR_WARN_COLOR();
+					}
 
-				UNLAction* endingAction = Action;
-				Action = Action->PreviousAction;
-				endingAction->InvokeOnDone(Action);
+					UNLAction* endingAction = Action;
+					Action = GetActionBelow(Action);
+					endingAction->InvokeOnDone(Action);
+					RecordTransition(ENLTransitionRecordType::Done, endingAction->GetClass(), Action ? Action->GetClass() : nullptr,
+									 NAME_None, currentResult.Reason, ENLActionChangeType::DONE);
 
-				if(Action)
-				{
-					// Resume the action and let it apply an action result
-					Action->NextAction = nullptr;
-					
-					const FNLActionResult resumeResult = Action->InvokeOnResume(endingAction);
-					return ApplyActionResult(resumeResult, fromRequest);
+					++TransitionsThisFrame;
+					++chainLength;
+
+					if(Action)
+					{
+						// Resume the action, its result is applied next
+						currentResult = Action->InvokeOnResume(endingAction);
+					}
+					// Otherwise there are no more actions, this behavior has completed!
+					break;
 				}
+			default:
+				// No change to the current action
+				currentResult = FNLActionResult();
+				break;
+		}
+	}
 
-				// No more actions, this behavior has completed!
-				return nullptr;
-			}
-		default:
-			// No change to the current action
-			return Action;
+	if(chainLength > 0)
+	{
+		if(brain)
+		{
+			brain->RecordTransitions(chainLength);
+		}
+		else if(crowd)
+		{
+			crowd->RecordTransitions(chainLength);
+		}
 	}
+
+	return Action;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
 bool UNLBehavior::HandleEventResponse(UNLAction* respondingAction, const FName eventName, const FNLEventResponse& response)
+{
+	if(response.IsNone())
+	{
+		// Nothing to handle, move on
+		return false;
+	}
+
+	return StoreEventResponse(respondingAction, eventName, FNLEventResponse(response));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLBehavior::StoreEventResponse(UNLAction* respondingAction, const FName eventName, FNLEventResponse&& response)
 {
 	check(respondingAction);
 
@@ -373,35 +850,58 @@ bool UNLBehavior::HandleEventResponse(UNLAction* respondingAction, const FName e
 		// Nothing to handle, move on
 		return false;
 	}
+
+	if(!ActionStack.IsValidIndex(respondingAction->StackDepth) || ActionStack[respondingAction->StackDepth] != respondingAction)
+	{
+		// Only actions on the stack have their responses applied
+		return false;
+	}
 	
 	bool eventHandled = false;
-	FString storeAction = "STORED";
+	const TCHAR* storeAction = TEXT("STORED");
+	ENLTransitionRecordType recordType = ENLTransitionRecordType::EventStored;
 
 	// Check if there is already an event pending which has a higher priority. If not, we can replace it.
-	if(response.Priority > respondingAction->EventResponse.Priority)
+	const FNLPendingEventResponse* pendingResponse = FindPendingResponse(respondingAction);
+	const ENLEventRequestPriority pendingPriority = pendingResponse ? pendingResponse->Response.Priority : ENLEventRequestPriority::NONE;
+	if(response.Priority > pendingPriority)
 	{
-		if(respondingAction->EventResponse.Priority != ENLEventRequestPriority::NONE)
+		if(pendingPriority != ENLEventRequestPriority::NONE)
 		{
-			storeAction = "OVERRODE PREVIOUS WITH";
+			storeAction = TEXT("OVERRODE PREVIOUS WITH");
+			recordType = ENLTransitionRecordType::EventOverrode;
 		}
-		respondingAction->EventResponse = response;
-		respondingAction->EventResponse.EventName = eventName;
+		response.EventName = eventName;
+		SetEventResponse(respondingAction, MoveTemp(response));
 		eventHandled = true;
 	}
 	else
 	{
 		storeAction = TEXT("IGNORED");
+		recordType = ENLTransitionRecordType::EventIgnored;
 		if(response.Priority == ENLEventRequestPriority::CRITICAL)
 		{
 			UE_LOG(LogNextLife, Warning, TEXT("%s::%s -> %s RESULT_CRITICAL collision"), *GetName(), *respondingAction->GetName(), *eventName.ToString());
 			storeAction = TEXT("IGNORE COLLISION");
+			recordType = ENLTransitionRecordType::EventCollision;
 		}
 	}
 	
-	if(GetBrainComponent()->LogState)
 	{
+		// The response was moved if it was stored
+		const FNLEventResponse& recordedResponse = eventHandled ? FindPendingResponse(respondingAction)->Response : response;
+		RecordTransition(recordType, respondingAction->GetClass(), recordedResponse.Action, eventName, recordedResponse.Reason,
+						 recordedResponse.ChangeRequest, recordedResponse.Priority);
+	}
+
+	const UNextLifeBrainComponent* brain = GetBrainComponent();
+	if(brain && brain->LogState)
+	{
+		// The response was moved if it was stored
+		const FNLEventResponse& loggedResponse = eventHandled ? FindPendingResponse(respondingAction)->Response : response;
+
 		FString requestStr;
-		switch(response.ChangeRequest)
+		switch(loggedResponse.ChangeRequest)
 		{
 			case ENLActionChangeType::DONE:
 				{
@@ -410,14 +910,14 @@ bool UNLBehavior::HandleEventResponse(UNLAction* respondingAction, const FName e
 				}
 			case ENLActionChangeType::CHANGE:
 				{
-					check(response.Action);
-					requestStr = FString::Printf(TEXT("CHANGE to %s (%s)"), *response.Action->GetName(), *UEnum::GetValueAsString(response.Priority));
+					check(loggedResponse.Action);
+					requestStr = FString::Printf(TEXT("CHANGE to %s (%s)"), *loggedResponse.Action->GetName(), *UEnum::GetValueAsString(loggedResponse.Priority));
 					break;
 				}
 			case ENLActionChangeType::SUSPEND:
 				{
-					check(response.Action);
-					requestStr = FString::Printf(TEXT("SUSPEND for %s (%s)"), *response.Action->GetName(), *UEnum::GetValueAsString(response.Priority));
+					check(loggedResponse.Action);
+					requestStr = FString::Printf(TEXT("SUSPEND for %s (%s)"), *loggedResponse.Action->GetName(), *UEnum::GetValueAsString(loggedResponse.Priority));
 					break;
 				}
 			default:
@@ -426,68 +926,123 @@ bool UNLBehavior::HandleEventResponse(UNLAction* respondingAction, const FName e
 		SET_WARN_COLOR(COLOR_CYAN);
 		UE_LOG(LogNextLife, Warning, TEXT("%s:%s %s EVENT '%s' with request %s - '%s'"), *GetName(),
 																					  *respondingAction->GetName(),
-																					  *storeAction,
+																					  storeAction,
 																					  *eventName.ToString(),
 																					  *requestStr,
-																					  *response.Reason);
+																					  *loggedResponse.Reason.ToString());
 		CLEAR_WARN_COLOR();
 	}
 
 	return eventHandled;
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLBehavior::RecordTransition(ENLTransitionRecordType type, const UClass* fromClass, const UClass* toClass,
+								   const FName eventName, const FName reason,
+								   ENLActionChangeType change, ENLEventRequestPriority priority)
+{
+	UNextLifeBrainComponent* brain = GetBrainComponent();
+	FNLTransitionRecorder* recorder = brain ? brain->GetTransitionRecorder() : nullptr;
+	if(!recorder)
+	{
+		return;
+	}
+
+	FNLTransitionRecord record;
+	record.Time = GetWorldTimeSeconds();
+	record.Frame = static_cast<uint32>(GFrameCounter);
+	record.EventName = eventName;
+	record.Reason = reason;
+	record.BehaviorClass = FNLTransitionRecorder::GetClassId(GetClass());
+	record.FromClass = FNLTransitionRecorder::GetClassId(fromClass);
+	record.ToClass = FNLTransitionRecorder::GetClassId(toClass);
+	record.StackDepth = Action ? static_cast<int16>(Action->StackDepth) : -1;
+	record.Type = type;
+	record.Change = change;
+	record.Priority = priority;
+	recorder->Record(record);
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
 UNLAction* UNLBehavior::ApplyPendingEvents()
 {
-	while(Action && !Action->EventResponse.IsNone())
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ApplyPendingEvents);
+	NEXTLIFE_TRACE_SCOPE("Apply Pending Events", this);
+
+	while(Action && !HasDeferredResult && PendingResponses.Num() > 0)
 	{
+		FNLPendingEventResponse* topResponse = FindPendingResponse(Action);
+		if(!topResponse)
+		{
+			break;
+		}
+
 		// Create a new action from the event
 		FNLActionResult newAction;
-		CreateActionResultFromEvent(Action->EventResponse, newAction);
+		CreateActionResultFromEvent(MoveTemp(topResponse->Response), newAction);
 
 		// Clear now so if any other events occur from the action result they won't be affected
-		Action->EventResponse = FNLEventResponse();
+		SetEventResponse(Action, FNLEventResponse());
 
 		// Apply the top level response immediately
-		Action = ApplyActionResult(newAction, true);
+		Action = ApplyActionResult(MoveTemp(newAction), true);
 	}
 
-	if(!Action)
+	if(!Action || HasDeferredResult || PendingResponses.Num() == 0)
 	{
+		// Pending requests wait until deferred transitions are done
 		return Action;
 	}
 
-	// Check for pending requests from lower actions, determine the highest order request and send it to the top level
-	// for evaluation.
-	FNLEventResponse requestedResponse;
-	UNLAction* requestingAction = nullptr;
-	UNLAction* previousAction = Action->PreviousAction;
-	while(previousAction)
+	// The responses left are from lower actions. Send the highest priority one, the one closest to the top on ties, to
+	// the top level for evaluation and clear the rest.
+	int32 requestingEntry = 0;
+	for(int32 entryIndex = 1; entryIndex < PendingResponses.Num(); ++entryIndex)
 	{
-		if(previousAction->EventResponse.Priority > requestedResponse.Priority)
+		const FNLPendingEventResponse& pending = PendingResponses[entryIndex];
+		const FNLPendingEventResponse& requesting = PendingResponses[requestingEntry];
+		if(pending.Response.Priority > requesting.Response.Priority ||
+		   (pending.Response.Priority == requesting.Response.Priority && pending.Action->StackDepth > requesting.Action->StackDepth))
 		{
-			requestedResponse = previousAction->EventResponse;
-			requestingAction = previousAction;
+			requestingEntry = entryIndex;
 		}
-
-		// Clear
-		previousAction->EventResponse = FNLEventResponse();
-		previousAction = previousAction->PreviousAction;
 	}
 
+	UNLAction* requestingAction = PendingResponses[requestingEntry].Action;
+	const int32 requestingIndex = requestingAction->StackDepth;
+	FNLEventResponse requestedResponse = MoveTemp(PendingResponses[requestingEntry].Response);
+	PendingResponses.Reset();
+	checkf(requestingIndex < Action->StackDepth, TEXT("A pending response was left in the TOP action"));
+
 	if(!requestedResponse.IsNone())
 	{
 		bool useNormalBehavior = true;
 		
 		// Check the stack for an action which could take this event over
-		UNLAction* nextAction = Action;
-		while(nextAction && nextAction != requestingAction)
+		for(int32 stackIndex = Action->StackDepth; stackIndex > requestingIndex; --stackIndex)
 		{
+			if(ActionSlots[stackIndex].Class != requestedResponse.Action)
+			{
+				continue;
+			}
+
+			// Every native action is hosted by the same class, only one of the requested native type can take over
+			UNLAction* takeoverAction = ActionStack[stackIndex];
+			if(requestedResponse.NativeType)
+			{
+				const FNLNativeAction* nativeAction = FNLNativeAction::Get(takeoverAction);
+				if(!nativeAction || nativeAction->GetNativeType() != requestedResponse.NativeType)
+				{
+					continue;
+				}
+			}
+
 			bool keepChildActions = true;
-			if(nextAction->GetClass() == requestedResponse.Action &&
-				nextAction->OnRequestTakeover(requestedResponse, requestingAction, keepChildActions))
+			if(takeoverAction->InvokeOnRequestTakeover(requestedResponse, requestingAction, keepChildActions))
 			{
 				useNormalBehavior = false;
 
@@ -495,23 +1050,23 @@ UNLAction* UNLBehavior::ApplyPendingEvents()
 				if(!keepChildActions)
 				{
 					// The takeover action has become the top action for now (this is so events from OnDone don't consider actions about to end)
-					Action = nextAction;
+					Action = takeoverAction;
 			
 					// The takeover action could be the current action, in which case, no extra action is required.
-					if(Action->NextAction)
+					if(UNLAction* oldAction = GetActionAbove(Action))
 					{
 						// Clear all actions above the takeover action
-						Action->NextAction->InvokeOnDone(Action);
+						oldAction->InvokeOnDone(Action);
 						
 						// Resume the takeover action
-						UNLAction* oldAction = Action->NextAction;
-						Action->NextAction = nullptr;
+						RecordTransition(ENLTransitionRecordType::Takeover, requestingAction->GetClass(), Action->GetClass(),
+										 requestedResponse.EventName, requestedResponse.Reason,
+										 requestedResponse.ChangeRequest, requestedResponse.Priority);
 						Action = ApplyActionResult(Action->InvokeOnResume(oldAction), true);
 					}
 				}
 				break;
 			}
-			nextAction = nextAction->PreviousAction;
 		}
 
 		if(useNormalBehavior &&
@@ -523,50 +1078,53 @@ UNLAction* UNLBehavior::ApplyPendingEvents()
 				
 			// Suspend appends means we just want to put the action ontop of the top acton.
 			// Request this of the top action, this suspend it if we can do it.
-			if(Action->OnRequestEvent(requestedResponse, requestingAction))
+			if(Action->InvokeOnRequestEvent(requestedResponse, requestingAction))
 			{
 				// Now run the suspend normally
 				FNLActionResult newAction;
-				CreateActionResultFromEvent(requestedResponse, newAction);
-				Action = ApplyActionResult(newAction, true);
+				CreateActionResultFromEvent(MoveTemp(requestedResponse), newAction);
+				Action = ApplyActionResult(MoveTemp(newAction), true);
 			}
 		}
 
 		if(useNormalBehavior)
 		{
 			// Now if this request is not None, request that this action go through from the top of the action stack down to the requester
-			nextAction = Action;
-			while(nextAction && nextAction != requestingAction)
+			int32 stackIndex = Action->StackDepth;
+			while(stackIndex > requestingIndex)
 			{
 				// If any action doesn't agree, we cannot use this request
-				if(!nextAction->OnRequestEvent(requestedResponse, requestingAction))
+				if(!ActionStack[stackIndex]->InvokeOnRequestEvent(requestedResponse, requestingAction))
 				{
 					break;
 				}
-				nextAction = nextAction->PreviousAction;
+				--stackIndex;
 			}
 
 			// If all actions up to the requesting action agree with the event, we clear all actions after the requesting
 			// action and run the event.
-			if(nextAction == requestingAction)
+			if(stackIndex == requestingIndex)
 			{
 				// The requesting action has become the top action for now (this is so events from OnDone don't consider actions about to end)
 				Action = requestingAction;
 				
 				// Clear all actions above the requesting action
-				check(Action->NextAction);
-				Action->NextAction->InvokeOnDone(requestingAction);
-				Action->NextAction = nullptr;
+				UNLAction* aboveAction = GetActionAbove(Action);
+				check(aboveAction);
+				aboveAction->InvokeOnDone(requestingAction);
+				RecordTransition(ENLTransitionRecordType::RequestAccepted, requestingAction->GetClass(), Action->GetClass(),
+								 requestedResponse.EventName, requestedResponse.Reason,
+								 requestedResponse.ChangeRequest, requestedResponse.Priority);
 
 				// Now run the event
 				FNLActionResult newAction;
-				CreateActionResultFromEvent(requestedResponse, newAction);
-				Action = ApplyActionResult(newAction, true);
+				CreateActionResultFromEvent(MoveTemp(requestedResponse), newAction);
+				Action = ApplyActionResult(MoveTemp(newAction), true);
 			}
 			else if(requestedResponse.Priority > ENLEventRequestPriority::TRY)
 			{
 				// Nobody accepted the action, give it back to the owner to try again later if it is important
-				requestingAction->EventResponse = requestedResponse;
+				SetEventResponse(requestingAction, MoveTemp(requestedResponse));
 			}
 		}
 	}
@@ -577,11 +1135,13 @@ UNLAction* UNLBehavior::ApplyPendingEvents()
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
-void UNLBehavior::CreateActionResultFromEvent(const FNLEventResponse& response, FNLActionResult& actionResultOut)
+void UNLBehavior::CreateActionResultFromEvent(FNLEventResponse&& response, FNLActionResult& actionResultOut)
 {
 	actionResultOut.Action = response.Action;
 	actionResultOut.Change = response.ChangeRequest;
 	actionResultOut.Payload = response.Payload;
+	actionResultOut.StructPayload = MoveTemp(response.StructPayload);
+	actionResultOut.NativeType = response.NativeType;
 	actionResultOut.Reason = response.Reason;
 }
 
@@ -611,25 +1171,28 @@ UNLGeneralMessage* UNLBehavior::CreateGeneralMessage(TSubclassOf<UNLGeneralMessa
 */
 FNLEventResponse UNLBehavior::General_Message_Implementation(UNLGeneralMessage* message)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_GeneralMessage);
+	NEXTLIFE_TRACE_SCOPE("General_Message", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = GeneralEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLGeneralEvents>())
+			UNLAction* curAction = GeneralEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLGeneralEvents::Execute_General_Message(curAction, message);
-				if(HandleEventResponse(curAction, TEXT("General_Message"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLGeneralEvents, curAction, General_Message, message);
+			if(StoreEventResponse(curAction, NAME_General_Message, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-    return responseOut;
+	return FNLEventResponse();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -637,25 +1200,28 @@ FNLEventResponse UNLBehavior::General_Message_Implementation(UNLGeneralMessage*
 */
 FNLEventResponse UNLBehavior::Sense_Sight_Implementation(APawn* subject, bool indirect)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_SenseSight);
+	NEXTLIFE_TRACE_SCOPE("Sense_Sight", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = SensingEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLSensingEvents>())
+			UNLAction* curAction = SensingEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLSensingEvents::Execute_Sense_Sight(curAction, subject, indirect);
-				if(HandleEventResponse(curAction, TEXT("Sense_Sight"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLSensingEvents, curAction, Sense_Sight, subject, indirect);
+			if(StoreEventResponse(curAction, NAME_Sense_Sight, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-	return responseOut;
+	return FNLEventResponse();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -663,25 +1229,28 @@ FNLEventResponse UNLBehavior::Sense_Sight_Implementation(APawn* subject, bool in
 */
 FNLEventResponse UNLBehavior::Sense_SightLost_Implementation(APawn* subject)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_SenseSightLost);
+	NEXTLIFE_TRACE_SCOPE("Sense_SightLost", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = SensingEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLSensingEvents>())
+			UNLAction* curAction = SensingEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLSensingEvents::Execute_Sense_SightLost(curAction, subject);
-				if(HandleEventResponse(curAction, TEXT("Sense_SightLost"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLSensingEvents, curAction, Sense_SightLost, subject);
+			if(StoreEventResponse(curAction, NAME_Sense_SightLost, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-	return responseOut;
+	return FNLEventResponse();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -689,25 +1258,28 @@ FNLEventResponse UNLBehavior::Sense_SightLost_Implementation(APawn* subject)
 */
 FNLEventResponse UNLBehavior::Sense_Sound_Implementation(APawn* OtherActor, const FVector& Location, float Volume, int32 flags)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_SenseSound);
+	NEXTLIFE_TRACE_SCOPE("Sense_Sound", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = SensingEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLSensingEvents>())
+			UNLAction* curAction = SensingEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLSensingEvents::Execute_Sense_Sound(curAction, OtherActor, Location, Volume, flags);
-				if(HandleEventResponse(curAction, TEXT("Sense_Sound"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLSensingEvents, curAction, Sense_Sound, OtherActor, Location, Volume, flags);
+			if(StoreEventResponse(curAction, NAME_Sense_Sound, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-	return responseOut;
+	return FNLEventResponse();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -715,25 +1287,28 @@ FNLEventResponse UNLBehavior::Sense_Sound_Implementation(APawn* OtherActor, cons
 */
 FNLEventResponse UNLBehavior::Sense_Contact_Implementation(AActor* other, const FHitResult& hitResult)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_SenseContact);
+	NEXTLIFE_TRACE_SCOPE("Sense_Contact", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = SensingEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLSensingEvents>())
+			UNLAction* curAction = SensingEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLSensingEvents::Execute_Sense_Contact(curAction, other, hitResult);
-				if(HandleEventResponse(curAction, TEXT("Sense_Contact"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLSensingEvents, curAction, Sense_Contact, other, hitResult);
+			if(StoreEventResponse(curAction, NAME_Sense_Contact, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-	return responseOut;
+	return FNLEventResponse();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -741,25 +1316,28 @@ FNLEventResponse UNLBehavior::Sense_Contact_Implementation(AActor* other, const
 */
 FNLEventResponse UNLBehavior::Movement_MoveTo_Implementation(const AActor* goal, const FVector& pos, float range)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_MovementMoveTo);
+	NEXTLIFE_TRACE_SCOPE("Movement_MoveTo", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = MovementEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLMovementEvents>())
+			UNLAction* curAction = MovementEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLMovementEvents::Execute_Movement_MoveTo(curAction, goal, pos, range);
-				if(HandleEventResponse(curAction, TEXT("Movement_MoveTo"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLMovementEvents, curAction, Movement_MoveTo, goal, pos, range);
+			if(StoreEventResponse(curAction, NAME_Movement_MoveTo, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-	return responseOut;
+	return FNLEventResponse();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -767,23 +1345,26 @@ FNLEventResponse UNLBehavior::Movement_MoveTo_Implementation(const AActor* goal,
 */
 FNLEventResponse UNLBehavior::Movement_MoveToComplete_Implementation(FAIRequestID RequestID, const EPathFollowingResult::Type Result)
 {
-	FNLEventResponse responseOut;
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_Event_MovementMoveToComplete);
+	NEXTLIFE_TRACE_SCOPE("Movement_MoveToComplete", this);
+
 	if(!AreEventsPaused())
 	{
-		UNLAction* curAction = Action;
-		while(curAction)
+		for(int32 listenerIndex = MovementEventListeners.Num() - 1; listenerIndex >= 0; --listenerIndex)
 		{
-			if(curAction->Implements<UNLMovementEvents>())
+			UNLAction* curAction = MovementEventListeners[listenerIndex];
+			if(!IsActiveListener(curAction))
 			{
-				responseOut = INLMovementEvents::Execute_Movement_MoveToComplete(curAction, RequestID, Result);
-				if(HandleEventResponse(curAction, TEXT("Movement_MoveToComplete"), responseOut))
-				{
-					break;
-				}
+				continue;
 			}
 
-			curAction = curAction->PreviousAction;
+			FNLEventResponse response = NL_CALL_EVENT(INLMovementEvents, curAction, Movement_MoveToComplete, RequestID, Result);
+			if(StoreEventResponse(curAction, NAME_Movement_MoveToComplete, MoveTemp(response)))
+			{
+				// The response was moved into the pending responses, its payload stays there
+				return FindPendingResponse(curAction)->Response.GetRequest();
+			}
 		}
 	}
-	return responseOut;
+	return FNLEventResponse();
 }
@@ -0,0 +1,245 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NLEventOverrides.h"
+#include "NextLifeModule.h"
+#include "NLAction.h"
+#include "NLBehavior.h"
+
+#include "Engine/Blueprint.h"
+#include "Engine/World.h"
+#include "Misc/CoreDelegates.h"
+#include "UObject/UObjectIterator.h"
+
+TMap<const UClass*, FNLEventOverrides::FClassEntry> FNLEventOverrides::Classes;
+
+namespace
+{
+	// An event and the event set interface declaring it, null for action events
+	struct FNLOverridableEvent
+	{
+		ENLOverridableEvents Event;
+		FName Name;
+		UClass* (*GetEventSet)();
+	};
+
+	const int32 OverridableEventCount = 15;
+
+	const FNLOverridableEvent& GetOverridableEvent(int32 index)
+	{
+		// Built on first use, the event set classes must exist by then
+		static const FNLOverridableEvent events[OverridableEventCount] =
+		{
+			{ ENLOverridableEvents::OnStart, TEXT("OnStart"), nullptr },
+			{ ENLOverridableEvents::OnUpdate, TEXT("OnUpdate"), nullptr },
+			{ ENLOverridableEvents::OnSuspend, TEXT("OnSuspend"), nullptr },
+			{ ENLOverridableEvents::OnResume, TEXT("OnResume"), nullptr },
+			{ ENLOverridableEvents::OnDone, TEXT("OnDone"), nullptr },
+			{ ENLOverridableEvents::OnRequestEvent, TEXT("OnRequestEvent"), nullptr },
+			{ ENLOverridableEvents::OnRequestTakeover, TEXT("OnRequestTakeover"), nullptr },
+			{ ENLOverridableEvents::OnReset, TEXT("OnReset"), nullptr },
+			{ ENLOverridableEvents::General_Message, TEXT("General_Message"), &UNLGeneralEvents::StaticClass },
+			{ ENLOverridableEvents::Sense_Sight, TEXT("Sense_Sight"), &UNLSensingEvents::StaticClass },
+			{ ENLOverridableEvents::Sense_SightLost, TEXT("Sense_SightLost"), &UNLSensingEvents::StaticClass },
+			{ ENLOverridableEvents::Sense_Sound, TEXT("Sense_Sound"), &UNLSensingEvents::StaticClass },
+			{ ENLOverridableEvents::Sense_Contact, TEXT("Sense_Contact"), &UNLSensingEvents::StaticClass },
+			{ ENLOverridableEvents::Movement_MoveTo, TEXT("Movement_MoveTo"), &UNLMovementEvents::StaticClass },
+			{ ENLOverridableEvents::Movement_MoveToComplete, TEXT("Movement_MoveToComplete"), &UNLMovementEvents::StaticClass },
+		};
+		return events[index];
+	}
+
+	// Does a class, or one of its super classes, implement an event set in C++
+	bool ImplementsEventSetNatively(const UClass* objectClass, const UClass* eventSet)
+	{
+		for(const UClass* currentClass = objectClass; currentClass; currentClass = currentClass->GetSuperClass())
+		{
+			for(const FImplementedInterface& implementedInterface : currentClass->Interfaces)
+			{
+				if(implementedInterface.Class && implementedInterface.Class->IsChildOf(eventSet) && !implementedInterface.bImplementedByK2)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Is a class one the registry is built for
+	bool IsRegisteredClass(const UClass* objectClass)
+	{
+		return objectClass->IsChildOf(UNLAction::StaticClass()) || objectClass->IsChildOf(UNLBehavior::StaticClass());
+	}
+
+	FDelegateHandle PostEngineInitHandle;
+	FDelegateHandle AssetLoadedHandle;
+	FDelegateHandle PostGarbageCollectHandle;
+	FDelegateHandle PreWorldInitializationHandle;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::Startup()
+{
+	PostEngineInitHandle = FCoreDelegates::OnPostEngineInit.AddStatic(&FNLEventOverrides::OnPostEngineInit);
+	AssetLoadedHandle = FCoreUObjectDelegates::OnAssetLoaded.AddStatic(&FNLEventOverrides::OnAssetLoaded);
+	PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddStatic(&FNLEventOverrides::OnPostGarbageCollect);
+
+#if WITH_EDITOR
+	// Blueprints compiled in the editor keep their class, forget what was found when a play session starts
+	PreWorldInitializationHandle = FWorldDelegates::OnPreWorldInitialization.AddLambda([](UWorld* world, const UWorld::InitializationValues initializationValues)
+	{
+		FNLEventOverrides::OnPreWorldInitialization();
+	});
+#endif
+
+	// Loaded as a plugin after the engine started
+	if(GEngine)
+	{
+		RegisterLoadedClasses();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::Shutdown()
+{
+	FCoreDelegates::OnPostEngineInit.Remove(PostEngineInitHandle);
+	FCoreUObjectDelegates::OnAssetLoaded.Remove(AssetLoadedHandle);
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectHandle);
+#if WITH_EDITOR
+	FWorldDelegates::OnPreWorldInitialization.Remove(PreWorldInitializationHandle);
+#endif
+
+	Classes.Empty();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+ENLOverridableEvents FNLEventOverrides::GetDirectEvents(const UClass* objectClass)
+{
+	if(!objectClass)
+	{
+		return ENLOverridableEvents::NONE;
+	}
+
+	// Objects created while loading off the game thread work it out without touching the registry
+	if(!IsInGameThread())
+	{
+		return FindDirectEvents(objectClass);
+	}
+
+	if(const FClassEntry* entry = Classes.Find(objectClass))
+	{
+		return entry->DirectEvents;
+	}
+
+	FClassEntry& entry = Classes.Add(objectClass);
+	entry.Class = objectClass;
+	entry.DirectEvents = FindDirectEvents(objectClass);
+	return entry.DirectEvents;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 FNLEventOverrides::GetClassCount()
+{
+	return Classes.Num();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+ENLOverridableEvents FNLEventOverrides::FindDirectEvents(const UClass* objectClass)
+{
+	ENLOverridableEvents directEvents = ENLOverridableEvents::NONE;
+	for(int32 eventIndex = 0; eventIndex < OverridableEventCount; ++eventIndex)
+	{
+		const FNLOverridableEvent& overridableEvent = GetOverridableEvent(eventIndex);
+
+		// A Blueprint override is a function of a Blueprint class, which isn't native
+		const UFunction* function = objectClass->FindFunctionByName(overridableEvent.Name);
+		if(!function || !function->HasAnyFunctionFlags(FUNC_Native))
+		{
+			continue;
+		}
+
+		// Event set events only have an implementation to call if the event set is implemented in C++
+		if(overridableEvent.GetEventSet && !ImplementsEventSetNatively(objectClass, overridableEvent.GetEventSet()))
+		{
+			continue;
+		}
+
+		directEvents |= overridableEvent.Event;
+	}
+	return directEvents;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::RegisterLoadedClasses()
+{
+	for(TObjectIterator<UClass> classIt; classIt; ++classIt)
+	{
+		const UClass* objectClass = *classIt;
+		if(IsRegisteredClass(objectClass) && !objectClass->HasAnyClassFlags(CLASS_NewerVersionExists))
+		{
+			GetDirectEvents(objectClass);
+		}
+	}
+
+	UE_LOG(LogNextLife, Verbose, TEXT("Event override registry has %d classes"), Classes.Num());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::OnPostEngineInit()
+{
+	RegisterLoadedClasses();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::OnAssetLoaded(UObject* asset)
+{
+	// Blueprint assets load their generated class along with them
+	const UClass* loadedClass = Cast<UClass>(asset);
+	if(const UBlueprint* blueprint = Cast<UBlueprint>(asset))
+	{
+		loadedClass = blueprint->GeneratedClass;
+	}
+
+	if(loadedClass && IsRegisteredClass(loadedClass))
+	{
+		GetDirectEvents(loadedClass);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::OnPostGarbageCollect()
+{
+	// A collected class' address can be reused by a new class
+	for(auto classIt = Classes.CreateIterator(); classIt; ++classIt)
+	{
+		if(!classIt.Value().Class.IsValid())
+		{
+			classIt.RemoveCurrent();
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventOverrides::OnPreWorldInitialization()
+{
+	Classes.Reset();
+}
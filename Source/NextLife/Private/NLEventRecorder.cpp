@@ -0,0 +1,648 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NLEventRecorder.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+#include "NLBehavior.h"
+
+#include "AIController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+#include "UObject/UObjectIterator.h"
+
+namespace
+{
+	// "NLEV"
+	const uint32 EventFileMagic = 0x56454C4E;
+	const uint32 EventFileVersion = 1;
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	* Writes the tagged properties of an object. Object references are kept as paths, so a recording doesn't hold on
+	* to anything from the world it was made in. Transient properties are skipped.
+	*/
+	void SaveProperties(const UObject* object, TArray<uint8>& dataOut)
+	{
+		FMemoryWriter writer(dataOut, true);
+		FObjectAndNameAsStringProxyArchive archive(writer, false);
+		object->SerializeScriptProperties(archive);
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	void LoadProperties(UObject* object, const TArray<uint8>& data)
+	{
+		FMemoryReader reader(data, true);
+		FObjectAndNameAsStringProxyArchive archive(reader, true);
+		object->SerializeScriptProperties(archive);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventRecorder::FNLEventRecorder()
+	: Recording(false)
+	, UpdateCount(0)
+	, EventCount(0)
+	, LogicWasStarted(false)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::Start(const UNextLifeBrainComponent& brain)
+{
+	Stop();
+	Recording = true;
+
+	BrainClass = brain.GetClass()->GetPathName();
+	SaveProperties(&brain, BrainProperties);
+
+	const AAIController* controller = brain.GetAIOwner();
+	const APawn* pawn = controller ? controller->GetPawn() : nullptr;
+	PawnClass = pawn ? pawn->GetClass()->GetPathName() : FString();
+
+	LogicWasStarted = brain.IsRunning() || brain.IsPaused();
+	for(const UNLBehavior* behavior : brain.GetBehaviors())
+	{
+		if(behavior)
+		{
+			BehaviorClasses.Add(AddClass(behavior->GetClass()));
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::Stop()
+{
+	Recording = false;
+	UpdateCount = 0;
+	EventCount = 0;
+	BrainClass.Reset();
+	BrainProperties.Reset();
+	PawnClass.Reset();
+	LogicWasStarted = false;
+	BehaviorClasses.Reset();
+	ClassIndices.Reset();
+	ClassPaths.Reset();
+	SubjectIndices.Reset();
+	SubjectNames.Reset();
+	Stream.Reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordUpdate(float deltaTime)
+{
+	WriteEntry(ENLRecordedEventType::Update, [deltaTime](FArchive& writer)
+	{
+		uint32 frame = static_cast<uint32>(GFrameCounter);
+		float delta = deltaTime;
+		writer << frame << delta;
+	});
+	++UpdateCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordLogic(ENLRecordedEventType type)
+{
+	check(type >= ENLRecordedEventType::StartLogic && type <= ENLRecordedEventType::ResumeLogic);
+	WriteEntry(type, [](FArchive& writer) {});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordBehavior(ENLRecordedEventType type, const UClass* behaviorClass)
+{
+	check(type == ENLRecordedEventType::AddBehavior || type == ENLRecordedEventType::RemoveBehavior);
+	int32 classIndex = AddClass(behaviorClass);
+	WriteEntry(type, [classIndex](FArchive& writer) mutable
+	{
+		writer << classIndex;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordGeneralMessage(const UNLGeneralMessage* message)
+{
+	int32 classIndex = message ? AddClass(message->GetClass()) : INDEX_NONE;
+	TArray<uint8> messageData;
+	if(message)
+	{
+		SaveProperties(message, messageData);
+	}
+
+	WriteEntry(ENLRecordedEventType::GeneralMessage, [classIndex, &messageData](FArchive& writer) mutable
+	{
+		writer << classIndex << messageData;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordSight(const AActor* subject, bool indirect)
+{
+	WriteEntry(ENLRecordedEventType::Sight, [this, subject, indirect](FArchive& writer)
+	{
+		WriteSubject(writer, subject);
+		uint8 indirectValue = indirect ? 1 : 0;
+		writer << indirectValue;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordSightLost(const AActor* subject)
+{
+	WriteEntry(ENLRecordedEventType::SightLost, [this, subject](FArchive& writer)
+	{
+		WriteSubject(writer, subject);
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordSound(const AActor* subject, const FVector& location, float volume, int32 flags)
+{
+	WriteEntry(ENLRecordedEventType::Sound, [&](FArchive& writer)
+	{
+		WriteSubject(writer, subject);
+		FVector soundLocation = location;
+		float soundVolume = volume;
+		int32 soundFlags = flags;
+		writer << soundLocation << soundVolume << soundFlags;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordContact(const AActor* other, const FHitResult& hitResult)
+{
+	WriteEntry(ENLRecordedEventType::Contact, [&](FArchive& writer)
+	{
+		WriteSubject(writer, other);
+		FVector impactPoint = hitResult.ImpactPoint;
+		FVector impactNormal = hitResult.ImpactNormal;
+		writer << impactPoint << impactNormal;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordMoveTo(const AActor* goal, const FVector& pos, float range)
+{
+	WriteEntry(ENLRecordedEventType::MoveTo, [&](FArchive& writer)
+	{
+		WriteSubject(writer, goal);
+		FVector movePos = pos;
+		float moveRange = range;
+		writer << movePos << moveRange;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::RecordMoveToComplete(FAIRequestID requestID, EPathFollowingResult::Type result)
+{
+	WriteEntry(ENLRecordedEventType::MoveToComplete, [requestID, result](FArchive& writer)
+	{
+		uint32 requestValue = requestID.GetID();
+		uint8 resultValue = static_cast<uint8>(result);
+		writer << requestValue << resultValue;
+	});
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::WriteEntry(ENLRecordedEventType type, TFunctionRef<void(FArchive&)> writePayload)
+{
+	check(Recording);
+
+	FMemoryWriter writer(Stream, false, true);
+	uint8 typeValue = static_cast<uint8>(type);
+	writer << typeValue;
+	writePayload(writer);
+
+	if(type != ENLRecordedEventType::Update)
+	{
+		++EventCount;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventRecorder::WriteSubject(FArchive& writer, const AActor* subject)
+{
+	int32 subjectIndex = INDEX_NONE;
+	FVector subjectLocation = FVector::ZeroVector;
+	if(subject)
+	{
+		const FName subjectName = subject->GetFName();
+		if(const int32* existingIndex = SubjectIndices.Find(subjectName))
+		{
+			subjectIndex = *existingIndex;
+		}
+		else
+		{
+			subjectIndex = SubjectNames.Add(subject->GetName());
+			SubjectIndices.Add(subjectName, subjectIndex);
+		}
+		subjectLocation = subject->GetActorLocation();
+	}
+	writer << subjectIndex << subjectLocation;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+int32 FNLEventRecorder::AddClass(const UClass* recordedClass)
+{
+	if(!recordedClass)
+	{
+		return INDEX_NONE;
+	}
+
+	if(const int32* classIndex = ClassIndices.Find(recordedClass))
+	{
+		return *classIndex;
+	}
+	return ClassIndices.Add(recordedClass, ClassPaths.Add(recordedClass->GetPathName()));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLEventRecorder::WriteFile(const FString& path) const
+{
+	if(!Recording)
+	{
+		return false;
+	}
+
+	TArray<uint8> fileData;
+	FMemoryWriter fileWriter(fileData);
+
+	uint32 magic = EventFileMagic;
+	uint32 version = EventFileVersion;
+	FString brainClass = BrainClass;
+	TArray<uint8> brainProperties = BrainProperties;
+	FString pawnClass = PawnClass;
+	bool logicWasStarted = LogicWasStarted;
+	TArray<int32> behaviorClasses = BehaviorClasses;
+	TArray<FString> classPaths = ClassPaths;
+	TArray<FString> subjectNames = SubjectNames;
+	int32 updateCount = UpdateCount;
+	int32 eventCount = EventCount;
+
+	fileWriter << magic << version;
+	fileWriter << brainClass << brainProperties << pawnClass << logicWasStarted << behaviorClasses;
+	fileWriter << classPaths << subjectNames << updateCount << eventCount;
+	fileWriter.Serialize(const_cast<uint8*>(Stream.GetData()), Stream.Num());
+
+	return FFileHelper::SaveArrayToFile(fileData, *path);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventReplay::FNLEventReplay()
+	: LogicWasStarted(false)
+	, UpdateCount(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLEventReplay::LoadFile(const FString& path)
+{
+	TArray<uint8> fileData;
+	if(!FFileHelper::LoadFileToArray(fileData, *path))
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Couldn't read event recording '%s'"), *path);
+		return false;
+	}
+
+	FMemoryReader reader(fileData);
+
+	uint32 magic = 0;
+	uint32 version = 0;
+	reader << magic << version;
+	if(magic != EventFileMagic || version != EventFileVersion)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("'%s' isn't a version %u event recording"), *path, EventFileVersion);
+		return false;
+	}
+
+	int32 eventCount = 0;
+	reader << BrainClass << BrainProperties << PawnClass << LogicWasStarted << BehaviorClasses;
+	reader << ClassPaths << SubjectNames << UpdateCount << eventCount;
+
+	Events.Reset(UpdateCount + eventCount);
+	while(!reader.AtEnd() && !reader.IsError())
+	{
+		uint8 type = 0;
+		reader << type;
+		if(type >= static_cast<uint8>(ENLRecordedEventType::Count))
+		{
+			UE_LOG(LogNextLife, Error, TEXT("'%s' has an unknown event type %u"), *path, type);
+			return false;
+		}
+
+		FNLRecordedEvent& recordedEvent = Events.AddDefaulted_GetRef();
+		recordedEvent.Type = static_cast<ENLRecordedEventType>(type);
+		switch(recordedEvent.Type)
+		{
+			case ENLRecordedEventType::Update:
+				reader << recordedEvent.Frame << recordedEvent.DeltaTime;
+				break;
+			case ENLRecordedEventType::AddBehavior:
+			case ENLRecordedEventType::RemoveBehavior:
+				reader << recordedEvent.Class;
+				break;
+			case ENLRecordedEventType::GeneralMessage:
+				reader << recordedEvent.Class << recordedEvent.MessageData;
+				break;
+			case ENLRecordedEventType::Sight:
+			{
+				uint8 indirect = 0;
+				reader << recordedEvent.Subject << recordedEvent.SubjectLocation << indirect;
+				recordedEvent.Flags = indirect;
+				break;
+			}
+			case ENLRecordedEventType::SightLost:
+				reader << recordedEvent.Subject << recordedEvent.SubjectLocation;
+				break;
+			case ENLRecordedEventType::Sound:
+				reader << recordedEvent.Subject << recordedEvent.SubjectLocation;
+				reader << recordedEvent.Location << recordedEvent.Value << recordedEvent.Flags;
+				break;
+			case ENLRecordedEventType::Contact:
+				reader << recordedEvent.Subject << recordedEvent.SubjectLocation;
+				reader << recordedEvent.Location << recordedEvent.Normal;
+				break;
+			case ENLRecordedEventType::MoveTo:
+				reader << recordedEvent.Subject << recordedEvent.SubjectLocation;
+				reader << recordedEvent.Location << recordedEvent.Value;
+				break;
+			case ENLRecordedEventType::MoveToComplete:
+				reader << recordedEvent.RequestID << recordedEvent.Result;
+				break;
+			default:
+				// Logic changes have no payload
+				break;
+		}
+	}
+
+	if(reader.IsError())
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Event recording '%s' is truncated"), *path);
+		return false;
+	}
+
+	Classes.Reset(ClassPaths.Num());
+	for(const FString& classPath : ClassPaths)
+	{
+		UClass* loadedClass = LoadObject<UClass>(nullptr, *classPath);
+		if(!loadedClass)
+		{
+			UE_LOG(LogNextLife, Warning, TEXT("Couldn't load recorded class '%s', its events will be skipped"), *classPath);
+		}
+		Classes.Add(loadedClass);
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNextLifeBrainComponent* FNLEventReplay::CreateBrain(AAIController* controller) const
+{
+	check(controller);
+
+	UClass* brainClass = LoadObject<UClass>(nullptr, *BrainClass);
+	if(!brainClass || !brainClass->IsChildOf(UNextLifeBrainComponent::StaticClass()))
+	{
+		UE_LOG(LogNextLife, Warning, TEXT("Couldn't load recorded brain class '%s', using the default brain"), *BrainClass);
+		brainClass = UNextLifeBrainComponent::StaticClass();
+	}
+
+	UNextLifeBrainComponent* brain = NewObject<UNextLifeBrainComponent>(controller, brainClass);
+	if(brainClass->GetPathName() == BrainClass)
+	{
+		LoadProperties(brain, BrainProperties);
+	}
+
+	// The driver updates the brain itself and it shouldn't record its own replay
+	brain->UseTickManager = false;
+	brain->RecordEvents = false;
+	brain->RegisterComponent();
+	brain->SetComponentTickEnabled(false);
+	controller->BrainComponent = brain;
+
+	for(int32 classIndex : BehaviorClasses)
+	{
+		UClass* behaviorClass = GetRecordedClass(classIndex);
+		if(behaviorClass && behaviorClass->IsChildOf(UNLBehavior::StaticClass()))
+		{
+			brain->AddBehavior(behaviorClass);
+		}
+	}
+
+	if(LogicWasStarted)
+	{
+		brain->StartLogic();
+	}
+	return brain;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLEventReplay::Deliver(UNextLifeBrainComponent& brain, const FNLRecordedEvent& recordedEvent,
+							 TFunctionRef<AActor*(int32, const FVector&)> resolveSubject) const
+{
+	AActor* subject = recordedEvent.Subject != INDEX_NONE ? resolveSubject(recordedEvent.Subject, recordedEvent.SubjectLocation) : nullptr;
+
+	switch(recordedEvent.Type)
+	{
+		case ENLRecordedEventType::StartLogic:
+			brain.StartLogic();
+			break;
+		case ENLRecordedEventType::StopLogic:
+			brain.StopLogic(TEXT("Replay"));
+			break;
+		case ENLRecordedEventType::PauseLogic:
+			brain.PauseLogic(TEXT("Replay"));
+			break;
+		case ENLRecordedEventType::ResumeLogic:
+			brain.ResumeLogic(TEXT("Replay"));
+			break;
+		case ENLRecordedEventType::AddBehavior:
+		case ENLRecordedEventType::RemoveBehavior:
+		{
+			UClass* behaviorClass = GetRecordedClass(recordedEvent.Class);
+			if(behaviorClass && behaviorClass->IsChildOf(UNLBehavior::StaticClass()))
+			{
+				if(recordedEvent.Type == ENLRecordedEventType::AddBehavior)
+				{
+					brain.AddBehavior(behaviorClass);
+				}
+				else
+				{
+					brain.RemoveBehavior(behaviorClass);
+				}
+			}
+			break;
+		}
+		case ENLRecordedEventType::GeneralMessage:
+		{
+			UClass* messageClass = GetRecordedClass(recordedEvent.Class);
+			if(messageClass && messageClass->IsChildOf(UNLGeneralMessage::StaticClass()))
+			{
+				UNLGeneralMessage* message = NewObject<UNLGeneralMessage>(GetTransientPackage(), messageClass);
+				LoadProperties(message, recordedEvent.MessageData);
+				brain.General_Message(message);
+			}
+			else if(recordedEvent.Class == INDEX_NONE)
+			{
+				brain.General_Message(nullptr);
+			}
+			break;
+		}
+		case ENLRecordedEventType::Sight:
+			brain.Sense_Sight(Cast<APawn>(subject), recordedEvent.Flags != 0);
+			break;
+		case ENLRecordedEventType::SightLost:
+			brain.Sense_SightLost(Cast<APawn>(subject));
+			break;
+		case ENLRecordedEventType::Sound:
+			brain.Sense_Sound(Cast<APawn>(subject), recordedEvent.Location, recordedEvent.Value, recordedEvent.Flags);
+			break;
+		case ENLRecordedEventType::Contact:
+		{
+			FHitResult hitResult;
+			hitResult.bBlockingHit = true;
+			hitResult.Location = hitResult.ImpactPoint = recordedEvent.Location;
+			hitResult.Normal = hitResult.ImpactNormal = recordedEvent.Normal;
+			hitResult.Actor = subject;
+			brain.Sense_Contact(subject, hitResult);
+			break;
+		}
+		case ENLRecordedEventType::MoveTo:
+			brain.Movement_MoveTo(subject, recordedEvent.Location, recordedEvent.Value);
+			break;
+		case ENLRecordedEventType::MoveToComplete:
+			brain.Movement_MoveToComplete(FAIRequestID(recordedEvent.RequestID), static_cast<EPathFollowingResult::Type>(recordedEvent.Result));
+			break;
+		default:
+			// Updates are run by the driver
+			break;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UClass* FNLEventReplay::GetPawnClass() const
+{
+	return PawnClass.IsEmpty() ? nullptr : LoadObject<UClass>(nullptr, *PawnClass);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UClass* FNLEventReplay::GetRecordedClass(int32 classIndex) const
+{
+	return Classes.IsValidIndex(classIndex) ? Classes[classIndex].Get() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+static void RecordEvents(const TArray<FString>& args, UWorld* world)
+{
+	const FString nameFilter = args.Num() > 0 ? args[0] : FString();
+
+	int32 brainCount = 0;
+	for(UNextLifeBrainComponent* brain : TObjectRange<UNextLifeBrainComponent>())
+	{
+		if(brain->GetWorld() == world && !brain->IsRecordingEvents() &&
+		   (nameFilter.IsEmpty() || brain->GetDebugName().Contains(nameFilter)))
+		{
+			brain->StartEventRecording();
+			++brainCount;
+		}
+	}
+	UE_LOG(LogNextLife, Log, TEXT("Recording events for %d brains, save them with NextLife.SaveEvents"), brainCount);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+static void SaveEvents(const TArray<FString>& args, UWorld* world)
+{
+	const FString nameFilter = args.Num() > 0 ? args[0] : FString();
+	const FString date = FDateTime::Now().ToString();
+
+	int32 brainCount = 0;
+	for(UNextLifeBrainComponent* brain : TObjectRange<UNextLifeBrainComponent>())
+	{
+		const FString brainName = brain->GetDebugName();
+		if(brain->GetWorld() != world || !brain->IsRecordingEvents() || (!nameFilter.IsEmpty() && !brainName.Contains(nameFilter)))
+		{
+			continue;
+		}
+
+		const FString path = FPaths::ProjectSavedDir() / TEXT("NextLife") / FString::Printf(TEXT("Events-%s-%s.nlev"), *brainName, *date);
+		if(brain->GetEventRecorder().WriteFile(path))
+		{
+			UE_LOG(LogNextLife, Log, TEXT("Wrote %d updates and %d events of '%s' to '%s'"), brain->GetEventRecorder().GetUpdateCount(),
+				   brain->GetEventRecorder().GetEventCount(), *brainName, *FPaths::ConvertRelativePathToFull(path));
+			++brainCount;
+		}
+		else
+		{
+			UE_LOG(LogNextLife, Error, TEXT("Couldn't write event recording '%s'"), *path);
+		}
+		brain->StopEventRecording();
+	}
+
+	if(brainCount == 0)
+	{
+		UE_LOG(LogNextLife, Warning, TEXT("No brains are recording events, enable RecordEvents, NextLife.RecordEventsOnStart or use NextLife.RecordEvents"));
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs RecordEventsCommand(
+	TEXT("NextLife.RecordEvents"),
+	TEXT("Starts recording the events and updates of brains. Optionally only brains whose pawn name contains the argument."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RecordEvents));
+
+static FAutoConsoleCommandWithWorldAndArgs SaveEventsCommand(
+	TEXT("NextLife.SaveEvents"),
+	TEXT("Writes the event recordings of brains to Saved/NextLife and stops recording. Replay them with the NLReplayEvents commandlet. Optionally only brains whose pawn name contains the argument."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SaveEvents));
@@ -0,0 +1,404 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NLNativeAction.h"
+#include "NextLifeModule.h"
+#include "NLBehavior.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UClass* NLGetNativeActionHostClass()
+{
+	return UNLNativeActionHost::StaticClass();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLNativeActionArena::FNLNativeActionArena()
+	: PageCursor(nullptr)
+	, PageEnd(nullptr)
+	, LiveCount(0)
+{
+	FMemory::Memzero(FreeLists);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLNativeActionArena::~FNLNativeActionArena()
+{
+	ensureMsgf(LiveCount == 0, TEXT("%d native actions were not destroyed before their arena"), LiveCount);
+
+	for(uint8* page : Pages)
+	{
+		FMemory::Free(page);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLNativeAction* FNLNativeActionArena::Construct(const FNLNativeActionType* nativeType)
+{
+	check(nativeType);
+
+	FNLNativeAction* nativeAction = nativeType->Construct(Allocate(nativeType->Size, nativeType->Alignment));
+	nativeAction->NativeType = nativeType;
+	++LiveCount;
+	return nativeAction;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLNativeActionArena::Destroy(FNLNativeAction* nativeAction)
+{
+	check(nativeAction);
+
+	// Native actions have no other base class, the action is at the start of its memory
+	const FNLNativeActionType* nativeType = nativeAction->NativeType;
+	nativeAction->~FNLNativeAction();
+	Free(nativeAction, nativeType->Size, nativeType->Alignment);
+	--LiveCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void* FNLNativeActionArena::Allocate(uint32 size, uint32 alignment)
+{
+	const uint32 sizeClass = GetSizeClass(size);
+	if(sizeClass >= NumSizeClasses || alignment > BlockAlignment)
+	{
+		return FMemory::Malloc(size, alignment);
+	}
+
+	if(FFreeBlock* freeBlock = FreeLists[sizeClass])
+	{
+		FreeLists[sizeClass] = freeBlock->Next;
+		return freeBlock;
+	}
+
+	// The rest of a page which is too small for the block is left unused
+	const uint32 blockSize = (sizeClass + 1) * BlockAlignment;
+	if(static_cast<uint32>(PageEnd - PageCursor) < blockSize)
+	{
+		uint8* page = static_cast<uint8*>(FMemory::Malloc(PageSize, BlockAlignment));
+		Pages.Add(page);
+		PageCursor = page;
+		PageEnd = page + PageSize;
+	}
+
+	void* block = PageCursor;
+	PageCursor += blockSize;
+	return block;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLNativeActionArena::Free(void* memory, uint32 size, uint32 alignment)
+{
+	const uint32 sizeClass = GetSizeClass(size);
+	if(sizeClass >= NumSizeClasses || alignment > BlockAlignment)
+	{
+		FMemory::Free(memory);
+		return;
+	}
+
+	FFreeBlock* freeBlock = static_cast<FFreeBlock*>(memory);
+	freeBlock->Next = FreeLists[sizeClass];
+	FreeLists[sizeClass] = freeBlock;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLNativeAction::FNLNativeAction()
+	: UpdateIsThreadSafe(false)
+	, HandledEvents(ENLNativeEventSets::NONE)
+	, NativeType(nullptr)
+	, Host(nullptr)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FString FNLNativeAction::GetShortDescription() const
+{
+	return NativeType ? FString(NativeType->Name) : FString();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLNativeAction* FNLNativeAction::Get(const UNLAction* action)
+{
+	const UNLNativeActionHost* host = Cast<const UNLNativeActionHost>(action);
+	return host ? host->GetNativeAction() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+APawn* FNLNativeAction::GetPawnOwner() const
+{
+	return Host ? Host->GetPawnOwner() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+AAIController* FNLNativeAction::GetAIOwner() const
+{
+	return Host ? Host->GetAIOwner() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLBehavior* FNLNativeAction::GetBehavior() const
+{
+	return Host ? Host->GetBehavior() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+float FNLNativeAction::GetWorldTimeSeconds() const
+{
+	return Host ? Host->GetWorldTimeSeconds() : -1.0f;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UBlackboardComponent* FNLNativeAction::GetBlackboard() const
+{
+	return Host ? Host->GetBlackboard() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLNativeAction::IsTopAction() const
+{
+	return Host && Host->IsTopAction();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLNativeAction::OnRequestEvent(const FNLEventResponse& eventRequested, UNLAction* requester)
+{
+	// The same default as UNLAction::OnRequestEvent
+	return eventRequested.Priority > ENLEventRequestPriority::TRY && eventRequested.IsNonDestructive(requester->GetNextAction() == nullptr);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNLNativeActionHost::UNLNativeActionHost()
+	: NativeAction(nullptr)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FString UNLNativeActionHost::GetShortDescription() const
+{
+	return NativeAction ? NativeAction->GetShortDescription() : Super::GetShortDescription();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLNativeActionHost::ListensTo(const UClass* eventInterface) const
+{
+	if(!NativeAction)
+	{
+		return false;
+	}
+
+	if(eventInterface == UNLGeneralEvents::StaticClass())
+	{
+		return EnumHasAnyFlags(NativeAction->HandledEvents, ENLNativeEventSets::GENERAL);
+	}
+	if(eventInterface == UNLSensingEvents::StaticClass())
+	{
+		return EnumHasAnyFlags(NativeAction->HandledEvents, ENLNativeEventSets::SENSING);
+	}
+	if(eventInterface == UNLMovementEvents::StaticClass())
+	{
+		return EnumHasAnyFlags(NativeAction->HandledEvents, ENLNativeEventSets::MOVEMENT);
+	}
+	return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLNativeActionHost::BindNativeAction(FNLNativeAction* nativeAction)
+{
+	checkf(!NativeAction, TEXT("Binding a native action to a host which is already running one"));
+
+	NativeAction = nativeAction;
+	NativeAction->Host = this;
+	UpdateIsThreadSafe = NativeAction->UpdateIsThreadSafe;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLNativeActionHost::DestroyNativeAction(FNLNativeActionArena& arena)
+{
+	if(NativeAction)
+	{
+		arena.Destroy(NativeAction);
+		NativeAction = nullptr;
+	}
+	UpdateIsThreadSafe = false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLNativeActionHost::OnStart_Implementation(UNLActionPayload* payload)
+{
+	if(!NativeAction)
+	{
+		// Restored from a save game or started without a native action type
+		return Done(TEXT("No native action"));
+	}
+	return NativeAction->OnStart(payload);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLNativeActionHost::OnUpdate_Implementation(const float deltaSeconds)
+{
+	if(!NativeAction)
+	{
+		return Done(TEXT("No native action"));
+	}
+	return NativeAction->OnUpdate(deltaSeconds);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLNativeActionHost::OnDone_Implementation(const UNLAction* nextAction)
+{
+	if(NativeAction)
+	{
+		NativeAction->OnDone(nextAction);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLNativeActionHost::OnSuspend_Implementation(const UNLAction* interruptingAction)
+{
+	return NativeAction ? NativeAction->OnSuspend(interruptingAction) : false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLActionResult UNLNativeActionHost::OnResume_Implementation(const UNLAction* resumedFromAction)
+{
+	if(!NativeAction)
+	{
+		return Done(TEXT("No native action"));
+	}
+	return NativeAction->OnResume(resumedFromAction);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLNativeActionHost::OnRequestEvent_Implementation(const FNLEventResponse& eventRequested, UNLAction* requester)
+{
+	return NativeAction ? NativeAction->OnRequestEvent(eventRequested, requester) : Super::OnRequestEvent_Implementation(eventRequested, requester);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNLNativeActionHost::OnRequestTakeover_Implementation(const FNLEventResponse& eventRequested, UNLAction* requester, bool& keepChildActions)
+{
+	// A request for another native type isn't for this action, even though it names the same host class
+	return NativeAction && NativeAction->GetNativeType() == eventRequested.NativeType && NativeAction->OnRequestTakeover(eventRequested, requester, keepChildActions);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNLNativeActionHost::OnReset_Implementation()
+{
+	// Hosts have no state of their own, the native action was destroyed when it was done
+	checkf(!NativeAction, TEXT("Resetting a native action host which is still running a native action"));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::General_Message_Implementation(UNLGeneralMessage* message)
+{
+	return NativeAction ? NativeAction->General_Message(message) : FNLEventResponse();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::Sense_Sight_Implementation(APawn* subject, bool indirect)
+{
+	return NativeAction ? NativeAction->Sense_Sight(subject, indirect) : FNLEventResponse();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::Sense_SightLost_Implementation(APawn* subject)
+{
+	return NativeAction ? NativeAction->Sense_SightLost(subject) : FNLEventResponse();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::Sense_Sound_Implementation(APawn* otherActor, const FVector& location, float volume, int32 flags)
+{
+	return NativeAction ? NativeAction->Sense_Sound(otherActor, location, volume, flags) : FNLEventResponse();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::Sense_Contact_Implementation(AActor* other, const FHitResult& hitResult)
+{
+	return NativeAction ? NativeAction->Sense_Contact(other, hitResult) : FNLEventResponse();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::Movement_MoveTo_Implementation(const AActor* goal, const FVector& pos, float range)
+{
+	return NativeAction ? NativeAction->Movement_MoveTo(goal, pos, range) : FNLEventResponse();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLEventResponse UNLNativeActionHost::Movement_MoveToComplete_Implementation(FAIRequestID requestID, const EPathFollowingResult::Type result)
+{
+	return NativeAction ? NativeAction->Movement_MoveToComplete(requestID, result) : FNLEventResponse();
+}
@@ -0,0 +1,84 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NLTrace.h"
+#include "NextLifeModule.h"
+#include "Misc/ScopeRWLock.h"
+
+#if NEXTLIFE_TRACE_ENABLED
+
+UE_TRACE_CHANNEL_DEFINE(NextLifeChannel);
+
+namespace
+{
+	// A label and class pair which has a CPU event type
+	struct FNLTraceEventKey
+	{
+		const TCHAR* Label;
+		const UClass* Class;
+
+		bool operator==(const FNLTraceEventKey& other) const
+		{
+			return Label == other.Label && Class == other.Class;
+		}
+
+		friend uint32 GetTypeHash(const FNLTraceEventKey& key)
+		{
+			return HashCombine(PointerHash(key.Label), PointerHash(key.Class));
+		}
+	};
+
+	// Scopes can be entered off the game thread by parallel action updates
+	FRWLock EventTypeLock;
+	TMap<FNLTraceEventKey, uint32> EventTypes;
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	uint32 GetEventType(const TCHAR* label, const UClass* objectClass)
+	{
+		const FNLTraceEventKey key{label, objectClass};
+		{
+			FReadScopeLock readLock(EventTypeLock);
+			if(const uint32* eventType = EventTypes.Find(key))
+			{
+				return *eventType;
+			}
+		}
+
+		FWriteScopeLock writeLock(EventTypeLock);
+		if(const uint32* eventType = EventTypes.Find(key))
+		{
+			return *eventType;
+		}
+
+		const FString eventName = FString::Printf(TEXT("NextLife %s %s"), label, *objectClass->GetName());
+		const uint32 eventType = FCpuProfilerTrace::OutputEventType(*eventName);
+		EventTypes.Add(key, eventType);
+		return eventType;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLTraceScope::FNLTraceScope(const TCHAR* label, const UObject* object)
+	: IsActive(object && UE_TRACE_CHANNELEXPR_IS_ENABLED(NextLifeChannel) && UE_TRACE_CHANNELEXPR_IS_ENABLED(CpuChannel))
+{
+	if(IsActive)
+	{
+		FCpuProfilerTrace::OutputBeginEvent(GetEventType(label, object->GetClass()));
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLTraceScope::~FNLTraceScope()
+{
+	if(IsActive)
+	{
+		FCpuProfilerTrace::OutputEndEvent();
+	}
+}
+
+#endif
@@ -0,0 +1,426 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NLTransitionRecorder.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/WeakObjectPtr.h"
+#include "UObject/UObjectIterator.h"
+
+namespace
+{
+	// "NLTR"
+	const uint32 TransitionFileMagic = 0x52544C4E;
+	const uint32 TransitionFileVersion = 1;
+
+	// A recorded class and its id
+	struct FClassIdEntry
+	{
+		// Tells if the class was collected, its pointer could be reused by another class
+		TWeakObjectPtr<const UClass> Class;
+		uint16 Id;
+	};
+
+	// Recorded class ids. Id 0 is no class.
+	TMap<const UClass*, FClassIdEntry> ClassIds;
+	TArray<FString> ClassNames = { TEXT("None") };
+
+	const TCHAR* RecordTypeNames[] =
+	{
+		TEXT("BEGIN"),
+		TEXT("STOP"),
+		TEXT("CHANGE"),
+		TEXT("SUSPEND"),
+		TEXT("DONE"),
+		TEXT("TAKEOVER"),
+		TEXT("REQUEST ACCEPTED"),
+		TEXT("EVENT STORED"),
+		TEXT("EVENT OVERRODE"),
+		TEXT("EVENT IGNORED"),
+		TEXT("EVENT COLLISION"),
+		TEXT("DEFERRED"),
+	};
+	static_assert(UE_ARRAY_COUNT(RecordTypeNames) == static_cast<int32>(ENLTransitionRecordType::Count), "Missing transition record type names");
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	int32 AddName(FName name, TMap<FName, int32>& nameIndices, TArray<FString>& names)
+	{
+		if(const int32* nameIndex = nameIndices.Find(name))
+		{
+			return *nameIndex;
+		}
+		names.Add(name.ToString());
+		return nameIndices.Add(name, names.Num() - 1);
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	const FString& GetTableEntry(const TArray<FString>& table, int32 index)
+	{
+		static const FString unknown(TEXT("?"));
+		return table.IsValidIndex(index) ? table[index] : unknown;
+	}
+
+	//-----------------------------------------------------------------------------------------------------------------
+	/**
+	*/
+	void SetStackDepth(TArray<FString>& stack, int32 topDepth)
+	{
+		// Actions pushed before the oldest record are unknown
+		const int32 oldNum = stack.Num();
+		stack.SetNum(topDepth + 1);
+		for(int32 stackIndex = oldNum; stackIndex < stack.Num(); ++stackIndex)
+		{
+			stack[stackIndex] = TEXT("?");
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLTransitionRecorder::FNLTransitionRecorder()
+	: Head(0)
+	, TotalRecorded(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLTransitionRecorder::SetCapacity(int32 capacity)
+{
+	Records.Reset();
+	Records.SetNumZeroed(FMath::Max(capacity, 0));
+	Head = 0;
+	TotalRecorded = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLTransitionRecorder::Reset()
+{
+	SetCapacity(Records.Num());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLTransitionRecorder::GetRecords(TArray<FNLTransitionRecord>& recordsOut) const
+{
+	recordsOut.Reset();
+	if(TotalRecorded < Records.Num())
+	{
+		recordsOut.Append(Records.GetData(), static_cast<int32>(TotalRecorded));
+	}
+	else
+	{
+		// Full, the oldest record is at the head
+		recordsOut.Append(Records.GetData() + Head, Records.Num() - Head);
+		recordsOut.Append(Records.GetData(), Head);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+uint16 FNLTransitionRecorder::GetClassId(const UClass* recordedClass)
+{
+	if(!recordedClass)
+	{
+		return NoClass;
+	}
+
+	FClassIdEntry* entry = ClassIds.Find(recordedClass);
+	if(entry && entry->Class.Get() == recordedClass)
+	{
+		return entry->Id;
+	}
+
+	if(ClassNames.Num() > MAX_uint16)
+	{
+		return NoClass;
+	}
+
+	// A new class, or one created where a collected class was. Records of the collected class keep its id and name.
+	if(!entry)
+	{
+		entry = &ClassIds.Add(recordedClass);
+	}
+	ClassNames.Add(recordedClass->GetName());
+	entry->Class = recordedClass;
+	entry->Id = static_cast<uint16>(ClassNames.Num() - 1);
+	return entry->Id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FString FNLTransitionRecorder::GetClassName(uint16 classId)
+{
+	return GetTableEntry(ClassNames, classId);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLTransitionRecorder::WriteFile(const FString& path, const TArray<TPair<FString, const FNLTransitionRecorder*>>& histories)
+{
+	// Names are written once in a table and referenced by index
+	TMap<FName, int32> nameIndices;
+	TArray<FString> names;
+
+	TArray<uint8> recordData;
+	FMemoryWriter recordWriter(recordData);
+
+	int32 historyCount = histories.Num();
+	recordWriter << historyCount;
+
+	TArray<FNLTransitionRecord> records;
+	for(const TPair<FString, const FNLTransitionRecorder*>& history : histories)
+	{
+		check(history.Value);
+		history.Value->GetRecords(records);
+
+		FString historyName = history.Key;
+		int64 totalRecorded = history.Value->GetTotalRecorded();
+		int32 recordCount = records.Num();
+		recordWriter << historyName << totalRecorded << recordCount;
+
+		for(FNLTransitionRecord& record : records)
+		{
+			int32 eventNameIndex = AddName(record.EventName, nameIndices, names);
+			int32 reasonIndex = AddName(record.Reason, nameIndices, names);
+			uint8 type = static_cast<uint8>(record.Type);
+			uint8 change = static_cast<uint8>(record.Change);
+			uint8 priority = static_cast<uint8>(record.Priority);
+
+			recordWriter << record.Time << record.Frame << eventNameIndex << reasonIndex;
+			recordWriter << record.BehaviorClass << record.FromClass << record.ToClass << record.StackDepth;
+			recordWriter << type << change << priority;
+		}
+	}
+
+	TArray<uint8> fileData;
+	FMemoryWriter fileWriter(fileData);
+
+	uint32 magic = TransitionFileMagic;
+	uint32 version = TransitionFileVersion;
+	fileWriter << magic << version;
+	fileWriter << ClassNames;
+	fileWriter << names;
+	fileWriter.Serialize(recordData.GetData(), recordData.Num());
+
+	return FFileHelper::SaveArrayToFile(fileData, *path);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLTransitionRecorder::DecodeFile(const FString& path, FString& decodedOut)
+{
+	TArray<uint8> fileData;
+	if(!FFileHelper::LoadFileToArray(fileData, *path))
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Couldn't read transition history '%s'"), *path);
+		return false;
+	}
+
+	FMemoryReader reader(fileData);
+
+	uint32 magic = 0;
+	uint32 version = 0;
+	reader << magic << version;
+	if(magic != TransitionFileMagic || version != TransitionFileVersion)
+	{
+		UE_LOG(LogNextLife, Error, TEXT("'%s' isn't a version %u transition history"), *path, TransitionFileVersion);
+		return false;
+	}
+
+	TArray<FString> classNames;
+	TArray<FString> names;
+	int32 historyCount = 0;
+	reader << classNames << names << historyCount;
+
+	for(int32 historyIndex = 0; historyIndex < historyCount && !reader.IsError(); ++historyIndex)
+	{
+		FString historyName;
+		int64 totalRecorded = 0;
+		int32 recordCount = 0;
+		reader << historyName << totalRecorded << recordCount;
+
+		decodedOut += FString::Printf(TEXT("%s: %d records"), *historyName, recordCount);
+		if(totalRecorded > recordCount)
+		{
+			decodedOut += FString::Printf(TEXT(", %lld older records were overwritten"), totalRecorded - recordCount);
+		}
+		decodedOut += LINE_TERMINATOR;
+
+		// Rebuild the action stack of each behavior as records are replayed
+		TMap<uint16, TArray<FString>> stacks;
+		for(int32 recordIndex = 0; recordIndex < recordCount && !reader.IsError(); ++recordIndex)
+		{
+			FNLTransitionRecord record;
+			int32 eventNameIndex = 0;
+			int32 reasonIndex = 0;
+			uint8 type = 0;
+			uint8 change = 0;
+			uint8 priority = 0;
+
+			reader << record.Time << record.Frame << eventNameIndex << reasonIndex;
+			reader << record.BehaviorClass << record.FromClass << record.ToClass << record.StackDepth;
+			reader << type << change << priority;
+
+			if(type >= static_cast<uint8>(ENLTransitionRecordType::Count))
+			{
+				UE_LOG(LogNextLife, Error, TEXT("'%s' has an unknown record type %u"), *path, type);
+				return false;
+			}
+
+			const FString& behaviorName = GetTableEntry(classNames, record.BehaviorClass);
+			const FString& fromName = GetTableEntry(classNames, record.FromClass);
+			const FString& toName = GetTableEntry(classNames, record.ToClass);
+			const FString& eventName = GetTableEntry(names, eventNameIndex);
+			const FString& reason = GetTableEntry(names, reasonIndex);
+
+			TArray<FString>& stack = stacks.FindOrAdd(record.BehaviorClass);
+			record.Type = static_cast<ENLTransitionRecordType>(type);
+			switch(record.Type)
+			{
+				case ENLTransitionRecordType::BehaviorBegin:
+					stack.Reset();
+					stack.Add(toName);
+					break;
+				case ENLTransitionRecordType::BehaviorStop:
+					stack.Reset();
+					break;
+				case ENLTransitionRecordType::Change:
+				case ENLTransitionRecordType::Suspend:
+				case ENLTransitionRecordType::Done:
+				case ENLTransitionRecordType::Takeover:
+				case ENLTransitionRecordType::RequestAccepted:
+					if(record.StackDepth < 0)
+					{
+						stack.Reset();
+					}
+					else
+					{
+						SetStackDepth(stack, record.StackDepth);
+						stack[record.StackDepth] = toName;
+					}
+					break;
+				default:
+					// Events and deferrals don't change the stack
+					break;
+			}
+
+			FString details;
+			if(record.Type >= ENLTransitionRecordType::EventStored && record.Type <= ENLTransitionRecordType::EventCollision)
+			{
+				details = FString::Printf(TEXT("'%s' %s -> %s %s (%s)"), *eventName, *fromName,
+										  *UEnum::GetValueAsString(static_cast<ENLActionChangeType>(change)), *toName,
+										  *UEnum::GetValueAsString(static_cast<ENLEventRequestPriority>(priority)));
+			}
+			else
+			{
+				details = FString::Printf(TEXT("%s -> %s"), *fromName, *toName);
+			}
+
+			decodedOut += FString::Printf(TEXT("  [%u %.3fs] %s %s %s"), record.Frame, record.Time, *behaviorName,
+										  RecordTypeNames[type], *details);
+			if(names.IsValidIndex(reasonIndex) && reason != TEXT("None"))
+			{
+				decodedOut += FString::Printf(TEXT(" : %s"), *reason);
+			}
+			decodedOut += FString::Printf(TEXT(" | %s"), *FString::Join(stack, TEXT(" > ")));
+			decodedOut += LINE_TERMINATOR;
+		}
+		decodedOut += LINE_TERMINATOR;
+	}
+
+	if(reader.IsError())
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Transition history '%s' is truncated"), *path);
+		return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+static void DumpTransitions(const TArray<FString>& args, UWorld* world)
+{
+	const FString nameFilter = args.Num() > 0 ? args[0] : FString();
+
+	TArray<TPair<FString, const FNLTransitionRecorder*>> histories;
+	for(UNextLifeBrainComponent* brain : TObjectRange<UNextLifeBrainComponent>())
+	{
+		const FNLTransitionRecorder* recorder = brain->GetTransitionRecorder();
+		if(!recorder || brain->GetWorld() != world)
+		{
+			continue;
+		}
+
+		const FString brainName = brain->GetDebugName();
+		if(nameFilter.IsEmpty() || brainName.Contains(nameFilter))
+		{
+			histories.Emplace(brainName, recorder);
+		}
+	}
+
+	if(histories.Num() == 0)
+	{
+		UE_LOG(LogNextLife, Warning, TEXT("No brains are recording transitions, enable RecordTransitionHistory or NextLife.RecordTransitions"));
+		return;
+	}
+
+	const FString path = FPaths::ProjectSavedDir() / TEXT("NextLife") / FString::Printf(TEXT("Transitions-%s.nltr"), *FDateTime::Now().ToString());
+	if(FNLTransitionRecorder::WriteFile(path, histories))
+	{
+		UE_LOG(LogNextLife, Log, TEXT("Wrote the transition history of %d brains to '%s'"), histories.Num(), *FPaths::ConvertRelativePathToFull(path));
+	}
+	else
+	{
+		UE_LOG(LogNextLife, Error, TEXT("Couldn't write transition history '%s'"), *path);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+static void DecodeTransitions(const TArray<FString>& args)
+{
+	if(args.Num() == 0)
+	{
+		UE_LOG(LogNextLife, Warning, TEXT("Usage: NextLife.DecodeTransitions <file.nltr>"));
+		return;
+	}
+
+	FString decoded;
+	if(FNLTransitionRecorder::DecodeFile(args[0], decoded))
+	{
+		const FString outputPath = FPaths::ChangeExtension(args[0], TEXT("txt"));
+		FFileHelper::SaveStringToFile(decoded, *outputPath);
+		UE_LOG(LogNextLife, Log, TEXT("Decoded transition history to '%s'"), *outputPath);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs DumpTransitionsCommand(
+	TEXT("NextLife.DumpTransitions"),
+	TEXT("Writes the transition history of recording brains to Saved/NextLife. Optionally only brains whose pawn name contains the argument."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&DumpTransitions));
+
+static FAutoConsoleCommand DecodeTransitionsCommand(
+	TEXT("NextLife.DecodeTransitions"),
+	TEXT("Decodes a transition history written by NextLife.DumpTransitions into a readable text file next to it."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&DecodeTransitions));
@@ -0,0 +1,205 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NLTypes.h"
+#include "NextLifeModule.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLStructPayload::FNLStructPayload(const FNLStructPayload& other)
+	: ScriptStruct(nullptr)
+	, HeapMemory(nullptr)
+{
+	InitializeAs(other.ScriptStruct, other.ScriptStruct ? other.GetMemory() : nullptr);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLStructPayload::FNLStructPayload(FNLStructPayload&& other)
+	: ScriptStruct(nullptr)
+	, HeapMemory(nullptr)
+{
+	RelocateFrom(other);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLStructPayload& FNLStructPayload::operator=(const FNLStructPayload& other)
+{
+	if(this != &other)
+	{
+		InitializeAs(other.ScriptStruct, other.ScriptStruct ? other.GetMemory() : nullptr);
+	}
+	return *this;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FNLStructPayload& FNLStructPayload::operator=(FNLStructPayload&& other)
+{
+	if(this != &other)
+	{
+		Reset();
+		RelocateFrom(other);
+	}
+	return *this;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLStructPayload::RelocateFrom(FNLStructPayload& other)
+{
+	check(!ScriptStruct && !HeapMemory);
+
+	ScriptStruct = other.ScriptStruct;
+	if(other.HeapMemory)
+	{
+		// Steal the allocation
+		HeapMemory = other.HeapMemory;
+		other.HeapMemory = nullptr;
+	}
+	else if(ScriptStruct)
+	{
+		// UE types are bitwise relocatable, the inline value is moved without copying what it owns. The source no
+		// longer owns it, so it isn't destroyed there.
+		FMemory::Memcpy(&InlineMemory, &other.InlineMemory, ScriptStruct->GetStructureSize());
+	}
+	other.ScriptStruct = nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLStructPayload::FitsInline(const UScriptStruct* scriptStruct)
+{
+	return scriptStruct->GetStructureSize() <= InlineSize && scriptStruct->GetMinAlignment() <= InlineAlignment;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+uint8* FNLStructPayload::AllocateMemory()
+{
+	check(ScriptStruct && !HeapMemory);
+
+	if(!FitsInline(ScriptStruct))
+	{
+		HeapMemory = static_cast<uint8*>(FMemory::Malloc(ScriptStruct->GetStructureSize(), ScriptStruct->GetMinAlignment()));
+	}
+	return GetMemory();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLStructPayload::InitializeAs(const UScriptStruct* scriptStruct, const uint8* structMemory)
+{
+	if(scriptStruct && scriptStruct == ScriptStruct)
+	{
+		// Same type, copy over the existing value
+		if(structMemory)
+		{
+			ScriptStruct->CopyScriptStruct(GetMemory(), structMemory);
+		}
+		else
+		{
+			ScriptStruct->ClearScriptStruct(GetMemory());
+		}
+		return;
+	}
+
+	Reset();
+
+	if(!scriptStruct)
+	{
+		return;
+	}
+
+	ScriptStruct = scriptStruct;
+	uint8* memory = AllocateMemory();
+	ScriptStruct->InitializeStruct(memory);
+	if(structMemory)
+	{
+		ScriptStruct->CopyScriptStruct(memory, structMemory);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLStructPayload::Reset()
+{
+	if(ScriptStruct)
+	{
+		ScriptStruct->DestroyStruct(GetMemory());
+		ScriptStruct = nullptr;
+	}
+
+	if(HeapMemory)
+	{
+		FMemory::Free(HeapMemory);
+		HeapMemory = nullptr;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLStructPayload::Serialize(FArchive& ar)
+{
+	UObject* structObject = const_cast<UScriptStruct*>(ScriptStruct);
+	ar << structObject;
+
+	if(ar.IsLoading())
+	{
+		InitializeAs(Cast<UScriptStruct>(structObject));
+	}
+
+	if(ScriptStruct)
+	{
+		const_cast<UScriptStruct*>(ScriptStruct)->SerializeItem(ar, GetMemory(), nullptr);
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNLStructPayload::AddStructReferencedObjects(FReferenceCollector& collector)
+{
+	if(!ScriptStruct)
+	{
+		return;
+	}
+
+	collector.AddReferencedObject(ScriptStruct);
+
+	// Any objects the held value references
+	if(ScriptStruct)
+	{
+		FVerySlowReferenceCollectorArchiveScope collectorScope(collector.GetVerySlowReferenceCollectorArchive(), ScriptStruct);
+		const_cast<UScriptStruct*>(ScriptStruct)->SerializeBin(collectorScope.GetArchive(), GetMemory());
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool FNLStructPayload::Identical(const FNLStructPayload* other, uint32 portFlags) const
+{
+	if(!other || ScriptStruct != other->ScriptStruct)
+	{
+		return false;
+	}
+
+	if(!ScriptStruct)
+	{
+		return true;
+	}
+
+	return ScriptStruct->CompareScriptStruct(GetMemory(), other->GetMemory(), portFlags);
+}
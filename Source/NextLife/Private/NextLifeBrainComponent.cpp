@@ -3,16 +3,61 @@
 #include "NextLifeBrainComponent.h"
 #include "NextLifeModule.h"
 #include "NLBehavior.h"
+#include "NextLifeTickManager.h"
+#include "NLTrace.h"
 
 #include "AIController.h"
 
+DECLARE_CYCLE_STAT(TEXT("Brain Tick"), STAT_NextLife_BrainTick, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Choose Behaviors"), STAT_NextLife_ChooseBehaviors, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Deliver Sensing Events"), STAT_NextLife_DeliverSensingEvents, STATGROUP_NextLife);
+
+static TAutoConsoleVariable<int32> CVarNextLifeRecordTransitions(
+	TEXT("NextLife.RecordTransitions"),
+	0,
+	TEXT("If non zero, every brain records its transition history when its logic starts, as if RecordTransitionHistory was set."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNextLifeRecordEventsOnStart(
+	TEXT("NextLife.RecordEventsOnStart"),
+	0,
+	TEXT("If non zero, every brain records its events when its logic starts, as if RecordEvents was set."),
+	ECVF_Default);
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
 UNextLifeBrainComponent::UNextLifeBrainComponent()
 	: LogState(false)
+	, RecordTransitionHistory(false)
+	, TransitionHistorySize(256)
+	, RecordEvents(false)
+	, MaxTransitionsPerFrame(64)
+	, QueueSensingEvents(false)
+	, SightFlickerInterval(0.0f)
+	, UseTickManager(false)
+	, SelectionReevaluationInterval(0.0f)
+	, SchedulingPriority(0)
+	, SelectionIsDirty(true)
+	, LastSelectionTime(0.0f)
+	, IsObservingBlackboard(false)
 	, AreBehaviorsPaused(false)
 	, LogicIsStarted(false)
+	, IsRegisteredWithTickManager(false)
+	, CurrentLODTier(INDEX_NONE)
+	, LODElapsedTime(0.0f)
+	, LODTimeUntilUpdate(0.0f)
+	, LODPhase(0.0f)
+	, LODDeferredTime(0.0f)
+	, IsLODUpdateDeferred(false)
+	, SensingEventsReceived(0)
+	, SensingEventsCoalesced(0)
+	, SensingEventsDelivered(0)
+	, TransitionFrame(0)
+	, TransitionsThisFrame(0)
+	, PeakTransitionsPerFrame(0)
+	, LongestTransitionChain(0)
+	, TransitionDeferrals(0)
 {
 }
 
@@ -21,12 +66,16 @@ UNextLifeBrainComponent::UNextLifeBrainComponent()
 */
 bool UNextLifeBrainComponent::AddBehavior(TSubclassOf<UNLBehavior> behaviorClass)
 {
-	if(!ActiveBehaviorClasses.Contains(behaviorClass))
+	if(!BehaviorIndexByClass.Contains(behaviorClass))
 	{
 		UNLBehavior* newBehavior = NewObject<UNLBehavior>(this, behaviorClass);
-		Behaviors.Add(newBehavior);
-		ActiveBehaviorClasses.Add(behaviorClass);
+		BehaviorIndexByClass.Add(behaviorClass, Behaviors.Add(newBehavior));
 		newBehavior->OnBehaviorEnded.AddDynamic(this, &UNextLifeBrainComponent::OnBehaviorComplete);
+		if(EventRecorder.IsRecording())
+		{
+			EventRecorder.RecordBehavior(ENLRecordedEventType::AddBehavior, behaviorClass);
+		}
+		InvalidateBehaviorSelection();
 		return true;
 	}
 
@@ -38,17 +87,18 @@ bool UNextLifeBrainComponent::AddBehavior(TSubclassOf<UNLBehavior> behaviorClass
 */
 bool UNextLifeBrainComponent::RemoveBehavior(TSubclassOf<UNLBehavior> behaviorClass)
 {
-	const int32 classIndex = ActiveBehaviorClasses.Find(behaviorClass);
-	if(classIndex != INDEX_NONE)
+	UNLBehavior* behavior = RemoveBehaviorOfClass(behaviorClass);
+	if(behavior)
 	{
-		ActiveBehaviorClasses.RemoveAt(classIndex);
-		check(Behaviors.IsValidIndex(classIndex));
-		check(Behaviors[classIndex]);
+		if(EventRecorder.IsRecording())
+		{
+			EventRecorder.RecordBehavior(ENLRecordedEventType::RemoveBehavior, behaviorClass);
+		}
 		if(LogicIsStarted)
 		{
-			Behaviors[classIndex]->StopBehavior(true);
+			behavior->StopBehavior(true);
 		}
-		Behaviors.RemoveAt(classIndex);
+		InvalidateBehaviorSelection();
 		return true;
 	}
 
@@ -58,19 +108,78 @@ bool UNextLifeBrainComponent::RemoveBehavior(TSubclassOf<UNLBehavior> behaviorCl
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
-void UNextLifeBrainComponent::ChooseBehaviors(TArray<int32>& behaviorsOut)
+UNLBehavior* UNextLifeBrainComponent::RemoveBehaviorOfClass(const UClass* behaviorClass)
 {
-	int32 behaviorIndex = 0;
-	for(UNLBehavior*& behavior : Behaviors)
+	int32 behaviorIndex = INDEX_NONE;
+	if(!BehaviorIndexByClass.RemoveAndCopyValue(behaviorClass, behaviorIndex))
+	{
+		return nullptr;
+	}
+
+	UNLBehavior* behavior = Behaviors[behaviorIndex];
+	Behaviors.RemoveAt(behaviorIndex);
+
+	// Keep the order behaviors were added in, shifting down the indices of the ones after
+	for(int32 shiftedIndex = behaviorIndex; shiftedIndex < Behaviors.Num(); ++shiftedIndex)
+	{
+		BehaviorIndexByClass.FindChecked(Behaviors[shiftedIndex]->GetClass()) = shiftedIndex;
+	}
+	return behavior;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::ChooseBehaviors()
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_ChooseBehaviors);
+
+	SelectionIsDirty = false;
+	const UWorld* world = GetWorld();
+	LastSelectionTime = world ? world->GetTimeSeconds() : 0.0f;
+
+	ChosenBehaviors.Init(false, Behaviors.Num());
+	for(int32 behaviorIndex = 0; behaviorIndex < Behaviors.Num() && behaviorIndex < ChosenBehaviors.Num(); ++behaviorIndex)
+	{
+		check(Behaviors[behaviorIndex]);
+		ChosenBehaviors[behaviorIndex] = ShouldChooseBehavior(Behaviors[behaviorIndex]);
+	}
+
+	// Stop any behaviors which shouldn't be running right now. ShouldChooseBehavior or a stopping behavior could have
+	// changed the behaviors, the next update will choose again.
+	for(int32 behaviorIndex = FMath::Min(Behaviors.Num(), ChosenBehaviors.Num()) - 1; behaviorIndex >= 0; --behaviorIndex)
 	{
-		if(ShouldChooseBehavior(behavior))
+		// If behavior was running, we should reset it
+		if(!ChosenBehaviors[behaviorIndex] && Behaviors[behaviorIndex]->HasBehaviorBegun())
 		{
-			behaviorsOut.Add(behaviorIndex);
+			Behaviors[behaviorIndex]->StopBehavior(false);
 		}
-		++behaviorIndex;
 	}
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNextLifeBrainComponent::ShouldChooseBehavior_Implementation(UNLBehavior* behaviorToAssess)
+{
+	return !behaviorToAssess->LowPriority || !IsSchedulerOverloaded();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNextLifeBrainComponent::IsSchedulerOverloaded() const
+{
+	if(!IsRegisteredWithTickManager)
+	{
+		return false;
+	}
+
+	const UWorld* world = GetWorld();
+	const UNextLifeTickManager* tickManager = world ? world->GetSubsystem<UNextLifeTickManager>() : nullptr;
+	return tickManager && tickManager->IsSchedulerOverloaded();
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
@@ -91,46 +200,249 @@ void UNextLifeBrainComponent::GetCurrentActiveBehaviors(TArray<UNLBehavior*>& be
 */
 void UNextLifeBrainComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_BrainTick);
+
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
+	if(IsRegisteredWithTickManager)
+	{
+		// The tick manager is running us
+		return;
+	}
+
+	TickBrain(DeltaTime);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::OnUnregister()
+{
+	SetTickManagerRegistration(false);
+	Super::OnUnregister();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::TickBrain(float deltaTime)
+{
 	if(AreBehaviorsPaused || !LogicIsStarted)
 	{
 		return;
 	}
 
-	TArray<int32> behaviorsToRun;
-	ChooseBehaviors(behaviorsToRun);
+	BehaviorsToRun.Reset();
+	PrepareBehaviorsToRun(BehaviorsToRun, deltaTime);
 
-	// Stop any behaviors which shouldn't be running right now first
-	for(int32 behaviorIndex = Behaviors.Num() - 1; behaviorIndex >= 0; --behaviorIndex)
+	for(UNLBehavior* behavior : BehaviorsToRun)
 	{
-		check(Behaviors[behaviorIndex]);
-		if(!behaviorsToRun.Contains(behaviorIndex))
+		RunChosenBehavior(behavior, deltaTime);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNextLifeBrainComponent::AdvanceLOD(float deltaTime, float significance, bool useTiers, float& elapsedTimeOut, float& deferredTimeOut)
+{
+	LODElapsedTime += deltaTime;
+	if(IsLODUpdateDeferred)
+	{
+		LODDeferredTime += deltaTime;
+	}
+
+	if(useTiers && LODTiers.Num() > 0)
+	{
+		int32 tier = LODTiers.Num() - 1;
+		for(int32 tierIndex = 0; tierIndex < LODTiers.Num(); ++tierIndex)
 		{
-			// If behavior was running, we should reset it
-			if(Behaviors[behaviorIndex]->HasBehaviorBegun())
+			if(significance <= LODTiers[tierIndex].MaxSignificance)
 			{
-				Behaviors[behaviorIndex]->StopBehavior(false);
+				tier = tierIndex;
+				break;
 			}
 		}
+
+		const float updateInterval = LODTiers[tier].UpdateInterval;
+		if(tier != CurrentLODTier)
+		{
+			// Start brains entering a tier at their own offset into the interval so brains in the same tier don't all
+			// update on the same frame. Never wait longer than the previous tier would have.
+			const float phaseDelay = updateInterval * LODPhase;
+			LODTimeUntilUpdate = CurrentLODTier == INDEX_NONE ? phaseDelay : FMath::Min(LODTimeUntilUpdate, phaseDelay);
+			CurrentLODTier = tier;
+		}
+
+		LODTimeUntilUpdate -= deltaTime;
+		if(LODTimeUntilUpdate > 0.0f)
+		{
+			return false;
+		}
+
+		// Keep to the interval, but don't try to catch up on missed updates after a long frame
+		LODTimeUntilUpdate = FMath::Max(LODTimeUntilUpdate + updateInterval, 0.0f);
+	}
+	else
+	{
+		CurrentLODTier = INDEX_NONE;
 	}
 
-	// Run behaviors which should be active
-	for(int32 behaviorIndex = Behaviors.Num() - 1; behaviorIndex >= 0; --behaviorIndex)
+	elapsedTimeOut = LODElapsedTime;
+	deferredTimeOut = LODDeferredTime;
+	LODElapsedTime = 0.0f;
+	LODDeferredTime = 0.0f;
+	IsLODUpdateDeferred = false;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::DeferLODUpdate(float elapsedTime, float deferredTime)
+{
+	LODElapsedTime += elapsedTime;
+	LODDeferredTime = deferredTime;
+	IsLODUpdateDeferred = true;
+	LODTimeUntilUpdate = 0.0f;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::RecordTransitions(int32 chainLength)
+{
+	if(TransitionFrame != GFrameCounter)
 	{
-		check(Behaviors[behaviorIndex]);
-		if(behaviorsToRun.Contains(behaviorIndex))
+		TransitionFrame = GFrameCounter;
+		TransitionsThisFrame = 0;
+	}
+
+	TransitionsThisFrame += chainLength;
+	PeakTransitionsPerFrame = FMath::Max(PeakTransitionsPerFrame, TransitionsThisFrame);
+	LongestTransitionChain = FMath::Max(LongestTransitionChain, chainLength);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::ResetLOD()
+{
+	CurrentLODTier = INDEX_NONE;
+	LODElapsedTime = 0.0f;
+	LODTimeUntilUpdate = 0.0f;
+	LODDeferredTime = 0.0f;
+	IsLODUpdateDeferred = false;
+	LODPhase = FMath::Frac(GetUniqueID() * 0.6180339887f);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::PrepareBehaviorsToRun(TArray<UNLBehavior*>& behaviorsOut, float deltaTime)
+{
+	if(AreBehaviorsPaused || !LogicIsStarted)
+	{
+		return;
+	}
+
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordUpdate(deltaTime);
+	}
+
+	bool reevaluate = SelectionIsDirty || ChosenBehaviors.Num() != Behaviors.Num() || SelectionReevaluationInterval == 0.0f;
+	if(!reevaluate && SelectionReevaluationInterval > 0.0f)
+	{
+		const UWorld* world = GetWorld();
+		reevaluate = !world || world->GetTimeSeconds() - LastSelectionTime >= SelectionReevaluationInterval;
+	}
+
+	if(reevaluate)
+	{
+		ChooseBehaviors();
+	}
+
+	// Output behaviors which should be active
+	for(int32 behaviorIndex = FMath::Min(Behaviors.Num(), ChosenBehaviors.Num()) - 1; behaviorIndex >= 0; --behaviorIndex)
+	{
+		if(ChosenBehaviors[behaviorIndex])
 		{
-			if(!Behaviors[behaviorIndex]->HasBehaviorBegun())
-			{
-				// Start it up
-				Behaviors[behaviorIndex]->BeginBehavior();
-			}
-			else
-			{
-				// Run it
-				Behaviors[behaviorIndex]->RunBehavior(DeltaTime);
-			}
+			behaviorsOut.Add(Behaviors[behaviorIndex]);
+		}
+	}
+
+	// Queued sensing events go in as one batch before the behaviors run and apply their pending events
+	DeliverQueuedSensingEvents();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::RunChosenBehavior(UNLBehavior* behavior, float deltaTime)
+{
+	check(behavior);
+
+	if(!CanRunChosenBehavior(behavior))
+	{
+		return;
+	}
+
+	if(!behavior->HasBehaviorBegun())
+	{
+		// Start it up
+		behavior->BeginBehavior();
+	}
+	else
+	{
+		// Run it
+		behavior->RunBehavior(deltaTime);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+bool UNextLifeBrainComponent::CanRunChosenBehavior(const UNLBehavior* behavior) const
+{
+	return !AreBehaviorsPaused && LogicIsStarted && behavior && FindBehavior(behavior->GetClass()) == behavior;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::SetTickManagerRegistration(bool registered)
+{
+	if(registered == IsRegisteredWithTickManager)
+	{
+		return;
+	}
+
+	UWorld* world = GetWorld();
+	UNextLifeTickManager* tickManager = world ? world->GetSubsystem<UNextLifeTickManager>() : nullptr;
+
+	if(registered)
+	{
+		if(!tickManager)
+		{
+			// No manager, fallback to the component tick
+			return;
+		}
+		ResetLOD();
+		tickManager->RegisterBrain(this);
+		IsRegisteredWithTickManager = true;
+		SetComponentTickEnabled(false);
+	}
+	else
+	{
+		if(tickManager)
+		{
+			tickManager->UnregisterBrain(this);
+		}
+		IsRegisteredWithTickManager = false;
+		if(IsRegistered())
+		{
+			SetComponentTickEnabled(true);
 		}
 	}
 }
@@ -140,7 +452,28 @@ void UNextLifeBrainComponent::TickComponent(float DeltaTime, ELevelTick TickType
 */
 void UNextLifeBrainComponent::StartLogic()
 {
+	if((RecordEvents || CVarNextLifeRecordEventsOnStart.GetValueOnGameThread() != 0) && !EventRecorder.IsRecording())
+	{
+		EventRecorder.Start(*this);
+	}
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordLogic(ENLRecordedEventType::StartLogic);
+	}
+
 	LogicIsStarted = true;
+	InvalidateBehaviorSelection();
+	SetSelectionBlackboardObservers(true);
+
+	if((RecordTransitionHistory || CVarNextLifeRecordTransitions.GetValueOnGameThread() != 0) && !TransitionRecorder.IsRecording())
+	{
+		TransitionRecorder.SetCapacity(FMath::Max(TransitionHistorySize, 1));
+	}
+
+	if(UseTickManager)
+	{
+		SetTickManagerRegistration(true);
+	}
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -159,6 +492,11 @@ void UNextLifeBrainComponent::StopLogic(const FString& Reason)
 {
 	if(LogicIsStarted)
 	{
+		if(EventRecorder.IsRecording())
+		{
+			EventRecorder.RecordLogic(ENLRecordedEventType::StopLogic);
+		}
+
 		for(int32 behaviorIndex = Behaviors.Num() - 1; behaviorIndex >= 0; --behaviorIndex)
 		{
 			if(Behaviors[behaviorIndex])
@@ -167,22 +505,16 @@ void UNextLifeBrainComponent::StopLogic(const FString& Reason)
 			}
 		}
 		LogicIsStarted = false;
+		SetTickManagerRegistration(false);
+		SetSelectionBlackboardObservers(false);
+
+		QueuedSensingEvents.Reset();
+		HeldSightLostEvents.Reset();
+		LastSightDeliveryTimes.Reset();
 
 		if(LogState)
 		{
-			FString aiName = TEXT("Unknown");
-			if(GetAIOwner())
-			{
-				if(GetAIOwner()->GetPawn())
-				{
-					aiName = GetAIOwner()->GetPawn()->GetName();
-				}
-				else
-				{
-					aiName = GetAIOwner()->GetName();
-				}
-			}
-			UE_LOG(LogNextLife, Warning, TEXT("AI '%s' Logic being stopped, reason: %s"), *aiName, *Reason);
+			UE_LOG(LogNextLife, Warning, TEXT("AI '%s' Logic being stopped, reason: %s"), *GetDebugName(), *Reason);
 		}
 	}
 }
@@ -200,6 +532,11 @@ void UNextLifeBrainComponent::Cleanup()
 */
 void UNextLifeBrainComponent::PauseLogic(const FString& Reason)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordLogic(ENLRecordedEventType::PauseLogic);
+	}
+
 	AreBehaviorsPaused = true;
 	for(UNLBehavior*& behavior : Behaviors)
 	{
@@ -215,7 +552,16 @@ void UNextLifeBrainComponent::PauseLogic(const FString& Reason)
 */
 EAILogicResuming::Type UNextLifeBrainComponent::ResumeLogic(const FString& Reason)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordLogic(ENLRecordedEventType::ResumeLogic);
+	}
+
 	AreBehaviorsPaused = false;
+	LODElapsedTime = 0.0f;
+	LODDeferredTime = 0.0f;
+	IsLODUpdateDeferred = false;
+	InvalidateBehaviorSelection();
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior)
@@ -242,6 +588,16 @@ bool UNextLifeBrainComponent::IsPaused() const
 	return AreBehaviorsPaused;
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FString UNextLifeBrainComponent::GetDebugName() const
+{
+	const AAIController* controller = GetAIOwner();
+	const APawn* pawn = controller ? controller->GetPawn() : nullptr;
+	return pawn ? pawn->GetName() : (controller ? controller->GetName() : GetName());
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
 */
@@ -249,13 +605,263 @@ void UNextLifeBrainComponent::OnBehaviorComplete(UNLBehavior* completeBehavior)
 {
 	check(completeBehavior);
 	
-	const int32 classIndex = ActiveBehaviorClasses.Find(completeBehavior->GetClass());
-	if(classIndex != INDEX_NONE)
+	if(RemoveBehaviorOfClass(completeBehavior->GetClass()))
+	{
+		InvalidateBehaviorSelection();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::SetSelectionBlackboardObservers(bool observe)
+{
+	if(observe == IsObservingBlackboard || !BlackboardComp)
+	{
+		return;
+	}
+
+	if(observe)
+	{
+		for(const FName& keyName : SelectionBlackboardKeys)
+		{
+			const FBlackboard::FKey keyId = BlackboardComp->GetKeyID(keyName);
+			if(keyId == FBlackboard::InvalidKey)
+			{
+				UE_LOG(LogNextLife, Warning, TEXT("Brain '%s' selection blackboard key '%s' doesn't exist"), *GetName(), *keyName.ToString());
+				continue;
+			}
+			BlackboardComp->RegisterObserver(keyId, this, FOnBlackboardChangeNotification::CreateUObject(this, &UNextLifeBrainComponent::OnSelectionBlackboardKeyChanged));
+		}
+	}
+	else
+	{
+		BlackboardComp->UnregisterObserversFrom(this);
+	}
+	IsObservingBlackboard = observe;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+EBlackboardNotificationResult UNextLifeBrainComponent::OnSelectionBlackboardKeyChanged(const UBlackboardComponent& blackboard, FBlackboard::FKey keyId)
+{
+	InvalidateBehaviorSelection();
+	return EBlackboardNotificationResult::ContinueObserving;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::QueueSensingEvent(FNLQueuedSensingEvent&& sensingEvent)
+{
+	if(AreBehaviorsPaused)
+	{
+		// Behaviors ignore events while paused
+		return;
+	}
+
+	++SensingEventsReceived;
+
+	const UWorld* world = GetWorld();
+	const float now = world ? world->GetTimeSeconds() : 0.0f;
+	sensingEvent.ReceivedTime = now;
+
+	const bool hasSubject = sensingEvent.Subject.IsValid();
+
+	auto findQueuedSight = [this, &sensingEvent]()
+	{
+		return QueuedSensingEvents.IndexOfByPredicate([&sensingEvent](const FNLQueuedSensingEvent& queuedEvent)
+		{
+			return queuedEvent.Type == ENLQueuedSensingEventType::Sight && queuedEvent.Subject == sensingEvent.Subject;
+		});
+	};
+
+	if(hasSubject && sensingEvent.Type == ENLQueuedSensingEventType::SightLost && !LastSightDeliveryTimes.Contains(sensingEvent.Subject))
+	{
+		// Seen and lost within the same frame without the behaviors knowing about the subject, drop both
+		const int32 queuedSightIndex = findQueuedSight();
+		if(queuedSightIndex != INDEX_NONE)
+		{
+			QueuedSensingEvents.RemoveAt(queuedSightIndex, 1, false);
+			SensingEventsCoalesced += 2;
+			return;
+		}
+	}
+
+	if(SightFlickerInterval > 0.0f && hasSubject)
+	{
+		if(sensingEvent.Type == ENLQueuedSensingEventType::Sight)
+		{
+			// Seen again while the sight lost is being held back, the subject never really left
+			const int32 heldIndex = HeldSightLostEvents.IndexOfByPredicate([&sensingEvent](const FNLQueuedSensingEvent& heldEvent)
+			{
+				return heldEvent.Subject == sensingEvent.Subject;
+			});
+			if(heldIndex != INDEX_NONE)
+			{
+				HeldSightLostEvents.RemoveAtSwap(heldIndex, 1, false);
+				SensingEventsCoalesced += 2;
+				return;
+			}
+
+			// Rate limit sights of the same subject
+			const float* lastDeliveryTime = LastSightDeliveryTimes.Find(sensingEvent.Subject);
+			if(lastDeliveryTime && now - *lastDeliveryTime < SightFlickerInterval)
+			{
+				++SensingEventsCoalesced;
+				return;
+			}
+		}
+		else if(sensingEvent.Type == ENLQueuedSensingEventType::SightLost)
+		{
+			// The behaviors already see the subject, the loss replaces any queued sight and is held back like any other
+			const int32 queuedSightIndex = findQueuedSight();
+			if(queuedSightIndex != INDEX_NONE)
+			{
+				QueuedSensingEvents.RemoveAt(queuedSightIndex, 1, false);
+				++SensingEventsCoalesced;
+			}
+
+			// Hold it back, if the subject is seen again before the interval passes it is dropped
+			for(const FNLQueuedSensingEvent& heldEvent : HeldSightLostEvents)
+			{
+				if(heldEvent.Subject == sensingEvent.Subject)
+				{
+					++SensingEventsCoalesced;
+					return;
+				}
+			}
+			HeldSightLostEvents.Add(MoveTemp(sensingEvent));
+			return;
+		}
+	}
+
+	// Coalesce with an event about the same subject already queued this frame
+	if(hasSubject)
+	{
+		for(FNLQueuedSensingEvent& queuedEvent : QueuedSensingEvents)
+		{
+			if(queuedEvent.Subject != sensingEvent.Subject)
+			{
+				continue;
+			}
+
+			const bool queuedIsSight = queuedEvent.Type == ENLQueuedSensingEventType::Sight || queuedEvent.Type == ENLQueuedSensingEventType::SightLost;
+			const bool newIsSight = sensingEvent.Type == ENLQueuedSensingEventType::Sight || sensingEvent.Type == ENLQueuedSensingEventType::SightLost;
+			if(queuedIsSight && newIsSight)
+			{
+				// The latest sight state wins
+				queuedEvent = MoveTemp(sensingEvent);
+				++SensingEventsCoalesced;
+				return;
+			}
+
+			if(queuedEvent.Type == sensingEvent.Type)
+			{
+				// Keep the loudest sound, or the latest contact
+				if(sensingEvent.Type != ENLQueuedSensingEventType::Sound || sensingEvent.Volume > queuedEvent.Volume)
+				{
+					queuedEvent = MoveTemp(sensingEvent);
+				}
+				++SensingEventsCoalesced;
+				return;
+			}
+		}
+	}
+
+	QueuedSensingEvents.Add(MoveTemp(sensingEvent));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::DeliverQueuedSensingEvents()
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_DeliverSensingEvents);
+
+	const UWorld* world = GetWorld();
+	const float now = world ? world->GetTimeSeconds() : 0.0f;
+
+	// Release held sight lost events which waited out the flicker interval
+	for(int32 heldIndex = HeldSightLostEvents.Num() - 1; heldIndex >= 0; --heldIndex)
+	{
+		if(now - HeldSightLostEvents[heldIndex].ReceivedTime >= SightFlickerInterval)
+		{
+			QueuedSensingEvents.Add(MoveTemp(HeldSightLostEvents[heldIndex]));
+			HeldSightLostEvents.RemoveAtSwap(heldIndex, 1, false);
+		}
+	}
+
+	// Subjects destroyed while seen never send a sight lost
+	for(auto deliveryIt = LastSightDeliveryTimes.CreateIterator(); deliveryIt; ++deliveryIt)
+	{
+		if(!deliveryIt.Key().IsValid())
+		{
+			deliveryIt.RemoveCurrent();
+		}
+	}
+
+	if(QueuedSensingEvents.Num() == 0)
 	{
-		ActiveBehaviorClasses.RemoveAt(classIndex);
-		check(Behaviors.IsValidIndex(classIndex));
-		check(Behaviors[classIndex]);
-		Behaviors.RemoveAt(classIndex);
+		return;
+	}
+
+	// Events queued while delivering wait for the next batch
+	Swap(QueuedSensingEvents, DeliveringSensingEvents);
+
+	for(const FNLQueuedSensingEvent& sensingEvent : DeliveringSensingEvents)
+	{
+		// The subject was destroyed while the event waited, events are never sent about a subject which is gone
+		if(sensingEvent.Subject.IsStale())
+		{
+			continue;
+		}
+
+		if(sensingEvent.Type == ENLQueuedSensingEventType::Sight)
+		{
+			LastSightDeliveryTimes.Add(sensingEvent.Subject, now);
+		}
+		else if(sensingEvent.Type == ENLQueuedSensingEventType::SightLost)
+		{
+			LastSightDeliveryTimes.Remove(sensingEvent.Subject);
+		}
+
+		DispatchSensingEvent(sensingEvent);
+		++SensingEventsDelivered;
+	}
+	DeliveringSensingEvents.Reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeBrainComponent::DispatchSensingEvent(const FNLQueuedSensingEvent& sensingEvent)
+{
+	for(UNLBehavior*& behavior : Behaviors)
+	{
+		if(!behavior || !behavior->HasBehaviorBegun())
+		{
+			continue;
+		}
+
+		switch(sensingEvent.Type)
+		{
+			case ENLQueuedSensingEventType::Sight:
+				NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sight, Cast<APawn>(sensingEvent.Subject.Get()), sensingEvent.Indirect);
+				break;
+			case ENLQueuedSensingEventType::SightLost:
+				NL_CALL_EVENT(INLSensingEvents, behavior, Sense_SightLost, Cast<APawn>(sensingEvent.Subject.Get()));
+				break;
+			case ENLQueuedSensingEventType::Sound:
+				NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sound, Cast<APawn>(sensingEvent.Subject.Get()), sensingEvent.Location, sensingEvent.Volume, sensingEvent.Flags);
+				break;
+			case ENLQueuedSensingEventType::Contact:
+				NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Contact, sensingEvent.Subject.Get(), sensingEvent.HitResult);
+				break;
+			default:
+				break;
+		}
 	}
 }
 
@@ -264,11 +870,16 @@ void UNextLifeBrainComponent::OnBehaviorComplete(UNLBehavior* completeBehavior)
 */
 void UNextLifeBrainComponent::General_Message(UNLGeneralMessage* message)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordGeneralMessage(message);
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_General_Message(behavior, message);
+			NL_CALL_EVENT(INLGeneralEvents, behavior, General_Message, message);
 		}
 	}
 }
@@ -278,11 +889,26 @@ void UNextLifeBrainComponent::General_Message(UNLGeneralMessage* message)
 */
 void UNextLifeBrainComponent::Sense_Sight(APawn* subject, bool indirect)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordSight(subject, indirect);
+	}
+
+	if(QueueSensingEvents || IsSchedulerOverloaded())
+	{
+		FNLQueuedSensingEvent sensingEvent;
+		sensingEvent.Type = ENLQueuedSensingEventType::Sight;
+		sensingEvent.Subject = subject;
+		sensingEvent.Indirect = indirect;
+		QueueSensingEvent(MoveTemp(sensingEvent));
+		return;
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_Sense_Sight(behavior, subject, indirect);
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sight, subject, indirect);
 		}
 	}
 }
@@ -292,11 +918,25 @@ void UNextLifeBrainComponent::Sense_Sight(APawn* subject, bool indirect)
 */
 void UNextLifeBrainComponent::Sense_SightLost(APawn* subject)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordSightLost(subject);
+	}
+
+	if(QueueSensingEvents || IsSchedulerOverloaded())
+	{
+		FNLQueuedSensingEvent sensingEvent;
+		sensingEvent.Type = ENLQueuedSensingEventType::SightLost;
+		sensingEvent.Subject = subject;
+		QueueSensingEvent(MoveTemp(sensingEvent));
+		return;
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_Sense_SightLost(behavior, subject);
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_SightLost, subject);
 		}
 	}
 }
@@ -307,11 +947,28 @@ void UNextLifeBrainComponent::Sense_SightLost(APawn* subject)
 void UNextLifeBrainComponent::Sense_Sound(APawn* OtherActor, const FVector& Location,
 	float Volume, int32 flags)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordSound(OtherActor, Location, Volume, flags);
+	}
+
+	if(QueueSensingEvents || IsSchedulerOverloaded())
+	{
+		FNLQueuedSensingEvent sensingEvent;
+		sensingEvent.Type = ENLQueuedSensingEventType::Sound;
+		sensingEvent.Subject = OtherActor;
+		sensingEvent.Location = Location;
+		sensingEvent.Volume = Volume;
+		sensingEvent.Flags = flags;
+		QueueSensingEvent(MoveTemp(sensingEvent));
+		return;
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_Sense_Sound(behavior, OtherActor, Location, Volume, flags);
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Sound, OtherActor, Location, Volume, flags);
 		}
 	}
 }
@@ -321,11 +978,26 @@ void UNextLifeBrainComponent::Sense_Sound(APawn* OtherActor, const FVector& Loca
 */
 void UNextLifeBrainComponent::Sense_Contact(AActor* other, const FHitResult& hitResult)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordContact(other, hitResult);
+	}
+
+	if(QueueSensingEvents || IsSchedulerOverloaded())
+	{
+		FNLQueuedSensingEvent sensingEvent;
+		sensingEvent.Type = ENLQueuedSensingEventType::Contact;
+		sensingEvent.Subject = other;
+		sensingEvent.HitResult = hitResult;
+		QueueSensingEvent(MoveTemp(sensingEvent));
+		return;
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_Sense_Contact(behavior, other, hitResult);
+			NL_CALL_EVENT(INLSensingEvents, behavior, Sense_Contact, other, hitResult);
 		}
 	}
 }
@@ -335,11 +1007,16 @@ void UNextLifeBrainComponent::Sense_Contact(AActor* other, const FHitResult& hit
 */
 void UNextLifeBrainComponent::Movement_MoveTo(const AActor* goal, const FVector& pos, float range)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordMoveTo(goal, pos, range);
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_Movement_MoveTo(behavior, goal, pos, range);
+			NL_CALL_EVENT(INLMovementEvents, behavior, Movement_MoveTo, goal, pos, range);
 		}
 	}
 }
@@ -349,11 +1026,16 @@ void UNextLifeBrainComponent::Movement_MoveTo(const AActor* goal, const FVector&
 */
 void UNextLifeBrainComponent::Movement_MoveToComplete(FAIRequestID RequestID, const EPathFollowingResult::Type Result)
 {
+	if(EventRecorder.IsRecording())
+	{
+		EventRecorder.RecordMoveToComplete(RequestID, Result);
+	}
+
 	for(UNLBehavior*& behavior : Behaviors)
 	{
 		if(behavior && behavior->HasBehaviorBegun())
 		{
-			behavior->Execute_Movement_MoveToComplete(behavior, RequestID, Result);
+			NL_CALL_EVENT(INLMovementEvents, behavior, Movement_MoveToComplete, RequestID, Result);
 		}
 	}
 }
@@ -2,6 +2,7 @@
 
 #include "NextLifeModule.h"
 #include "Modules/ModuleManager.h"
+#include "NLEventOverrides.h"
 
 DEFINE_LOG_CATEGORY(LogNextLife);
 
@@ -29,6 +30,7 @@ IMPLEMENT_MODULE(FNextLifeModule, NextLife);
 */
 void FNextLifeModule::StartupModule()
 {
+	FNLEventOverrides::Startup();
 }
 
 //--------------------------------------------------------------------------------------------------------------------
@@ -36,6 +38,7 @@ void FNextLifeModule::StartupModule()
 */
 void FNextLifeModule::ShutdownModule()
 {
+	FNLEventOverrides::Shutdown();
 }
 
 #undef LOCTEXT_NAMESPACE
@@ -0,0 +1,553 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#include "NextLifeTickManager.h"
+#include "NextLifeModule.h"
+#include "NextLifeBrainComponent.h"
+#include "NLBehavior.h"
+#include "NLAction.h"
+
+#include "AIController.h"
+#include "GameFramework/PlayerController.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Tick Manager"), STAT_NextLife_TickManager, STATGROUP_NextLife);
+DECLARE_CYCLE_STAT(TEXT("Tick Manager Parallel Updates"), STAT_NextLife_TickManagerParallel, STATGROUP_NextLife);
+
+static TAutoConsoleVariable<int32> CVarNextLifeParallelUpdates(
+	TEXT("NextLife.ParallelUpdates"),
+	0,
+	TEXT("If non zero, the NextLife tick manager updates thread safe native actions of all brains in parallel.\n")
+	TEXT("Everything else, including applying action results, still runs on the game thread in a fixed order."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNextLifeBudgetMs(
+	TEXT("NextLife.Budget.Ms"),
+	0.0f,
+	TEXT("Milliseconds per frame the NextLife tick manager may spend updating brains. Brains which don't fit are deferred\n")
+	TEXT("to the next frame. Zero or less is unlimited."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNextLifeBudgetMaxStaleness(
+	TEXT("NextLife.Budget.MaxStaleness"),
+	0.5f,
+	TEXT("Seconds a due brain can be deferred by the frame budget before it is updated regardless of the budget."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNextLifeBudgetSliceSize(
+	TEXT("NextLife.Budget.SliceSize"),
+	16,
+	TEXT("How many brains are gathered and run between checks of the frame budget."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNextLifeBudgetOverloadFrames(
+	TEXT("NextLife.Budget.OverloadFrames"),
+	10,
+	TEXT("Consecutive frames with deferred brains before the tick manager is considered overloaded, and consecutive\n")
+	TEXT("frames without before it recovers. While overloaded low priority behaviors aren't chosen and sensing events\n")
+	TEXT("are queued and coalesced."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNextLifeLOD(
+	TEXT("NextLife.LOD"),
+	1,
+	TEXT("If zero, brain LOD tiers are ignored and every brain ticked by the NextLife tick manager updates every frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNextLifeLODOutOfViewScale(
+	TEXT("NextLife.LOD.OutOfViewScale"),
+	1.0f,
+	TEXT("Scales the default LOD significance, the distance to the closest player view, of brains whose pawn is behind\n")
+	TEXT("every player view. Values above 1 drop brains out of view to lower update rates sooner."),
+	ECVF_Default);
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void FNextLifeTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if(Manager && TickType != LEVELTICK_ViewportsOnly)
+	{
+		Manager->TickBrains(DeltaTime);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+FString FNextLifeTickFunction::DiagnosticMessage()
+{
+	return TEXT("FNextLifeTickFunction");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+UNextLifeTickManager::UNextLifeTickManager()
+	: IsTicking(false)
+	, PendingRemovals(0)
+	, LastTickBrainCount(0)
+	, LastTickBehaviorCount(0)
+	, LastTickParallelUpdateCount(0)
+	, LastTickLODSkippedBrainCount(0)
+	, LastTickDeferredBrainCount(0)
+	, LastTickStaleBrainCount(0)
+	, TotalDeferrals(0)
+	, LastTickTimeMs(0.0f)
+	, ConsecutiveDeferredFrames(0)
+	, ConsecutiveRecoveredFrames(0)
+	, IsOverloaded(false)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::Deinitialize()
+{
+	if(TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+	TickFunction.Manager = nullptr;
+
+	Brains.Reset();
+	Batches.Reset();
+	ViewPoints.Reset();
+	DueBrains.Reset();
+	SignificanceFunction = nullptr;
+	BatchIndexByClass.Reset();
+	PendingRemovals = 0;
+
+	Super::Deinitialize();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::RegisterBrain(UNextLifeBrainComponent* brain)
+{
+	check(brain);
+
+	if(Brains.Contains(brain))
+	{
+		return;
+	}
+
+	Brains.Add(brain);
+
+	// Register the tick function when the first brain shows up
+	if(!TickFunction.IsTickFunctionRegistered())
+	{
+		UWorld* world = GetWorld();
+		check(world && world->PersistentLevel);
+
+		TickFunction.Manager = this;
+		TickFunction.bCanEverTick = true;
+		TickFunction.bTickEvenWhenPaused = false;
+		TickFunction.TickGroup = TG_DuringPhysics;
+		TickFunction.RegisterTickFunction(world->PersistentLevel);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::UnregisterBrain(UNextLifeBrainComponent* brain)
+{
+	const int32 brainIndex = Brains.Find(brain);
+	if(brainIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	if(IsTicking)
+	{
+		// Can't shuffle the array while it is being iterated, remove it after the tick
+		Brains[brainIndex] = nullptr;
+		++PendingRemovals;
+	}
+	else
+	{
+		Brains.RemoveAt(brainIndex);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::CompactBrains()
+{
+	if(PendingRemovals > 0)
+	{
+		Brains.Remove(nullptr);
+		PendingRemovals = 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::TickBrains(float deltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NextLife_TickManager);
+
+	const double startTime = FPlatformTime::Seconds();
+
+	IsTicking = true;
+	LastTickBrainCount = 0;
+	LastTickBehaviorCount = 0;
+	LastTickParallelUpdateCount = 0;
+	LastTickLODSkippedBrainCount = 0;
+	LastTickLODTierBrainCounts.Reset();
+
+	LastTickDeferredBrainCount = 0;
+	LastTickStaleBrainCount = 0;
+
+	const bool useLOD = CVarNextLifeLOD.GetValueOnGameThread() != 0;
+	if(useLOD && !SignificanceFunction)
+	{
+		GatherViewPoints();
+	}
+
+	// Work out which brains are due to update this frame
+	DueBrains.Reset();
+	const float maxStaleness = CVarNextLifeBudgetMaxStaleness.GetValueOnGameThread();
+	for(int32 brainIndex = 0; brainIndex < Brains.Num(); ++brainIndex)
+	{
+		UNextLifeBrainComponent* brain = Brains[brainIndex];
+		if(!brain || brain->IsPendingKill() || !brain->IsRunning())
+		{
+			continue;
+		}
+
+		const bool brainUsesLOD = useLOD && brain->LODTiers.Num() > 0;
+		const float significance = brainUsesLOD ? GetBrainSignificance(brain) : 0.0f;
+		float brainDeltaTime = 0.0f;
+		float deferredTime = 0.0f;
+		const bool shouldUpdate = brain->AdvanceLOD(deltaTime, significance, brainUsesLOD, brainDeltaTime, deferredTime);
+
+		const int32 tier = FMath::Max(brain->GetCurrentLODTier(), 0);
+		if(LastTickLODTierBrainCounts.Num() <= tier)
+		{
+			LastTickLODTierBrainCounts.SetNumZeroed(tier + 1);
+		}
+		++LastTickLODTierBrainCounts[tier];
+
+		if(!shouldUpdate)
+		{
+			++LastTickLODSkippedBrainCount;
+			continue;
+		}
+
+		// Only time spent deferred by the budget counts, brains on slow tiers wait a long time between updates anyway
+		DueBrains.Add({brain, brainDeltaTime, deferredTime, deferredTime >= maxStaleness});
+	}
+
+	const float budgetMs = CVarNextLifeBudgetMs.GetValueOnGameThread();
+	const bool useBudget = budgetMs > 0.0f;
+	if(useBudget)
+	{
+		// Stale brains first as they have to run, then by priority, then the longest waiting so brains of the same
+		// priority take turns
+		DueBrains.Sort([](const FDueBrain& a, const FDueBrain& b)
+		{
+			if(a.Stale != b.Stale)
+			{
+				return a.Stale;
+			}
+			if(a.Brain->SchedulingPriority != b.Brain->SchedulingPriority)
+			{
+				return a.Brain->SchedulingPriority > b.Brain->SchedulingPriority;
+			}
+			return a.DeltaTime > b.DeltaTime;
+		});
+	}
+
+	const bool parallelUpdates = CVarNextLifeParallelUpdates.GetValueOnGameThread() != 0;
+	const int32 sliceSize = useBudget ? FMath::Max(CVarNextLifeBudgetSliceSize.GetValueOnGameThread(), 1) : DueBrains.Num();
+
+	// Run due brains a slice at a time until the budget runs out. Brains are still batched by behavior class within
+	// a slice.
+	int32 dueIndex = 0;
+	while(dueIndex < DueBrains.Num())
+	{
+		const bool overBudget = useBudget && (FPlatformTime::Seconds() - startTime) * 1000.0 >= budgetMs;
+		if(overBudget && !DueBrains[dueIndex].Stale)
+		{
+			break;
+		}
+
+		int32 sliceEnd = FMath::Min(dueIndex + sliceSize, DueBrains.Num());
+		if(overBudget)
+		{
+			// Only stale brains run past the budget
+			for(int32 staleIndex = dueIndex; staleIndex < sliceEnd; ++staleIndex)
+			{
+				if(!DueBrains[staleIndex].Stale)
+				{
+					sliceEnd = staleIndex;
+					break;
+				}
+			}
+		}
+
+		GatherBatches(dueIndex, sliceEnd);
+		if(parallelUpdates)
+		{
+			RunBatchesParallel();
+		}
+		else
+		{
+			RunBatches();
+		}
+		dueIndex = sliceEnd;
+	}
+
+	// Defer the rest to next frame, keeping their elapsed time
+	for(; dueIndex < DueBrains.Num(); ++dueIndex)
+	{
+		DueBrains[dueIndex].Brain->DeferLODUpdate(DueBrains[dueIndex].DeltaTime, DueBrains[dueIndex].DeferredTime);
+		++LastTickDeferredBrainCount;
+	}
+	TotalDeferrals += LastTickDeferredBrainCount;
+	DueBrains.Reset();
+
+	// Sustained deferrals mean the budget can't keep up, switch on the overload policy until it recovers
+	const int32 overloadFrames = FMath::Max(CVarNextLifeBudgetOverloadFrames.GetValueOnGameThread(), 1);
+	if(LastTickDeferredBrainCount > 0)
+	{
+		ConsecutiveRecoveredFrames = 0;
+		if(++ConsecutiveDeferredFrames >= overloadFrames && !IsOverloaded)
+		{
+			IsOverloaded = true;
+			UE_LOG(LogNextLife, Log, TEXT("NextLife tick manager is overloaded, %d brains deferred with a %.2fms budget"), LastTickDeferredBrainCount, budgetMs);
+			InvalidateBehaviorSelections();
+		}
+	}
+	else
+	{
+		ConsecutiveDeferredFrames = 0;
+		if(++ConsecutiveRecoveredFrames >= overloadFrames && IsOverloaded)
+		{
+			IsOverloaded = false;
+			UE_LOG(LogNextLife, Log, TEXT("NextLife tick manager recovered from overload"));
+			InvalidateBehaviorSelections();
+		}
+	}
+
+	IsTicking = false;
+	CompactBrains();
+
+	LastTickTimeMs = static_cast<float>((FPlatformTime::Seconds() - startTime) * 1000.0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::InvalidateBehaviorSelections()
+{
+	// The default ShouldChooseBehavior depends on the overload state
+	for(UNextLifeBrainComponent* brain : Brains)
+	{
+		if(brain)
+		{
+			brain->InvalidateBehaviorSelection();
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::GatherBatches(int32 dueStart, int32 dueEnd)
+{
+	for(int32 dueIndex = dueStart; dueIndex < dueEnd; ++dueIndex)
+	{
+		const FDueBrain& dueBrain = DueBrains[dueIndex];
+		UNextLifeBrainComponent* brain = dueBrain.Brain;
+
+		// An earlier slice could have stopped this brain
+		if(brain->IsPendingKill() || !brain->IsRunning())
+		{
+			continue;
+		}
+
+		ScratchBehaviors.Reset();
+		brain->PrepareBehaviorsToRun(ScratchBehaviors, dueBrain.DeltaTime);
+		++LastTickBrainCount;
+		LastTickStaleBrainCount += dueBrain.Stale ? 1 : 0;
+
+		for(UNLBehavior* behavior : ScratchBehaviors)
+		{
+			UClass* behaviorClass = behavior->GetClass();
+			int32* batchIndex = BatchIndexByClass.Find(behaviorClass);
+			if(!batchIndex)
+			{
+				FBehaviorBatch& newBatch = Batches.AddDefaulted_GetRef();
+				newBatch.BehaviorClass = behaviorClass;
+				batchIndex = &BatchIndexByClass.Add(behaviorClass, Batches.Num() - 1);
+			}
+			Batches[*batchIndex].Runs.Add({brain, behavior, dueBrain.DeltaTime});
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::RunBatches()
+{
+	// Run each batch back to back
+	for(FBehaviorBatch& batch : Batches)
+	{
+		for(const FBehaviorRun& run : batch.Runs)
+		{
+			run.Brain->RunChosenBehavior(run.Behavior, run.DeltaTime);
+		}
+		LastTickBehaviorCount += batch.Runs.Num();
+
+		// Keep the allocation for next frame
+		batch.Runs.Reset();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::RunBatchesParallel()
+{
+	PendingUpdates.Reset();
+
+	// Begin every behavior on the game thread. Starting behaviors and applying pending events can create actions and
+	// call blueprint events so it can't be done in parallel.
+	for(FBehaviorBatch& batch : Batches)
+	{
+		for(const FBehaviorRun& run : batch.Runs)
+		{
+			if(!run.Brain->CanRunChosenBehavior(run.Behavior))
+			{
+				continue;
+			}
+
+			if(!run.Behavior->HasBehaviorBegun())
+			{
+				run.Behavior->BeginBehavior();
+				continue;
+			}
+
+			if(run.Behavior->BeginRunBehavior())
+			{
+				UNLAction* topAction = run.Behavior->GetAction();
+				FPendingUpdate& update = PendingUpdates.AddDefaulted_GetRef();
+				update.Brain = run.Brain;
+				update.Behavior = run.Behavior;
+				update.UpdatedAction = topAction;
+				update.DeltaTime = run.DeltaTime;
+				update.OffGameThread = topAction->CanUpdateOffGameThread();
+				LastTickParallelUpdateCount += update.OffGameThread ? 1 : 0;
+			}
+		}
+		LastTickBehaviorCount += batch.Runs.Num();
+		batch.Runs.Reset();
+	}
+
+	// Update the thread safe actions. Each update writes only its own result slot so the outcome doesn't depend on
+	// how the work was split up.
+	{
+		SCOPE_CYCLE_COUNTER(STAT_NextLife_TickManagerParallel);
+		ParallelFor(PendingUpdates.Num(), [this](int32 updateIndex)
+		{
+			FPendingUpdate& update = PendingUpdates[updateIndex];
+			if(update.OffGameThread)
+			{
+				update.Result = update.UpdatedAction->InvokeUpdateOffGameThread(update.DeltaTime);
+			}
+		});
+	}
+
+	// Merge on the game thread in gather order. Results are applied, and behavior ended events broadcast, in the same
+	// order regardless of thread count.
+	for(FPendingUpdate& update : PendingUpdates)
+	{
+		// An earlier merge could have stopped this brain, removed the behavior or changed its action stack
+		if(!update.Brain->CanRunChosenBehavior(update.Behavior) || update.Behavior->GetAction() != update.UpdatedAction)
+		{
+			continue;
+		}
+
+		if(!update.OffGameThread)
+		{
+			update.Result = update.UpdatedAction->InvokeUpdate(update.DeltaTime);
+		}
+		update.Behavior->FinishRunBehavior(MoveTemp(update.Result));
+	}
+
+	PendingUpdates.Reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+void UNextLifeTickManager::GatherViewPoints()
+{
+	ViewPoints.Reset();
+
+	UWorld* world = GetWorld();
+	if(!world)
+	{
+		return;
+	}
+
+	for(FConstPlayerControllerIterator iterator = world->GetPlayerControllerIterator(); iterator; ++iterator)
+	{
+		APlayerController* playerController = iterator->Get();
+		if(!playerController)
+		{
+			continue;
+		}
+
+		FVector viewLocation;
+		FRotator viewRotation;
+		playerController->GetPlayerViewPoint(viewLocation, viewRotation);
+		ViewPoints.Emplace(viewRotation, viewLocation);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+float UNextLifeTickManager::GetBrainSignificance(const UNextLifeBrainComponent* brain) const
+{
+	if(SignificanceFunction)
+	{
+		return SignificanceFunction(brain);
+	}
+	return GetDefaultSignificance(brain);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+float UNextLifeTickManager::GetDefaultSignificance(const UNextLifeBrainComponent* brain) const
+{
+	const AAIController* controller = brain->GetAIOwner();
+	const APawn* pawn = controller ? controller->GetPawn() : nullptr;
+	if(!pawn || ViewPoints.Num() == 0)
+	{
+		// Nothing to measure against, treat it as fully significant
+		return 0.0f;
+	}
+
+	const FVector pawnLocation = pawn->GetActorLocation();
+	float closestDistanceSquared = MAX_flt;
+	bool inAnyView = false;
+	for(const FTransform& viewPoint : ViewPoints)
+	{
+		const FVector toPawn = pawnLocation - viewPoint.GetLocation();
+		closestDistanceSquared = FMath::Min(closestDistanceSquared, toPawn.SizeSquared());
+		inAnyView |= FVector::DotProduct(toPawn, viewPoint.GetRotation().GetForwardVector()) >= 0.0f;
+	}
+
+	const float distance = FMath::Sqrt(closestDistanceSquared);
+	return inAnyView ? distance : distance * CVarNextLifeLODOutOfViewScale.GetValueOnGameThread();
+}
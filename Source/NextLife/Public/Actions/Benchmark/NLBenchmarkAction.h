@@ -0,0 +1,61 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "NLAction.h"
+#include "EventSets/NLGeneralEvents.h"
+#include "EventSets/NLSensingEvents.h"
+#include "EventSets/NLMovementEvents.h"
+#include "NLBenchmarkAction.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Synthetic action of UNLBenchmarkBehavior. Builds the action stack up to the behaviors StackDepth, transitions at its
+ * TransitionRate while on top and listens to every event set.
+ */
+UCLASS(Blueprintable)
+class NEXTLIFE_API UNLBenchmarkAction : public UNLAction
+									 , public INLGeneralEvents
+									 , public INLSensingEvents
+									 , public INLMovementEvents
+{
+	GENERATED_BODY()
+public:
+	UNLBenchmarkAction();
+
+protected:
+	virtual FNLActionResult OnStart_Implementation(UNLActionPayload* payload) override;
+	virtual FNLActionResult OnUpdate_Implementation(const float deltaSeconds) override;
+	virtual FNLActionResult OnResume_Implementation(const UNLAction* resumedFromAction) override;
+
+	// General Events
+	virtual FNLEventResponse General_Message_Implementation(UNLGeneralMessage* message) override;
+
+	// Sensing Events
+	virtual FNLEventResponse Sense_Sight_Implementation(APawn* subject, bool indirect = false) override;
+	virtual FNLEventResponse Sense_SightLost_Implementation(APawn* subject) override;
+	virtual FNLEventResponse Sense_Sound_Implementation(APawn* OtherActor, const FVector& Location, float Volume, int32 flags) override;
+	virtual FNLEventResponse Sense_Contact_Implementation(AActor* other, const FHitResult& hitResult) override;
+
+	// Movement Events
+	virtual FNLEventResponse Movement_MoveTo_Implementation(const AActor* goal, const FVector& pos, float range) override;
+	virtual FNLEventResponse Movement_MoveToComplete_Implementation(FAIRequestID RequestID, const EPathFollowingResult::Type Result) override;
+
+private:
+	// Suspends for another benchmark action while the stack is shallower than the behaviors StackDepth
+	FNLActionResult BuildStack();
+
+	// The response to any event
+	FNLEventResponse RespondToEvent();
+
+	const class UNLBenchmarkBehavior* GetBenchmarkBehavior() const;
+
+	// Depth of this action in the stack, the root action being 0
+	int32 Depth;
+
+	// Time since the last transition
+	float TransitionTime;
+
+	// The number of transitions made, alternating CHANGE and DONE
+	int32 TransitionCount;
+};
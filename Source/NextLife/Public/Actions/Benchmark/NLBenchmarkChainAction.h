@@ -0,0 +1,24 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "NLAction.h"
+#include "NLBenchmarkChainAction.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Synthetic action for the action stack microbenchmarks. While its UNLBenchmarkBehavior has chain transitions left, it
+ * immediately changes to or suspends for another chain action when started, or is done when resumed, producing a
+ * chain of CHANGE, SUSPEND or DONE transitions from a single result.
+ */
+UCLASS()
+class NEXTLIFE_API UNLBenchmarkChainAction : public UNLAction
+{
+	GENERATED_BODY()
+public:
+	UNLBenchmarkChainAction();
+
+protected:
+	virtual FNLActionResult OnStart_Implementation(UNLActionPayload* payload) override;
+	virtual FNLActionResult OnResume_Implementation(const UNLAction* resumedFromAction) override;
+};
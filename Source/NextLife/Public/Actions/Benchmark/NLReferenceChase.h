@@ -0,0 +1,61 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "NLAction.h"
+#include "EventSets/NLSensingEvents.h"
+#include "NLReferenceChase.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * The pawn UNLReferenceChase chases
+ */
+USTRUCT()
+struct NEXTLIFE_API FNLReferenceChasePayload
+{
+	GENERATED_BODY()
+
+	FNLReferenceChasePayload()
+		: Target(nullptr)
+	{}
+
+	explicit FNLReferenceChasePayload(APawn* target)
+		: Target(target)
+	{}
+
+	UPROPERTY()
+	APawn* Target;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Chases a pawn seen by UNLReferencePatrol, heading for where it was last seen once sight of it is lost, and gives up
+ * after the reference AI GiveUpTime.
+ */
+UCLASS()
+class NEXTLIFE_API UNLReferenceChase : public UNLAction
+									 , public INLSensingEvents
+{
+	GENERATED_BODY()
+public:
+	typedef FNLReferenceChasePayload PayloadType;
+
+	UNLReferenceChase();
+
+protected:
+	virtual FNLActionResult OnStart_Implementation(UNLActionPayload* payload) override;
+	virtual FNLActionResult OnUpdate_Implementation(const float deltaSeconds) override;
+
+	// Sensing Events
+	virtual FNLEventResponse Sense_Sight_Implementation(APawn* subject, bool indirect = false) override;
+	virtual FNLEventResponse Sense_SightLost_Implementation(APawn* subject) override;
+
+private:
+	TWeakObjectPtr<APawn> Target;
+
+	bool TargetVisible;
+	FVector LastKnownLocation;
+
+	// Seconds since sight of the target was lost
+	float LostTime;
+};
@@ -0,0 +1,35 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "NLAction.h"
+#include "EventSets/NLSensingEvents.h"
+#include "NLReferencePatrol.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Root action of UNLReferenceBehavior. Patrols around where the pawn started and suspends for UNLReferenceChase when
+ * it sees a pawn.
+ */
+UCLASS()
+class NEXTLIFE_API UNLReferencePatrol : public UNLAction
+									  , public INLSensingEvents
+{
+	GENERATED_BODY()
+public:
+	UNLReferencePatrol();
+
+protected:
+	virtual FNLActionResult OnStart_Implementation(UNLActionPayload* payload) override;
+	virtual FNLActionResult OnUpdate_Implementation(const float deltaSeconds) override;
+
+	// Sensing Events
+	virtual FNLEventResponse Sense_Sight_Implementation(APawn* subject, bool indirect = false) override;
+
+private:
+	// Where the pawn started, patrolled around
+	FVector Home;
+
+	// The patrol point being walked to
+	int32 PatrolIndex;
+};
@@ -15,6 +15,10 @@ class NEXTLIFE_API UNLHumanoidIdle : public UNLAction
 								 , public INLSensingEvents
 {
 	GENERATED_BODY()
+public:
+	UNLHumanoidIdle();
+
+private:
 
 	// Sensing Events
 	virtual FNLEventResponse Sense_Sight_Implementation(APawn* subject, bool indirect = false) override;
@@ -0,0 +1,54 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "NLBehavior.h"
+
+#include "NLBenchmarkBehavior.generated.h"
+
+/**
+ * A synthetic behavior used by the NLBenchmark commandlet to load brains with a configurable amount of work.
+ * Its actions keep an action stack StackDepth deep, the top action transitions TransitionRate times a second and the
+ * root action answers EventResponseChance of the events it receives with a suspend request.
+ * Blueprint subclasses can be benchmarked to measure the cost of Blueprint behaviors and actions.
+ */
+UCLASS(Blueprintable)
+class NEXTLIFE_API UNLBenchmarkBehavior : public UNLBehavior
+{
+	GENERATED_BODY()
+public:
+	UNLBenchmarkBehavior();
+
+	// The depth of the action stack kept by the benchmark actions
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "1"))
+	int32 StackDepth;
+
+	// Transitions a second made by the top action, alternating CHANGE with DONE followed by a SUSPEND to rebuild the stack
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "0"))
+	float TransitionRate;
+
+	// The fraction of events the root action answers with a suspend request, exercising pending event processing
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "0", ClampMax = "1"))
+	float EventResponseChance;
+
+	// Chain transitions left for UNLBenchmarkChainAction and the kind of transition to chain, set by the action stack
+	// microbenchmarks
+	int32 ChainRemaining;
+	ENLActionChangeType ChainChange;
+
+	// Entry points into the action stack for the NLStackBenchmark commandlet
+	UNLAction* BenchmarkApplyActionResult(FNLActionResult&& result)
+	{
+		return Action = ApplyActionResult(MoveTemp(result), false);
+	}
+
+	UNLAction* BenchmarkApplyPendingEvents()
+	{
+		return Action = ApplyPendingEvents();
+	}
+
+	bool BenchmarkStoreEventResponse(UNLAction* respondingAction, FNLEventResponse&& response)
+	{
+		return StoreEventResponse(respondingAction, NAME_None, MoveTemp(response));
+	}
+};
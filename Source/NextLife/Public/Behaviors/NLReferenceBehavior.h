@@ -0,0 +1,26 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Behaviors/NLHumanoidBehavior.h"
+#include "Benchmark/NLReferenceAI.h"
+
+#include "NLReferenceBehavior.generated.h"
+
+/**
+ * The NextLife implementation of the reference AI compared against a Behavior Tree by the NLCompareBenchmark
+ * commandlet. Patrols with UNLReferencePatrol, which suspends for UNLReferenceChase on sight of a pawn.
+ */
+UCLASS(Blueprintable)
+class NEXTLIFE_API UNLReferenceBehavior : public UNLHumanoidBehavior
+{
+	GENERATED_BODY()
+public:
+	UNLReferenceBehavior();
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Reference AI")
+	FNLReferenceAISettings Settings;
+
+	// The settings of the reference behavior an action runs in, or the defaults outside of one
+	static const FNLReferenceAISettings& GetSettings(const UNLAction* action);
+};
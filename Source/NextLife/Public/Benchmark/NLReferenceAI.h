@@ -0,0 +1,49 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "NLReferenceAI.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Settings of the reference AI used to compare NextLife with other AI frameworks (see the NLCompareBenchmark
+ * commandlet). The reference AI patrols the corners of a square around its home, chases a pawn it sees, and gives up
+ * GiveUpTime seconds after losing sight of it. Every implementation moves its pawn with these helpers so only the
+ * decision making differs between them.
+ */
+USTRUCT(BlueprintType)
+struct NEXTLIFE_API FNLReferenceAISettings
+{
+	GENERATED_BODY()
+
+	FNLReferenceAISettings()
+		: MoveSpeed(300.0f)
+		, PatrolExtent(500.0f)
+		, AcceptanceRadius(25.0f)
+		, GiveUpTime(1.0f)
+	{}
+
+	// Movement speed in units per second, moving straight without navigation
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Reference AI")
+	float MoveSpeed;
+
+	// Half the size of the patrolled square
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Reference AI")
+	float PatrolExtent;
+
+	// Distance at which a patrol point is reached
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Reference AI")
+	float AcceptanceRadius;
+
+	// Seconds a chase goes on after losing sight of the target
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Reference AI")
+	float GiveUpTime;
+
+	// The patrol point of an index around home
+	FVector GetPatrolPoint(const FVector& home, int32 patrolIndex) const;
+
+	// Moves a pawn towards a goal, returning true once it is within AcceptanceRadius
+	bool MoveTowards(APawn* pawn, const FVector& goal, float deltaTime) const;
+};
@@ -0,0 +1,82 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "BehaviorTree/BTTaskNode.h"
+#include "BehaviorTree/Decorators/BTDecorator_Blackboard.h"
+#include "Benchmark/NLReferenceAI.h"
+
+#include "NLReferenceBTNodes.generated.h"
+
+class UBehaviorTree;
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Blackboard keys of the Behavior Tree reference AI. A perception handler sets Target and TargetVisible on sight and
+ * clears TargetVisible when sight is lost, the way sensing is usually fed to a Behavior Tree.
+ */
+struct NEXTLIFE_API FNLReferenceBlackboardKeys
+{
+	static const FName Home;
+	static const FName PatrolIndex;
+	static const FName Target;
+	static const FName TargetVisible;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Walks to the next patrol point around Home
+ */
+UCLASS()
+class NEXTLIFE_API UNLReferenceBTTask_Patrol : public UBTTaskNode
+{
+	GENERATED_BODY()
+public:
+	UNLReferenceBTTask_Patrol();
+
+	UPROPERTY(EditAnywhere, Category = "Reference AI")
+	FNLReferenceAISettings Settings;
+
+protected:
+	virtual EBTNodeResult::Type ExecuteTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory) override;
+	virtual void TickTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory, float deltaSeconds) override;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Chases Target, heading for where it was last seen once it isn't visible, and clears it after GiveUpTime
+ */
+UCLASS()
+class NEXTLIFE_API UNLReferenceBTTask_Chase : public UBTTaskNode
+{
+	GENERATED_BODY()
+public:
+	UNLReferenceBTTask_Chase();
+
+	UPROPERTY(EditAnywhere, Category = "Reference AI")
+	FNLReferenceAISettings Settings;
+
+	virtual uint16 GetInstanceMemorySize() const override;
+
+protected:
+	virtual EBTNodeResult::Type ExecuteTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory) override;
+	virtual void TickTask(UBehaviorTreeComponent& ownerComp, uint8* nodeMemory, float deltaSeconds) override;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Allows the chase while Target is set, aborting the patrol when it gets set
+ */
+UCLASS()
+class NEXTLIFE_API UNLReferenceBTDecorator_HasTarget : public UBTDecorator_Blackboard
+{
+	GENERATED_BODY()
+public:
+	UNLReferenceBTDecorator_HasTarget();
+};
+
+/**
+ * Builds the Behavior Tree reference AI in code, the equivalent of UNLReferenceBehavior:
+ * a selector running the chase while Target is set, patrolling otherwise.
+ */
+NEXTLIFE_API UBehaviorTree* NLCreateReferenceBehaviorTree(UObject* outer, const FNLReferenceAISettings& settings);
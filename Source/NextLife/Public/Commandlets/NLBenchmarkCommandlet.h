@@ -0,0 +1,30 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "NLBenchmarkCommandlet.generated.h"
+
+/**
+ * Synthetic crowd load benchmark. Spawns Count AI controllers with NextLife brains running a benchmark behavior in an
+ * empty world, sends them a steady stream of sensing, movement and general events, and runs the world without rendering
+ * for a number of frames. Reports frame time, tick manager time, transitions and events per second, event dispatch
+ * time, UObject allocations and garbage collection time, optionally as JSON.
+ *
+ * With -Crowd the behaviors run as agents of the NextLife crowd (UNLCrowdSubsystem) instead, without controllers, pawns
+ * or brains, and events are sent as crowd signals. Tick manager time is then the crowd tick time.
+ *
+ * Usage: -run=NLBenchmark [-Count=1000] [-Frames=600] [-Warmup=60] [-DeltaTime=0.0333] [-EventRate=2]
+ *        [-StackDepth=4] [-TransitionRate=1] [-EventResponseChance=0.1] [-Behavior=<benchmark behavior class path>]
+ *        [-PoolActions] [-Crowd] [-GCFrames=60] [-Output=<file.json>]
+ */
+UCLASS()
+class NEXTLIFE_API UNLBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UNLBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
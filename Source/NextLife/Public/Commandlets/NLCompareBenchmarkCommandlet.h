@@ -0,0 +1,31 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "NLCompareBenchmarkCommandlet.generated.h"
+
+/**
+ * Compares NextLife with the engine's Behavior Trees running the same reference AI (see FNLReferenceAISettings):
+ * patrol, chase a pawn on sight and give up after losing sight of it. UNLReferenceBehavior is the NextLife version,
+ * NLCreateReferenceBehaviorTree builds the Behavior Tree version. Each system runs at every agent count in its own
+ * empty world without rendering, with every agent seeing a pawn for SightDuration seconds every SightPeriod seconds.
+ *
+ * Reported for each system and count:
+ *  - AI CPU per agent: frame time over the same agents without AI, divided by the count
+ *  - Memory per agent: UObjects and their class sizes created by setting the AI up, and the change in used memory
+ *  - Reaction latency: frames and game time from delivering sight until the agent is chasing
+ *
+ * Usage: -run=NLCompareBenchmark [-Counts=100,500,1000,2000] [-Systems=NextLife,BehaviorTree] [-Frames=600]
+ *        [-Warmup=120] [-DeltaTime=0.0333] [-SightPeriod=4] [-SightDuration=1.5] [-Output=<file.json>]
+ */
+UCLASS()
+class NEXTLIFE_API UNLCompareBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UNLCompareBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,21 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "NLDecodeTransitionsCommandlet.generated.h"
+
+/**
+ * Decodes a transition history written by NextLife.DumpTransitions into readable action stack histories, offline.
+ * Usage: -run=NLDecodeTransitions -File=<file.nltr> [-Output=<file.txt>]
+ */
+UCLASS()
+class NEXTLIFE_API UNLDecodeTransitionsCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UNLDecodeTransitionsCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,34 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "NLPerfGateCommandlet.generated.h"
+
+/**
+ * Performance regression gate. Runs the NextLife benchmarks described by the JSON baselines in a directory and fails
+ * when a gated metric is worse than its baseline by more than its tolerance. Runs headless, for example on a build agent:
+ *   UE4Editor-Cmd <Project> -run=NLPerfGate -nullrhi -unattended [-Baselines=<dir>] [-Runs=3] [-Report=<file.json>]
+ *
+ * Each baseline file names a benchmark (Crowd for NLBenchmark, ActionStack for NLStackBenchmark), the arguments it is
+ * run with and the gated metrics:
+ *   { "Benchmark": "Crowd", "Args": "-Count=1000 -Frames=300",
+ *     "Metrics": { "FrameMs": { "Baseline": 2.5, "Tolerance": 0.15, "AbsoluteTolerance": 0.05 } } }
+ * Every gated metric is lower is better. A metric fails when it exceeds Baseline * (1 + Tolerance) + AbsoluteTolerance.
+ * ActionStack metrics are named <Name>@<Depth>, e.g. ApplyPendingEvents@16. Each benchmark is run Runs times and the
+ * median of each metric is compared.
+ *
+ * -UpdateBaseline rewrites the baseline values from this machine, keeping tolerances, and creates the default
+ * baselines when the directory has none. Baselines are only comparable on the machine type they were made on.
+ * The default directory is Benchmarks/Baselines in the plugin.
+ */
+UCLASS()
+class NEXTLIFE_API UNLPerfGateCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UNLPerfGateCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,23 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "NLReplayEventsCommandlet.generated.h"
+
+/**
+ * Replays an event recording written by NextLife.SaveEvents into the recorded behaviors in an empty world, timing each
+ * brain update. Recorded subjects are replaced by stand-in pawns at their recorded locations. Replaying a prefix of the
+ * recording with -Updates bisects where a spike starts, -Repeat replays it several times for stable timings.
+ * Usage: -run=NLReplayEvents -File=<file.nlev> [-Updates=<count>] [-Repeat=<count>] [-Csv=<file.csv>]
+ */
+UCLASS()
+class NEXTLIFE_API UNLReplayEventsCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UNLReplayEventsCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,26 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "NLStackBenchmarkCommandlet.generated.h"
+
+/**
+ * Microbenchmarks of the action stack algorithms whose cost grows with stack depth: ApplyPendingEvents with a response
+ * buried at the bottom of the stack (with and without the takeover scan calling OnRequestTakeover, and accepted),
+ * GetActionStack, GetActionStackView, GetActionOfClass, IsBelowMe, IsActionClassBelowMe, IsActionClassAboveMe, the
+ * linear class walk those class queries replaced (ClassScanReference) and chains of CHANGE, SUSPEND and DONE transitions. Results are nanoseconds per operation for each depth or chain length,
+ * optionally written as JSON.
+ *
+ * Usage: -run=NLStackBenchmark [-Depths=1,4,10,16,64] [-Iterations=20000] [-PoolActions] [-Output=<file.json>]
+ */
+UCLASS()
+class NEXTLIFE_API UNLStackBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UNLStackBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
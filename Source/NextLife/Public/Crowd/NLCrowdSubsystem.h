@@ -0,0 +1,297 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "AITypes.h"
+#include "Navigation/PathFollowingComponent.h"
+#include "NLTypes.h"
+
+#include "NLCrowdSubsystem.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * The tick function of a NextLife crowd
+ */
+USTRUCT()
+struct FNLCrowdTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	FNLCrowdTickFunction()
+		: Crowd(nullptr)
+	{}
+
+	// The crowd which owns this tick function
+	class UNLCrowdSubsystem* Crowd;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FNLCrowdTickFunction> : public TStructOpsTypeTraitsBase2<FNLCrowdTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+// The kinds of signals crowd agents receive, each is delivered as the event of the same name
+enum class ENLCrowdSignalType : uint8
+{
+	General_Message,
+	Sense_Sight,
+	Sense_SightLost,
+	Sense_Sound,
+	Sense_Contact,
+	Movement_MoveTo,
+	Movement_MoveToComplete,
+};
+
+// A signal waiting to be delivered to a crowd agent on the next crowd tick
+struct FNLCrowdSignal
+{
+	FNLCrowdSignal()
+		: Type(ENLCrowdSignalType::General_Message)
+		, Indirect(false)
+		, Location(FVector::ZeroVector)
+		, Value(0.0f)
+		, Flags(0)
+		, PayloadIndex(INDEX_NONE)
+		, MoveResult(EPathFollowingResult::Invalid)
+	{}
+
+	FNLCrowdAgentHandle Agent;
+	ENLCrowdSignalType Type;
+
+	// The sighted, lost, heard or contacted actor, or the move goal
+	TWeakObjectPtr<AActor> Subject;
+
+	// Sight
+	bool Indirect;
+
+	// Sound location and volume, move position and range
+	FVector Location;
+	float Value;
+	int32 Flags;
+
+	// The message or hit result in the crowds signal payloads
+	int32 PayloadIndex;
+
+	// Move complete
+	FAIRequestID RequestID;
+	EPathFollowingResult::Type MoveResult;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * NextLife Crowd
+ * Runs NextLife behaviors for crowd agents without an AI controller or brain component per agent. An agent is a
+ * behavior plus a location and an optional pawn, kept in arrays indexed by agent (see FNLCrowdAgentHandle).
+ *
+ * Agents are grouped into chunks of up to AgentsPerChunk agents running the same behavior class, and the crowd ticks a
+ * chunk at a time, so the same behavior and action code runs back to back. Sensing and movement events are sent to
+ * agents as signals which are queued and delivered together at the start of the next crowd tick.
+ *
+ * Crowd behaviors and actions are authored like any other. Their brain component and AI owner are null, GetPawnOwner
+ * returns the agents pawn if it has one, and the agents location is read and written through the crowd
+ * (see UNLBehavior::GetCrowd and UNLBehavior::GetCrowdAgent).
+ */
+UCLASS()
+class NEXTLIFE_API UNLCrowdSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+	UNLCrowdSubsystem();
+
+	virtual void Deinitialize() override;
+
+	// The most agents in a chunk
+	static constexpr int32 AgentsPerChunk = 64;
+
+	// The most transitions a crowd behavior applies per frame, see UNextLifeBrainComponent::MaxTransitionsPerFrame
+	int32 MaxTransitionsPerFrame;
+
+	/**
+	 * Adds an agent running a behavior. The behavior begins on the next crowd tick, agents added while the crowd ticks
+	 * join it at the end of the tick.
+	 * @param behaviorClass - The behavior the agent runs
+	 * @param location - Where the agent is
+	 * @param pawn - An optional pawn representing the agent, returned by GetPawnOwner in its actions
+	 */
+	FNLCrowdAgentHandle AddAgent(TSubclassOf<class UNLBehavior> behaviorClass, const FVector& location, class APawn* pawn = nullptr);
+
+	// Stops an agents behavior and removes it. Removing agents while the crowd ticks is deferred to the end of the tick.
+	void RemoveAgent(FNLCrowdAgentHandle agent);
+
+	// Is the agent in the crowd
+	bool IsAgentValid(FNLCrowdAgentHandle agent) const
+	{
+		return AgentSerials.IsValidIndex(agent.Index) && AgentSerials[agent.Index] == agent.Serial && AgentBehaviors[agent.Index] != nullptr;
+	}
+
+	// Agent data, the agent must be valid
+	class UNLBehavior* GetAgentBehavior(FNLCrowdAgentHandle agent) const
+	{
+		check(IsAgentValid(agent));
+		return AgentBehaviors[agent.Index];
+	}
+
+	class APawn* GetAgentPawn(FNLCrowdAgentHandle agent) const
+	{
+		check(IsAgentValid(agent));
+		return AgentPawns[agent.Index];
+	}
+
+	const FVector& GetAgentLocation(FNLCrowdAgentHandle agent) const
+	{
+		check(IsAgentValid(agent));
+		return AgentLocations[agent.Index];
+	}
+
+	void SetAgentLocation(FNLCrowdAgentHandle agent, const FVector& location)
+	{
+		check(IsAgentValid(agent));
+		AgentLocations[agent.Index] = location;
+	}
+
+	// True until the agents behavior ends
+	bool IsAgentRunning(FNLCrowdAgentHandle agent) const
+	{
+		return IsAgentValid(agent) && AgentRunning[agent.Index];
+	}
+
+	/**
+	 * Signals, delivered to the agent as the event of the same name on the next crowd tick
+	 */
+	void SignalMessage(FNLCrowdAgentHandle agent, class UNLGeneralMessage* message);
+	void SignalSight(FNLCrowdAgentHandle agent, class APawn* subject, bool indirect = false);
+	void SignalSightLost(FNLCrowdAgentHandle agent, class APawn* subject);
+	void SignalSound(FNLCrowdAgentHandle agent, class APawn* subject, const FVector& location, float volume, int32 flags = 0);
+	void SignalContact(FNLCrowdAgentHandle agent, class AActor* other, const FHitResult& hitResult);
+	void SignalMoveTo(FNLCrowdAgentHandle agent, const class AActor* goal, const FVector& pos, float range);
+	void SignalMoveToComplete(FNLCrowdAgentHandle agent, FAIRequestID requestID, EPathFollowingResult::Type result);
+
+	// Delivers signals and runs the behavior of every agent. Called from the crowd tick function.
+	void TickAgents(float deltaTime);
+
+	// Called by agent behaviors after applying a chain of action transitions
+	void RecordTransitions(int32 chainLength)
+	{
+		TransitionsThisTick += chainLength;
+	}
+
+	// The number of agents in the crowd
+	int32 GetAgentCount() const
+	{
+		return AgentCount;
+	}
+
+	// The number of chunks ticked during the last crowd tick
+	int32 GetLastTickChunkCount() const
+	{
+		return LastTickChunkCount;
+	}
+
+	// The number of signals delivered during the last crowd tick
+	int32 GetLastTickSignalCount() const
+	{
+		return LastTickSignalCount;
+	}
+
+	// The number of action transitions applied by agents during the last crowd tick
+	int32 GetLastTickTransitionCount() const
+	{
+		return LastTickTransitionCount;
+	}
+
+	// The time, in milliseconds, the last crowd tick took
+	float GetLastTickTimeMs() const
+	{
+		return LastTickTimeMs;
+	}
+
+protected:
+
+	// Agents running the same behavior class, ticked together. Chunks are removed once their last agent leaves.
+	struct FChunk
+	{
+		TWeakObjectPtr<UClass> BehaviorClass;
+		TArray<int32> Agents;
+	};
+
+	// Called when an agents behavior ends
+	UFUNCTION()
+	void OnAgentBehaviorEnded(class UNLBehavior* behavior);
+
+	// Queues a signal for a valid agent, returning it to be filled in
+	FNLCrowdSignal* AddSignal(FNLCrowdAgentHandle agent, ENLCrowdSignalType type);
+
+	// Sends a signal to its agent as an event, messages and hitResults are the payloads queued with the signal
+	void DeliverSignal(const FNLCrowdSignal& signal, const TArray<class UNLGeneralMessage*>& messages, const TArray<FHitResult>& hitResults);
+
+	// Removes an agent, the agent must be valid and the crowd not ticking
+	void RemoveAgentNow(FNLCrowdAgentHandle agent);
+
+	// Adds an agent to a chunk of its behavior class with room, removes it from its chunk
+	void AddAgentToChunk(int32 agentIndex, UClass* behaviorClass);
+	void RemoveAgentFromChunk(int32 agentIndex);
+
+	// Removes an empty chunk, moving the last chunk into its index. The crowd must not be ticking.
+	void RemoveChunk(int32 chunkIndex);
+
+	// Agent data, indexed by FNLCrowdAgentHandle::Index. Free indices have a null behavior.
+	UPROPERTY(Transient)
+	TArray<class UNLBehavior*> AgentBehaviors;
+
+	UPROPERTY(Transient)
+	TArray<class APawn*> AgentPawns;
+
+	TArray<FVector> AgentLocations;
+	TArray<int32> AgentSerials;
+	TBitArray<> AgentRunning;
+
+	// Where each agent is in the chunks
+	TArray<int32> AgentChunks;
+	TArray<int32> AgentChunkSlots;
+
+	// Agent indices ready for reuse
+	TArray<int32> FreeAgents;
+
+	// The chunks, and the chunks of each behavior class with room for more agents. Classes without open chunks have no
+	// entry.
+	TArray<FChunk> Chunks;
+	TMap<TWeakObjectPtr<UClass>, TArray<int32>> OpenChunksByClass;
+
+	// Signals waiting for the next tick and their payloads
+	TArray<FNLCrowdSignal> PendingSignals;
+
+	UPROPERTY(Transient)
+	TArray<class UNLGeneralMessage*> PendingMessages;
+
+	TArray<FHitResult> PendingHitResults;
+
+	// Agents added and removed while ticking
+	TArray<FNLCrowdAgentHandle> PendingAdds;
+	TArray<FNLCrowdAgentHandle> PendingRemovals;
+
+	// The tick function which ticks the agents
+	FNLCrowdTickFunction TickFunction;
+
+	// True while agents are being ticked
+	bool IsTicking;
+
+	int32 AgentCount;
+
+	// Transitions applied during the current tick
+	int32 TransitionsThisTick;
+
+	// Stats from the last tick
+	int32 LastTickChunkCount;
+	int32 LastTickSignalCount;
+	int32 LastTickTransitionCount;
+	float LastTickTimeMs;
+};
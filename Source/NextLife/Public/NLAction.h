@@ -3,6 +3,7 @@
 #pragma once
 
 #include "NLTypes.h"
+#include "NLEventOverrides.h"
 
 #include "NLAction.generated.h"
 
@@ -18,15 +19,29 @@ struct FNLActionResult
 	FNLActionResult()
 		: Change(ENLActionChangeType::NONE)
 		, Payload(nullptr)
+		, NativeType(nullptr)
 	{}
 
 	FNLActionResult(ENLActionChangeType change,
 					TSubclassOf<class UNLAction> action,
-					const FString& reason,
+					const FName reason,
 					class UNLActionPayload* payload = nullptr)
 		: Change(change)
 		, Action(action)
 		, Payload(payload)
+		, NativeType(nullptr)
+		, Reason(reason)
+	{}
+
+	FNLActionResult(ENLActionChangeType change,
+					TSubclassOf<class UNLAction> action,
+					const FName reason,
+					FNLStructPayload&& structPayload)
+		: Change(change)
+		, Action(action)
+		, Payload(nullptr)
+		, StructPayload(MoveTemp(structPayload))
+		, NativeType(nullptr)
 		, Reason(reason)
 	{}
 
@@ -42,11 +57,85 @@ struct FNLActionResult
 	UPROPERTY()
 	class UNLActionPayload* Payload;
 
-	// The reason for this response
+	// The struct payload sent with this result, an alternative to Payload which doesn't create an object
 	UPROPERTY()
-	FString Reason;
+	FNLStructPayload StructPayload;
+
+	// The native action type to run when Action is the native action host (see NLNativeAction.h)
+	const struct FNLNativeActionType* NativeType;
+
+	// The reason for this response, for debugging. Always None when NEXTLIFE_WITH_REASONS is off.
+	UPROPERTY()
+	FName Reason;
+};
+
+class FNLNativeAction;
+
+// The class of the action which runs native actions on the stack (see UNLNativeActionHost)
+NEXTLIFE_API UClass* NLGetNativeActionHostClass();
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * The action class and native action type results and event responses use to start an action type, which is either a
+ * UNLAction class or a native action (see FNLNativeAction)
+ */
+template<typename TAction, bool IsNative = TIsDerivedFrom<TAction, FNLNativeAction>::IsDerived>
+struct TNLActionTarget
+{
+	static UClass* GetClass()
+	{
+		return TAction::StaticClass();
+	}
+
+	static const FNLNativeActionType* GetNativeType()
+	{
+		return nullptr;
+	}
+};
+
+template<typename TAction>
+struct TNLActionTarget<TAction, true>
+{
+	static UClass* GetClass()
+	{
+		return NLGetNativeActionHostClass();
+	}
+
+	static const FNLNativeActionType* GetNativeType()
+	{
+		return TAction::StaticNativeType();
+	}
 };
 
+// Compile time check that a payload can be sent to an action type
+template<typename TAction, typename TPayload>
+void NLCheckPayloadType()
+{
+	static_assert(TIsDerivedFrom<TAction, class UNLAction>::IsDerived || TIsDerivedFrom<TAction, FNLNativeAction>::IsDerived,
+				  "The action must derive from UNLAction or FNLNativeAction");
+	static_assert(TIsSame<typename TAction::PayloadType, typename TDecay<TPayload>::Type>::Value,
+				  "The payload type does not match the PayloadType declared by the action");
+}
+
+// Makes a result starting an action type, see TNLActionTarget
+template<typename TAction>
+FNLActionResult NLMakeActionResult(ENLActionChangeType change, const FName reason, FNLStructPayload&& structPayload)
+{
+	FNLActionResult result(change, TNLActionTarget<TAction>::GetClass(), reason, MoveTemp(structPayload));
+	result.NativeType = TNLActionTarget<TAction>::GetNativeType();
+	return result;
+}
+
+// Makes an event response starting an action type, see TNLActionTarget
+template<typename TAction>
+FNLEventResponse NLMakeEventResponse(ENLActionChangeType change, ENLEventRequestPriority priority, const FName reason,
+									 FNLStructPayload&& structPayload, const ENLSuspendBehavior suspendBehavior = ENLSuspendBehavior::NORMAL)
+{
+	FNLEventResponse response(change, priority, TNLActionTarget<TAction>::GetClass(), reason, MoveTemp(structPayload), suspendBehavior);
+	response.NativeType = TNLActionTarget<TAction>::GetNativeType();
+	return response;
+}
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
  * Base Action : An action is something the AI should do to complete a task
@@ -62,6 +151,10 @@ public:
 	/// Behaviors control us
 	friend class UNLBehavior;
 
+	/// The struct payload type this action expects to be started with (see ChangeTo<>, SuspendFor<>, GetStructPayload).
+	/// Actions which are started with a struct payload should redeclare this with their payload struct.
+	typedef void PayloadType;
+
 	/// Get the current short description. Could evolve depending on internal action state.
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
 	virtual FString GetShortDescription() const
@@ -69,107 +162,29 @@ public:
 		return ActionShortDescription;
 	}
 
-	/// Gets the previous action
+	/// Gets the previous action, the action below this one in the stack
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	UNLAction* GetPreviousAction() const
-	{
-		return PreviousAction;
-	}
+	UNLAction* GetPreviousAction() const;
 
-	/// Gets the next action
+	/// Gets the next action, the action above this one in the stack
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	UNLAction* GetNextAction() const
-	{
-		return NextAction;
-	}
+	UNLAction* GetNextAction() const;
 
 	/// Determine if an action is below me
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	bool IsBelowMe(const UNLAction* otherAction) const
-	{
-		if(otherAction == this)
-		{
-			return false;
-		}
-
-		const UNLAction* previous = PreviousAction;
-		while(previous)
-		{
-			if(previous == otherAction)
-			{
-				return true;
-			}
-			previous = previous->PreviousAction;
-		}
-
-		return false;
-	}
+	bool IsBelowMe(const UNLAction* otherAction) const;
 
 	/// Is an action of a class below this action
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	bool IsActionClassBelowMe(TSubclassOf<UNLAction> actionClass) const
-	{
-		if(!actionClass)
-		{
-			return false;
-		}
-
-		const UNLAction* previous = PreviousAction;
-		while(previous)
-		{
-			if(previous->GetClass()->IsChildOf(actionClass))
-			{
-				return true;
-			}
-			previous = previous->PreviousAction;
-		}
-
-		return false;
-	}
+	bool IsActionClassBelowMe(TSubclassOf<UNLAction> actionClass) const;
 
 	/// Determine if an action is above me
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	bool IsAboveMe(const UNLAction* otherAction) const
-	{
-		if(otherAction == this)
-		{
-			return false;
-		}
-
-		const UNLAction* next = NextAction;
-		while(next)
-		{
-			if(next == otherAction)
-			{
-				return true;
-			}
-			next = next->NextAction;
-		}
-
-		return false;
-	}
+	bool IsAboveMe(const UNLAction* otherAction) const;
 
 	/// Is an action of a class above this action
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	bool IsActionClassAboveMe(TSubclassOf<UNLAction> actionClass) const
-	{
-		if(!actionClass)
-		{
-			return false;
-		}
-
-		const UNLAction* next = NextAction;
-		while(next)
-		{
-			if(next->GetClass()->IsChildOf(actionClass))
-			{
-				return true;
-			}
-			next = next->NextAction;
-		}
-
-		return false;
-	}
+	bool IsActionClassAboveMe(TSubclassOf<UNLAction> actionClass) const;
 
 	/// Gets the pawn which is being controlled by the AI controller which is running NextLife as the AI brain.
 	/// If you are getting the pawn owner to cast it to a specific class to get information, perhaps consider using a blackboard instead.
@@ -196,21 +211,67 @@ public:
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
 	class UBlackboardComponent* GetBlackboard() const;
 
+	/**
+	 * Gets the struct payload this action was started with.
+	 * Returns null if the action was not started with a struct payload of this type.
+	 */
+	template<typename TPayload>
+	const TPayload* GetStructPayload() const
+	{
+		return StartStructPayload.Get<TPayload>();
+	}
+
+	/// Can an event be called through its native implementation, skipping the Blueprint event thunk (see FNLEventOverrides)
+	FORCEINLINE bool CallsEventDirectly(ENLOverridableEvents event) const
+	{
+		return EnumHasAnyFlags(DirectEvents, event);
+	}
+
+	/// Does this action receive the events of an event set interface. True if its class implements the interface.
+	virtual bool ListensTo(const UClass* eventInterface) const
+	{
+		return GetClass()->ImplementsInterface(eventInterface);
+	}
+
 	/**
 	* Is this action currently the top action
 	*/
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action")
-	FORCEINLINE bool IsTopAction() const
+	bool IsTopAction() const;
+
+	/**
+	 * Can this actions update be run off the game thread (see UpdateIsThreadSafe)
+	 * Blueprint actions are never updated off the game thread.
+	 */
+	bool CanUpdateOffGameThread() const
 	{
-		return NextAction == nullptr;
+		return UpdateIsThreadSafe && !GetClass()->HasAnyClassFlags(CLASS_CompiledFromBlueprint);
 	}
 
 protected:
 
+	virtual void PostInitProperties() override;
+
+	/**
+	 * Set to true in the constructor of native actions whose OnUpdate_Implementation is thread safe.
+	 * When parallel behavior updates are enabled, the update of these actions can run on worker threads along with
+	 * the updates of other brains. A thread safe update must only read from its own behavior, action stack and pawn and
+	 * should not create or destroy objects. The returned result is still applied on the game thread.
+	 */
+	bool UpdateIsThreadSafe;
+
 	/// A short description about the action. Used in debug spew so it is best to keep this simple, maybe three words max.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Action")
 	FString ActionShortDescription;
 
+	/// How requests from actions below this action are accepted. Anything but CUSTOM decides without calling OnRequestEvent.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Action|Requests")
+	FNLRequestEventPolicy RequestEventPolicy;
+
+	/// How requests from actions below this action are taken over. Anything but CUSTOM decides without calling OnRequestTakeover.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Action|Requests")
+	FNLRequestTakeoverPolicy RequestTakeoverPolicy;
+
 	/**
 	 * Called when this action is about to be serialized (for a save game)
 	 * Useful for setting up save game variables (extra information for when the game is loaded to get things back in order)
@@ -226,8 +287,9 @@ protected:
 	/**
 	* Starts this action and sets its previous action pointer.
 	* This could start a new action to immediately be started which will be reflected in the result.
+	* The struct payload is moved into the action before OnStart so it can be read with GetStructPayload.
 	*/
-	FNLActionResult InvokeOnStart(UNLActionPayload* payload);
+	FNLActionResult InvokeOnStart(UNLActionPayload* payload, FNLStructPayload&& structPayload = FNLStructPayload());
 
 	/**
 	 * The primary action update call steps (each step could occur over multiple frames depending changes in state):
@@ -252,6 +314,12 @@ protected:
 	 */
 	FNLActionResult InvokeUpdate(float deltaSeconds);
 
+	/**
+	 * Same as InvokeUpdate but callable off the game thread, only for actions which CanUpdateOffGameThread.
+	 * This calls the native update directly.
+	 */
+	FNLActionResult InvokeUpdateOffGameThread(float deltaSeconds);
+
 	/**
 	* Suspends this action possibly causing the action to complete. If this invoke returns false, the suspend cannot
 	* occur and the action should be ended. Any action which return false on suspend should expect an OnEnd invoke shortly after.
@@ -266,9 +334,28 @@ protected:
 
 	/**
 	* Ends the action and action children and any actions above this action.
+	* If the behavior pools actions, the ended actions are returned to the pool.
 	*/
 	void InvokeOnDone(const UNLAction* nextAction);
 
+	/**
+	 * Resets this action so it can be reused from the behaviors action pool.
+	 * Clears the action stack state then calls OnReset to clear user state.
+	 */
+	void InvokeOnReset();
+
+	/**
+	 * Asks this action if a lower actions event request can go through.
+	 * Decided by RequestEventPolicy, calling OnRequestEvent if the policy is CUSTOM.
+	 */
+	bool InvokeOnRequestEvent(const FNLEventResponse& eventRequested, UNLAction* requester);
+
+	/**
+	 * Asks this action to take over an event request.
+	 * Decided by RequestTakeoverPolicy, calling OnRequestTakeover if the policy is CUSTOM.
+	 */
+	bool InvokeOnRequestTakeover(const FNLEventResponse& eventRequested, UNLAction* requester, bool& keepChildActions);
+
 	/**
 	 * Start the action, the result will be immediately processed which could cause an immediate transition to another action.
 	 * If a transition occurs, those new actions will follow the same rule of Start and immediate processing.
@@ -332,6 +419,7 @@ protected:
 	 * and can refuse the event with the return response, true being accept, false being refuse.
 	 * NOTE: If this is a simple additive action, it might be meaningful to return true always to let other actions know
 	 *		 it can be overriden.
+	 * NOTE: Only called when RequestEventPolicy is CUSTOM.
 	 */
 	UFUNCTION(BlueprintNativeEvent, Category = "NextLife|Action")
 	bool OnRequestEvent(const FNLEventResponse &eventRequested, UNLAction* requester);
@@ -348,6 +436,7 @@ protected:
 	 * Asks an action to take over an events request.
 	 * If true is returned, this action took the payload and the request should be dropped.
 	 * If you want this takeover to also take over the action stack (make this action the current action finishing actions above it) set keepChildActions to false.
+	 * NOTE: Only called when RequestTakeoverPolicy is CUSTOM.
 	 */
 	UFUNCTION(BlueprintNativeEvent, Category = "NextLife|Action")
 	bool OnRequestTakeover(const FNLEventResponse &eventRequested, UNLAction* requester, bool& keepChildActions);
@@ -357,6 +446,15 @@ protected:
 		return false;
 	}
 
+	/**
+	 * Called when a pooled action is about to be reused (see UNLBehavior::PoolActions).
+	 * Any state kept in the action should be put back the way it was when the action was first created.
+	 * By default, every property declared below UNLAction is copied back from the class default object.
+	 */
+	UFUNCTION(BlueprintNativeEvent, Category = "NextLife|Action")
+	void OnReset();
+	virtual void OnReset_Implementation();
+
 	/**
 	* Asks an action to take over an events request.
 	* If true is returned, this action took the payload and the request should be dropped.
@@ -381,7 +479,7 @@ protected:
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action Result")
 	FNLActionResult ChangeTo(TSubclassOf<class UNLAction> action, UNLActionPayload* payload, const FString& reason = TEXT(""))
 	{
-		return FNLActionResult(ENLActionChangeType::CHANGE, action, reason, payload);
+		return FNLActionResult(ENLActionChangeType::CHANGE, action, MakeReason(reason), payload);
 	}
 
 	/**
@@ -391,14 +489,51 @@ protected:
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action Result")
 	FNLActionResult SuspendFor(TSubclassOf<class UNLAction> action, UNLActionPayload* payload, const FString& reason = TEXT(""))
 	{
-		return FNLActionResult(ENLActionChangeType::SUSPEND, action, reason, payload);
+		return FNLActionResult(ENLActionChangeType::SUSPEND, action, MakeReason(reason), payload);
+	}
+
+	/**
+	 * Change this action to a new action started with a struct payload.
+	 * The payload type must be the PayloadType declared by the action, which can be a UNLAction class or a native action.
+	 */
+	template<typename TAction, typename TPayload, int32 N = 1>
+	FNLActionResult ChangeTo(TPayload&& payload, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeActionResult<TAction>(ENLActionChangeType::CHANGE, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)));
+	}
+
+	/**
+	 * Suspend this action for another started with a struct payload.
+	 * The payload type must be the PayloadType declared by the action, which can be a UNLAction class or a native action.
+	 */
+	template<typename TAction, typename TPayload, int32 N = 1>
+	FNLActionResult SuspendFor(TPayload&& payload, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeActionResult<TAction>(ENLActionChangeType::SUSPEND, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)));
+	}
+
+	/**
+	 * Change this action to, or suspend it for, an action without a payload, which can be a UNLAction class or a native action
+	 */
+	template<typename TAction>
+	FNLActionResult ChangeTo()
+	{
+		return NLMakeActionResult<TAction>(ENLActionChangeType::CHANGE, NAME_None, FNLStructPayload());
+	}
+
+	template<typename TAction>
+	FNLActionResult SuspendFor()
+	{
+		return NLMakeActionResult<TAction>(ENLActionChangeType::SUSPEND, NAME_None, FNLStructPayload());
 	}
 
 	// The action is done
 	UFUNCTION(BlueprintPure, Category = "NextLife|Action Result")
 	FNLActionResult Done(const FString& reason = TEXT(""))
 	{
-		return FNLActionResult(ENLActionChangeType::DONE, nullptr, reason);
+		return FNLActionResult(ENLActionChangeType::DONE, nullptr, MakeReason(reason));
 	}
 
 	// Return response to continue (no request being made, let the parent actions handle this event)
@@ -422,7 +557,7 @@ protected:
 								 const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY,
 								 const FString& reason = TEXT(""))
 	{
-		return FNLEventResponse(ENLActionChangeType::CHANGE, priority, action, reason, payload);
+		return FNLEventResponse(ENLActionChangeType::CHANGE, priority, action, MakeReason(reason), payload);
 	}
 
 	/**
@@ -439,7 +574,33 @@ protected:
 								   const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY,
 								   const FString& reason = TEXT(""), const ENLSuspendBehavior suspendBehavior = ENLSuspendBehavior::NORMAL)
 	{
-		return FNLEventResponse(ENLActionChangeType::SUSPEND, priority, action, reason, payload, suspendBehavior);
+		return FNLEventResponse(ENLActionChangeType::SUSPEND, priority, action, MakeReason(reason), payload, suspendBehavior);
+	}
+
+	/**
+	 * Return response to request a change to another action started with a struct payload.
+	 * The payload type must be the PayloadType declared by the action, which can be a UNLAction class or a native action.
+	 */
+	template<typename TAction, typename TPayload, int32 N = 1>
+	FNLEventResponse TryChangeTo(TPayload&& payload,
+								 const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY,
+								 const TCHAR (&reason)[N] = TEXT(""))
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeEventResponse<TAction>(ENLActionChangeType::CHANGE, priority, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)));
+	}
+
+	/**
+	 * Return response to request a suspension to another action started with a struct payload.
+	 * The payload type must be the PayloadType declared by the action, which can be a UNLAction class or a native action.
+	 */
+	template<typename TAction, typename TPayload, int32 N = 1>
+	FNLEventResponse TrySuspendFor(TPayload&& payload,
+								   const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY,
+								   const TCHAR (&reason)[N] = TEXT(""), const ENLSuspendBehavior suspendBehavior = ENLSuspendBehavior::NORMAL)
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeEventResponse<TAction>(ENLActionChangeType::SUSPEND, priority, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)), suspendBehavior);
 	}
 
 	/**
@@ -451,26 +612,32 @@ protected:
 	UFUNCTION(BlueprintPure, Category = "NextLife|Event Response")
 	FNLEventResponse TryDone(const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY, const FString& reason = TEXT(""))
 	{
-		return FNLEventResponse(ENLActionChangeType::DONE, priority, nullptr, reason);
+		return FNLEventResponse(ENLActionChangeType::DONE, priority, nullptr, MakeReason(reason));
 	}
 
 private:
 
+	// Interns a reason given from Blueprint. These are often built at runtime, so they are only kept while the brain
+	// running this action logs its state or records its transitions.
+	FName MakeReason(const FString& reason) const;
+
+	// The struct payload this action was started with
+	UPROPERTY(Transient)
+	FNLStructPayload StartStructPayload;
+
 	// Has this action had its OnStart function called yet?
 	UPROPERTY(SaveGame)
 	bool HasStarted;
 	
-	// The action which started us in the stack that we will resume to when we finish
-	UPROPERTY(SaveGame)
-	UNLAction* PreviousAction;
-
-	// The action which we started
-	// This is not saved, only the previous action is. The pointer is fixed up OnSaveRestore.
-	UPROPERTY()
-	UNLAction* NextAction;
+	// The index of this action in its behaviors action stack (see UNLBehavior::GetActionStackView), the root action
+	// being 0. INDEX_NONE when the action isn't on a stack. This is not saved, it is fixed up OnSaveRestore.
+	int32 StackDepth;
 
-	// The response caused by an event in this action
-	// Can be superseeded by other action event responses of a higher priority
+	// The action below this one, only loaded from save games made before behaviors kept their action stack. The stack
+	// is rebuilt from these links OnSaveRestore, which clears them.
 	UPROPERTY(SaveGame)
-	FNLEventResponse EventResponse;
+	UNLAction* PreviousAction_DEPRECATED;
+
+	// The events of this actions class called without the Blueprint event thunk, looked up when the action is created
+	ENLOverridableEvents DirectEvents;
 };
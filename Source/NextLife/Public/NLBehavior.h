@@ -3,6 +3,8 @@
 #pragma once
 
 #include "NLTypes.h"
+#include "NLAction.h"
+#include "NLNativeAction.h"
 
 // Baseline event sets
 #include "EventSets/NLGeneralEvents.h"
@@ -11,12 +13,14 @@
 
 #include "NLBehavior.generated.h"
 
+enum class ENLTransitionRecordType : uint8;
+
 // DOCUMENTATION
 /**
  * Events
  * -------------------
  * When an event occurs it is iterated to each action starting from the top of the stack. If an action responds to
- * the event, iteration stops and the event response is stored in the action.
+ * the event, iteration stops and the event response is stored in the behaviors pending responses for that action.
  *
  * When a behavior is ticked, events are first processed.
  * The top actions events are immediately processed.
@@ -28,6 +32,66 @@
 // On behavior actions complete
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FNLOnBehaviorEnded, class UNLBehavior*, endedBehavior);
 
+// Actions listening to an event interface, in stack order (top of the stack last)
+typedef TArray<class UNLAction*, TInlineAllocator<8>> FNLActionListenerList;
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Ended actions of a single class waiting to be reused
+ */
+USTRUCT()
+struct FNLActionPoolEntry
+{
+	GENERATED_BODY()
+
+	UPROPERTY(Transient)
+	TArray<class UNLAction*> Actions;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * What the behavior keeps about each action on its stack, next to the action itself so stack queries read contiguous
+ * memory instead of visiting every action
+ */
+struct FNLActionStackSlot
+{
+	explicit FNLActionStackSlot(const UClass* actionClass)
+		: Class(actionClass)
+	{}
+
+	// The class of the action
+	const UClass* Class;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * An event response waiting in an action on the stack to be applied
+ */
+USTRUCT()
+struct FNLPendingEventResponse
+{
+	GENERATED_BODY()
+
+	FNLPendingEventResponse()
+		: Action(nullptr)
+	{}
+
+	FNLPendingEventResponse(class UNLAction* action, FNLEventResponse&& response)
+		: Action(action)
+		, Response(MoveTemp(response))
+	{}
+
+	// The action which responded
+	UPROPERTY(SaveGame)
+	class UNLAction* Action;
+
+	UPROPERTY(SaveGame)
+	FNLEventResponse Response;
+};
+
+// Stack positions of the actions of one class, lowest first
+typedef TArray<int32, TInlineAllocator<4>> FNLActionClassPositions;
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
  * Base Behavior
@@ -43,7 +107,14 @@ class NEXTLIFE_API UNLBehavior : public UObject
 public:
     UNLBehavior();
 
+	/// Actions end themselves and query the stack
+	friend class UNLAction;
+
+	/// Crowds run behaviors for their agents
+	friend class UNLCrowdSubsystem;
+
 	virtual void BeginDestroy() override;
+	virtual void PostInitProperties() override;
 
 	UPROPERTY(BlueprintAssignable)
 	FNLOnBehaviorEnded OnBehaviorEnded;
@@ -52,10 +123,40 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Behavior")
 	TSubclassOf<class UNLAction> InitialActionClass;
 
+	// If true, ended actions are kept and reused for new actions of the same class instead of creating a new action
+	// object for every CHANGE and SUSPEND. Reused actions are reset via UNLAction::OnReset before they start.
+	// Actions should not be referenced after they are done when this is enabled.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Behavior")
+	bool PoolActions;
+
+	// The maximum number of ended actions kept for reuse per action class
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Behavior", meta = (EditCondition = "PoolActions", ClampMin = "1"))
+	int32 MaxPooledActionsPerClass;
+
+	// If true, this behavior is not chosen while the NextLife tick manager is overloaded (see NextLife.Budget.Ms).
+	// Only used by the default UNextLifeBrainComponent::ShouldChooseBehavior.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Behavior")
+	bool LowPriority;
+
 	// Get the owning brain component
 	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
 	class UNextLifeBrainComponent* GetBrainComponent() const;
 
+	// Can an event be called through its native implementation, skipping the Blueprint event thunk (see FNLEventOverrides)
+	FORCEINLINE bool CallsEventDirectly(ENLOverridableEvents event) const
+	{
+		return EnumHasAnyFlags(DirectEvents, event);
+	}
+
+	// Get the owning crowd, null unless this behavior is run by a crowd agent
+	class UNLCrowdSubsystem* GetCrowd() const;
+
+	// The crowd agent running this behavior, not set unless this behavior is run by a crowd
+	FNLCrowdAgentHandle GetCrowdAgent() const
+	{
+		return CrowdAgent;
+	}
+
 	// Gets the world time associated with the AI being driven by this behavior
 	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
 	float GetWorldTimeSeconds() const;
@@ -64,19 +165,40 @@ public:
 	void OnSaveRestored();
 
 	/**
-	 * Puts together the current action stack into an array
+	 * Copies the current action stack into an array
 	 * Return true if the stack is valid (Behavior has begun and had an initial action)
-	 * The returned array is ordered as the first action first, the current active action last
+	 * The returned array is ordered as the current active action first, the root action last
 	 */
 	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
 	bool GetActionStack(TArray<class UNLAction*>& actionStackOut) const;
 
+	/**
+	 * The current action stack without copying it, ordered as the root action first, the current active action last.
+	 * The view is invalidated by the next transition.
+	 */
+	TArrayView<class UNLAction* const> GetActionStackView() const
+	{
+		return Action ? TArrayView<UNLAction* const>(ActionStack.GetData(), Action->StackDepth + 1) : TArrayView<UNLAction* const>();
+	}
+
 	// Begins this behavior (creates the initial action and starts it, possibly causing a chain reaction of actions to stack).
 	virtual void BeginBehavior();
 
 	// Run this behavior. Called from the NextLife Brain Component.
 	virtual void RunBehavior(float deltaSeconds);
 
+	/**
+	 * The first step of RunBehavior, used when the action update is run separately (parallel updates).
+	 * Applies pending events and returns true if there is a top action ready to be updated.
+	 */
+	bool BeginRunBehavior();
+
+	/**
+	 * The last step of RunBehavior, used when the action update is run separately (parallel updates).
+	 * Applies the top actions update result.
+	 */
+	void FinishRunBehavior(struct FNLActionResult&& updateResult);
+
 	// Sets all events into a paused state.
 	// This prevents new events from propagating to actions.
 	void SetEventsPausedState(bool pausedState)
@@ -119,6 +241,34 @@ public:
 	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
 	UNLAction* GetActionOfClass(TSubclassOf<UNLAction> actionClass) const;
 
+	// The number of actions created by reusing a pooled action
+	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
+	int32 GetActionPoolHits() const
+	{
+		return ActionPoolHits;
+	}
+
+	// The number of actions which had to be created because no pooled action was available
+	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
+	int32 GetActionPoolMisses() const
+	{
+		return ActionPoolMisses;
+	}
+
+	// The number of ended actions currently waiting in the pool
+	UFUNCTION(BlueprintPure, Category = "NextLife|Behavior")
+	int32 GetPooledActionCount() const;
+
+	// Returns an ended action to the pool so it can be reused. Called by actions when they are done.
+	// Native actions are destroyed and their host is always kept for reuse.
+	void ReleaseAction(class UNLAction* action);
+
+	// The arena native actions of this behavior are allocated from
+	const FNLNativeActionArena& GetNativeActionArena() const
+	{
+		return NativeActionArena;
+	}
+
 	/**
 	 * Stops the behavior. Tears down the action stack gracefully by ending each action. Acts like the behavior ended if callBehaviorEnded is true.
 	 * @param callBehaviorEnded - Should this call fire the OnBehaviorEnded event?
@@ -161,10 +311,93 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Behavior")
 	FString BehaviorShortName;
 
+	/**
+	 * Puts a new action on the top of the stack, above the current top action, and registers it for the events it implements
+	 */
+	void PushAction(class UNLAction* newAction);
+
+	/**
+	 * Removes the top action of the stack, which must be the ending action. Called by actions when they are done.
+	 */
+	void PopAction(class UNLAction* endingAction);
+
+	// The actions next to an action on the stack, null at either end
+	FORCEINLINE class UNLAction* GetActionBelow(const class UNLAction* action) const
+	{
+		return action->StackDepth > 0 ? ActionStack[action->StackDepth - 1] : nullptr;
+	}
+
+	FORCEINLINE class UNLAction* GetActionAbove(const class UNLAction* action) const
+	{
+		return action->StackDepth + 1 < ActionStack.Num() ? ActionStack[action->StackDepth + 1] : nullptr;
+	}
+
+	/**
+	 * Returns the stack positions of the actions which are, or derive from, the class. Null if there are none.
+	 */
+	FORCEINLINE const FNLActionClassPositions* FindActionClassPositions(const UClass* actionClass) const
+	{
+		const FNLActionClassPositions* positions = ActionClassPositions.Find(actionClass);
+		return positions && positions->Num() > 0 ? positions : nullptr;
+	}
+
+	/**
+	 * Resets the action stack, its slots and its class index
+	 */
+	void ResetActionStack();
+
+	/**
+	 * Adds or removes a stack position under the class of an action and each of its super classes
+	 */
+	void IndexActionClass(const UClass* actionClass, int32 stackIndex);
+	void UnindexActionClass(const UClass* actionClass, int32 stackIndex);
+
+	/**
+	 * Sets the event response waiting in an action on the stack, a none response clears it
+	 */
+	void SetEventResponse(class UNLAction* action, FNLEventResponse&& response);
+
+	/**
+	 * The event response waiting in an action, null if there is none
+	 */
+	FNLPendingEventResponse* FindPendingResponse(const class UNLAction* action)
+	{
+		return PendingResponses.FindByPredicate([action](const FNLPendingEventResponse& pending) { return pending.Action == action; });
+	}
+
+	/**
+	 * Adds an action to the listener lists of the event interfaces it implements
+	 */
+	void RegisterActionListener(class UNLAction* action);
+
+	/**
+	 * Removes an ended action from the listener lists. Called by actions when they are done.
+	 */
+	void UnregisterActionListener(class UNLAction* action);
+
+	/**
+	 * Clears all the listener lists, used when the stack is torn down
+	 */
+	void ClearActionListeners();
+
+	/**
+	 * Should a listener get events. Actions above the current top action are ending and don't get events.
+	 */
+	bool IsActiveListener(const class UNLAction* listener) const;
+
+	/**
+	 * Creates a new action of a class for this behavior, reusing a pooled action if there is one.
+	 * For the native action host class, a host runs a new native action of nativeType.
+	 */
+	class UNLAction* CreateAction(TSubclassOf<class UNLAction> actionClass, const FNLNativeActionType* nativeType = nullptr);
+
 	/**
 	 * Applies the current action result to the current TOP action possibly modifying the current set TOP action
+	 * The result is consumed, its struct payload is moved into the started action.
+	 * Results from starting and resuming actions are applied in a loop. Once the brains MaxTransitionsPerFrame is
+	 * reached the remaining result is deferred to the next run.
 	 */
-	UNLAction* ApplyActionResult(const struct FNLActionResult& result, bool fromRequest);
+	UNLAction* ApplyActionResult(struct FNLActionResult&& result, bool fromRequest);
 
 	/**
 	 * When an event occurs and an action accept it with a result this is called to store the event result for processing
@@ -173,7 +406,22 @@ protected:
 	 */
 	UFUNCTION(BlueprintCallable, Category = "NextLife|Behavior")
 	bool HandleEventResponse(UNLAction* respondingAction, const FName eventName, const struct FNLEventResponse& response);
+
+	/**
+	 * Native version of HandleEventResponse. The response is moved into the pending responses if it is stored,
+	 * so events can be handled without copying the response. Responses of actions not on the stack are not stored.
+	 * @return True if the event was handled
+	 */
+	bool StoreEventResponse(UNLAction* respondingAction, const FName eventName, struct FNLEventResponse&& response);
 	
+	/**
+	 * Adds a record to the brains transition history if it is recording
+	 */
+	void RecordTransition(ENLTransitionRecordType type, const UClass* fromClass, const UClass* toClass,
+						  const FName eventName = NAME_None, const FName reason = NAME_None,
+						  ENLActionChangeType change = ENLActionChangeType::NONE,
+						  ENLEventRequestPriority priority = ENLEventRequestPriority::NONE);
+
 	/**
 	 * Apply pending events in the action stack and return the new top level action
 	 */
@@ -181,15 +429,68 @@ protected:
 
 	/**
 	 * Creates an action result from an event response
-	 * Used when applying events
+	 * Used when applying events. The response payload is moved into the result.
 	 */
-	static void CreateActionResultFromEvent(const FNLEventResponse& response, FNLActionResult& actionResultOut);
+	static void CreateActionResultFromEvent(FNLEventResponse&& response, FNLActionResult& actionResultOut);
 	
 	// The current TOP action
 	UPROPERTY(SaveGame) // BlueprintReadOnly, Category = "Behavior", 
 	class UNLAction* Action;
 
+	// The action stack, the root action first. Actions above Action are ending. An action's StackDepth is its index.
+	UPROPERTY(SaveGame)
+	TArray<class UNLAction*> ActionStack;
+
+	// The slot of each action in ActionStack, at the same index
+	TArray<FNLActionStackSlot, TInlineAllocator<8>> ActionSlots;
+
+	// The event responses waiting in actions on the stack, at most one per action in no particular order. Usually empty,
+	// so frames without events don't look at the stack at all.
+	UPROPERTY(SaveGame)
+	TArray<FNLPendingEventResponse> PendingResponses;
+
+	// The stack positions of every action class on the stack and their super classes, for constant time class queries.
+	// Positions are only added and removed at the top, so they stay sorted. Emptied entries are kept for reuse.
+	TMap<const UClass*, FNLActionClassPositions> ActionClassPositions;
+
 	// If paused, events will not be accepted
 	UPROPERTY(SaveGame)
 	bool EventsPaused;
+
+	// A result left over when the brains MaxTransitionsPerFrame was reached, applied first on the next run
+	UPROPERTY(Transient)
+	FNLActionResult DeferredResult;
+	bool HasDeferredResult;
+	bool DeferredResultFromRequest;
+
+	// Transitions applied during TransitionFrame, checked against the brains MaxTransitionsPerFrame
+	uint64 TransitionFrame;
+	int32 TransitionsThisFrame;
+
+	// Actions on the stack which implement each event interface, so events only visit actions that handle them.
+	// Kept up to date as actions are pushed and ended. The stack keeps these actions referenced.
+	FNLActionListenerList GeneralEventListeners;
+	FNLActionListenerList SensingEventListeners;
+	FNLActionListenerList MovementEventListeners;
+
+	// Ended actions waiting to be reused, by action class
+	UPROPERTY(Transient)
+	TMap<UClass*, FNLActionPoolEntry> ActionPool;
+
+	// Native action hosts which are not running a native action, reused by any native action type
+	UPROPERTY(Transient)
+	TArray<class UNLNativeActionHost*> NativeActionHosts;
+
+	// Where the native actions are allocated
+	FNLNativeActionArena NativeActionArena;
+
+	// Pool stats
+	int32 ActionPoolHits;
+	int32 ActionPoolMisses;
+
+	// The crowd agent running this behavior, set by the crowd
+	FNLCrowdAgentHandle CrowdAgent;
+
+	// The events of this behaviors class called without the Blueprint event thunk, looked up when the behavior is created
+	ENLOverridableEvents DirectEvents;
 };
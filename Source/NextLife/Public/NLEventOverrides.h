@@ -0,0 +1,93 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * The Blueprint native events of actions and event sets which can be called without their Blueprint event thunk.
+ * Each value is named after its event.
+ */
+enum class ENLOverridableEvents : uint32
+{
+	NONE = 0,
+
+	// Actions
+	OnStart = 1 << 0,
+	OnUpdate = 1 << 1,
+	OnSuspend = 1 << 2,
+	OnResume = 1 << 3,
+	OnDone = 1 << 4,
+	OnRequestEvent = 1 << 5,
+	OnRequestTakeover = 1 << 6,
+	OnReset = 1 << 7,
+
+	// Event sets
+	General_Message = 1 << 8,
+	Sense_Sight = 1 << 9,
+	Sense_SightLost = 1 << 10,
+	Sense_Sound = 1 << 11,
+	Sense_Contact = 1 << 12,
+	Movement_MoveTo = 1 << 13,
+	Movement_MoveToComplete = 1 << 14,
+};
+ENUM_CLASS_FLAGS(ENLOverridableEvents)
+
+/**
+ * Calls an event set event on an action or behavior. When its class implements the event natively and Blueprint does
+ * not override it the native implementation is called directly, skipping the Execute_ lookup and ProcessEvent.
+ * Usage: NL_CALL_EVENT(INLSensingEvents, action, Sense_Sight, subject, indirect)
+ */
+#define NL_CALL_EVENT(EventSet, Object, Event, ...) \
+	((Object)->CallsEventDirectly(ENLOverridableEvents::Event) \
+		? Cast<EventSet>(Object)->Event##_Implementation(__VA_ARGS__) \
+		: EventSet::Execute_##Event((Object), __VA_ARGS__))
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Registry of how the classes of actions and behaviors implement their Blueprint native events.
+ * An event is direct for a class when it is implemented natively (the class, or one of its super classes, implements
+ * its event set in C++) and no Blueprint class in its hierarchy overrides it. Direct events are called through their
+ * virtual _Implementation function instead of the event thunk.
+ *
+ * The registry is built for the loaded action and behavior classes once the engine has started, classes loaded after
+ * that are added as their assets load, and any other class is added the first time it is asked about. Actions and
+ * behaviors look up their class once, when they are created (see UNLAction::CallsEventDirectly).
+ */
+class NEXTLIFE_API FNLEventOverrides
+{
+public:
+	// Hooks the registry into the engine, called by the module
+	static void Startup();
+	static void Shutdown();
+
+	// The direct events of a class, adding the class to the registry if it isn't there yet
+	static ENLOverridableEvents GetDirectEvents(const UClass* objectClass);
+
+	// The number of classes in the registry
+	static int32 GetClassCount();
+
+private:
+	// Works out the direct events of a class
+	static ENLOverridableEvents FindDirectEvents(const UClass* objectClass);
+
+	// Adds every loaded action and behavior class
+	static void RegisterLoadedClasses();
+
+	// Engine hooks
+	static void OnPostEngineInit();
+	static void OnAssetLoaded(UObject* asset);
+	static void OnPostGarbageCollect();
+	static void OnPreWorldInitialization();
+
+	struct FClassEntry
+	{
+		// Tells if the class was collected, its pointer could be reused by another class
+		TWeakObjectPtr<const UClass> Class;
+		ENLOverridableEvents DirectEvents;
+	};
+
+	static TMap<const UClass*, FClassEntry> Classes;
+};
@@ -0,0 +1,225 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Navigation/PathFollowingComponent.h"
+
+class UNextLifeBrainComponent;
+class UNLGeneralMessage;
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * What an event recording entry describes
+ */
+enum class ENLRecordedEventType : uint8
+{
+	// The brain updated its behaviors. Events recorded before an update were received before it.
+	Update,
+	// Brain logic and behavior changes
+	StartLogic,
+	StopLogic,
+	PauseLogic,
+	ResumeLogic,
+	AddBehavior,
+	RemoveBehavior,
+	// Events delivered to the brain
+	GeneralMessage,
+	Sight,
+	SightLost,
+	Sound,
+	Contact,
+	MoveTo,
+	MoveToComplete,
+
+	Count
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * A decoded entry of an event recording
+ */
+struct FNLRecordedEvent
+{
+	FNLRecordedEvent()
+		: Type(ENLRecordedEventType::Update)
+		, Frame(0)
+		, DeltaTime(0.0f)
+		, Subject(INDEX_NONE)
+		, SubjectLocation(FVector::ZeroVector)
+		, Location(FVector::ZeroVector)
+		, Normal(FVector::ZeroVector)
+		, Value(0.0f)
+		, Flags(0)
+		, RequestID(0)
+		, Result(0)
+		, Class(INDEX_NONE)
+	{}
+
+	ENLRecordedEventType Type;
+
+	// Update frame number and the time passed to the behaviors
+	uint32 Frame;
+	float DeltaTime;
+
+	// The sighted, lost, heard or contacted actor or move goal as an index into the subject table, and where it was
+	int32 Subject;
+	FVector SubjectLocation;
+
+	// Sound location, contact impact point or move position
+	FVector Location;
+
+	// Contact impact normal
+	FVector Normal;
+
+	// Sound volume or move range
+	float Value;
+
+	// Sound flags, or 1 for indirect sight
+	int32 Flags;
+
+	// MoveToComplete request and result
+	uint32 RequestID;
+	uint8 Result;
+
+	// Behavior or message class as an index into the class table
+	int32 Class;
+
+	// Tagged properties of a general message
+	TArray<uint8> MessageData;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Records the events delivered to a brain along with its updates, frame numbers and delta times into a compact binary
+ * stream (see UNextLifeBrainComponent::RecordEvents). Actors are recorded by name and location, messages by class and
+ * tagged properties. Recordings are played back into the same behaviors by FNLEventReplay.
+ */
+class NEXTLIFE_API FNLEventRecorder
+{
+public:
+	FNLEventRecorder();
+
+	// Starts a new recording of a brain, capturing its class, properties, pawn class and behaviors
+	void Start(const UNextLifeBrainComponent& brain);
+
+	// Stops recording, discarding the recording
+	void Stop();
+
+	bool IsRecording() const
+	{
+		return Recording;
+	}
+
+	// The number of updates and events recorded
+	int32 GetUpdateCount() const
+	{
+		return UpdateCount;
+	}
+
+	int32 GetEventCount() const
+	{
+		return EventCount;
+	}
+
+	void RecordUpdate(float deltaTime);
+	void RecordLogic(ENLRecordedEventType type);
+	void RecordBehavior(ENLRecordedEventType type, const UClass* behaviorClass);
+	void RecordGeneralMessage(const UNLGeneralMessage* message);
+	void RecordSight(const AActor* subject, bool indirect);
+	void RecordSightLost(const AActor* subject);
+	void RecordSound(const AActor* subject, const FVector& location, float volume, int32 flags);
+	void RecordContact(const AActor* other, const FHitResult& hitResult);
+	void RecordMoveTo(const AActor* goal, const FVector& pos, float range);
+	void RecordMoveToComplete(FAIRequestID requestID, EPathFollowingResult::Type result);
+
+	// Writes the recording so far to a file, recording continues
+	bool WriteFile(const FString& path) const;
+
+private:
+	// Appends an entry to the stream
+	void WriteEntry(ENLRecordedEventType type, TFunctionRef<void(FArchive&)> writePayload);
+
+	void WriteSubject(FArchive& writer, const AActor* subject);
+
+	int32 AddClass(const UClass* recordedClass);
+
+	bool Recording;
+
+	int32 UpdateCount;
+	int32 EventCount;
+
+	// Captured when recording started
+	FString BrainClass;
+	TArray<uint8> BrainProperties;
+	FString PawnClass;
+	bool LogicWasStarted;
+	TArray<int32> BehaviorClasses;
+
+	// Classes and subjects referenced by index from the stream
+	TMap<const UClass*, int32> ClassIndices;
+	TArray<FString> ClassPaths;
+	TMap<FName, int32> SubjectIndices;
+	TArray<FString> SubjectNames;
+
+	TArray<uint8> Stream;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * An event recording loaded for replay. The replay driver creates a brain with CreateBrain, then walks Events in order,
+ * delivering events with Deliver and ticking the brain with the recorded delta time for each Update. Actors aren't
+ * recorded, so subjects are stand-ins given by the driver.
+ */
+class NEXTLIFE_API FNLEventReplay
+{
+public:
+	FNLEventReplay();
+
+	// Loads a recording written by FNLEventRecorder::WriteFile
+	bool LoadFile(const FString& path);
+
+	// Creates the recorded brain class with its recorded properties and behaviors on a controller, registered and not
+	// using the tick manager so the driver controls its updates. Logic is started if it was when recording began.
+	UNextLifeBrainComponent* CreateBrain(class AAIController* controller) const;
+
+	// Delivers a recorded entry other than Update to a brain. Subjects are resolved through resolveSubject, given the
+	// subject index and its recorded location.
+	void Deliver(UNextLifeBrainComponent& brain, const FNLRecordedEvent& recordedEvent,
+				 TFunctionRef<AActor*(int32, const FVector&)> resolveSubject) const;
+
+	// The recorded pawn class, null if it couldn't be loaded
+	UClass* GetPawnClass() const;
+
+	const TArray<FNLRecordedEvent>& GetEvents() const
+	{
+		return Events;
+	}
+
+	const TArray<FString>& GetSubjectNames() const
+	{
+		return SubjectNames;
+	}
+
+	int32 GetUpdateCount() const
+	{
+		return UpdateCount;
+	}
+
+private:
+	UClass* GetRecordedClass(int32 classIndex) const;
+
+	FString BrainClass;
+	TArray<uint8> BrainProperties;
+	FString PawnClass;
+	bool LogicWasStarted;
+	TArray<int32> BehaviorClasses;
+	TArray<FString> ClassPaths;
+	TArray<FString> SubjectNames;
+	int32 UpdateCount;
+
+	// Loaded ClassPaths
+	TArray<TWeakObjectPtr<UClass>> Classes;
+
+	TArray<FNLRecordedEvent> Events;
+};
@@ -0,0 +1,434 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "NLAction.h"
+
+// Baseline event sets
+#include "EventSets/NLGeneralEvents.h"
+#include "EventSets/NLSensingEvents.h"
+#include "EventSets/NLMovementEvents.h"
+
+#include "NLNativeAction.generated.h"
+
+// DOCUMENTATION
+/**
+ * Native Actions
+ * -------------------
+ * A native action is a plain C++ class deriving from FNLNativeAction instead of a UNLAction UObject. It has no
+ * reflection, no Blueprint events and is never seen by the garbage collector. Native actions are allocated from an
+ * arena owned by their behavior and destroyed as soon as they are done.
+ *
+ * On the stack a native action is run by a UNLNativeActionHost, a generic action which forwards the action calls and
+ * events to it. Hosts are reused by every native action type of a behavior, so a behavior only ever creates as many
+ * hosts as it has native actions on its stack at once. Native and UObject actions can change to, suspend for and
+ * receive events from each other with the same rules.
+ *
+ * Declaring a native action:
+ *
+ *	struct FMyNativeAction : public FNLNativeAction
+ *	{
+ *		NL_NATIVE_ACTION(FMyNativeAction)
+ *		typedef FMyPayload PayloadType;		// Optional, like UObject actions
+ *
+ *		virtual FNLActionResult OnUpdate(float deltaSeconds) override;
+ *	};
+ *
+ * and transitioning to it from any action with ChangeTo<FMyNativeAction>(payload) or SuspendFor<FMyNativeAction>(payload).
+ *
+ * Rules:
+ * - Native actions derive from FNLNativeAction only, no other base classes.
+ * - Object pointers held by a native action are not seen by the garbage collector, use TWeakObjectPtr.
+ * - Native actions are not saved. A host restored from a save game has no native action and is done on its next update.
+ * - A native action is destroyed when it is done. The action resuming from it only sees its host.
+ */
+
+class FNLNativeAction;
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Describes a native action type. There is a single instance of it for each type, see NL_NATIVE_ACTION.
+ */
+struct FNLNativeActionType
+{
+	// The name of the type, for debugging
+	const TCHAR* Name;
+
+	// The size and alignment of the type
+	uint32 Size;
+	uint32 Alignment;
+
+	// Default constructs the type in memory of Size and Alignment
+	FNLNativeAction* (*Construct)(void* memory);
+};
+
+/**
+ * Declares the type of a native action. Put it at the top of the native actions declaration.
+ */
+#define NL_NATIVE_ACTION(TypeName) \
+public: \
+	static const FNLNativeActionType* StaticNativeType() \
+	{ \
+		static const FNLNativeActionType nativeType = { TEXT(#TypeName), sizeof(TypeName), alignof(TypeName), \
+														[](void* memory) -> FNLNativeAction* { return new(memory) TypeName(); } }; \
+		return &nativeType; \
+	}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * The event sets a native action listens to
+ */
+enum class ENLNativeEventSets : uint8
+{
+	NONE = 0,
+	GENERAL = 1 << 0,
+	SENSING = 1 << 1,
+	MOVEMENT = 1 << 2,
+};
+ENUM_CLASS_FLAGS(ENLNativeEventSets)
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Allocates the native actions of a behavior.
+ * Small actions are carved out of pages and their blocks are kept in free lists by size, so the actions of a behavior
+ * are close together in memory and reusing a block costs no allocation. Larger actions are allocated on the heap.
+ */
+class NEXTLIFE_API FNLNativeActionArena
+{
+public:
+	FNLNativeActionArena();
+	~FNLNativeActionArena();
+
+	FNLNativeActionArena(const FNLNativeActionArena&) = delete;
+	FNLNativeActionArena& operator=(const FNLNativeActionArena&) = delete;
+
+	/**
+	 * Allocates and default constructs a native action of a type
+	 */
+	FNLNativeAction* Construct(const FNLNativeActionType* nativeType);
+
+	/**
+	 * Destructs a native action and returns its memory to the arena
+	 */
+	void Destroy(FNLNativeAction* nativeAction);
+
+	// The number of native actions constructed and not destroyed
+	int32 GetLiveCount() const
+	{
+		return LiveCount;
+	}
+
+	// The bytes of the pages allocated by the arena
+	SIZE_T GetPageBytes() const
+	{
+		return Pages.Num() * PageSize;
+	}
+
+private:
+
+	static constexpr uint32 PageSize = 1024;
+	static constexpr uint32 BlockAlignment = 16;
+	static constexpr uint32 NumSizeClasses = 16;
+
+	// A free block links to the next free block of its size
+	struct FFreeBlock
+	{
+		FFreeBlock* Next;
+	};
+
+	// The size class of an allocation, blocks are BlockAlignment bytes apart in size
+	static uint32 GetSizeClass(uint32 size)
+	{
+		return (size - 1) / BlockAlignment;
+	}
+
+	void* Allocate(uint32 size, uint32 alignment);
+	void Free(void* memory, uint32 size, uint32 alignment);
+
+	// The free blocks of each size class
+	FFreeBlock* FreeLists[NumSizeClasses];
+
+	// The pages blocks are carved from, and the unused part of the last page
+	TArray<uint8*> Pages;
+	uint8* PageCursor;
+	uint8* PageEnd;
+
+	int32 LiveCount;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Base Native Action : An action which is a plain C++ class, see the documentation at the top of this file.
+ * The calls match the UNLAction calls of the same name.
+ */
+class NEXTLIFE_API FNLNativeAction
+{
+public:
+	/// The arena creates us, hosts run us
+	friend class FNLNativeActionArena;
+	friend class UNLNativeActionHost;
+
+	/// The struct payload type this action expects to be started with, see UNLAction::PayloadType
+	typedef void PayloadType;
+
+	virtual ~FNLNativeAction() {}
+
+	/// Get the current short description, the type name by default
+	virtual FString GetShortDescription() const;
+
+	/// Gets the type of this action
+	const FNLNativeActionType* GetNativeType() const
+	{
+		return NativeType;
+	}
+
+	/// Gets the host running this action on the stack
+	class UNLNativeActionHost* GetHost() const
+	{
+		return Host;
+	}
+
+	/// Gets the native action run by an action on the stack, null for UObject actions
+	static FNLNativeAction* Get(const UNLAction* action);
+
+	/// The same as the UNLAction functions, for the host of this action
+	class APawn* GetPawnOwner() const;
+	class AAIController* GetAIOwner() const;
+	class UNLBehavior* GetBehavior() const;
+	float GetWorldTimeSeconds() const;
+	class UBlackboardComponent* GetBlackboard() const;
+	bool IsTopAction() const;
+
+	/**
+	 * Gets the struct payload this action was started with.
+	 * Returns null if the action was not started with a struct payload of this type.
+	 */
+	template<typename TPayload>
+	const TPayload* GetStructPayload() const;
+
+protected:
+
+	FNLNativeAction();
+
+	/// Set to true in the constructor if OnUpdate is thread safe, see UNLAction::UpdateIsThreadSafe
+	bool UpdateIsThreadSafe;
+
+	/// Set in the constructor to the event sets this action implements, it only receives those events
+	ENLNativeEventSets HandledEvents;
+
+	virtual FNLActionResult OnStart(UNLActionPayload* payload)
+	{
+		return Continue();
+	}
+
+	virtual FNLActionResult OnUpdate(float deltaSeconds)
+	{
+		return Continue();
+	}
+
+	virtual void OnDone(const UNLAction* nextAction)
+	{
+	}
+
+	virtual bool OnSuspend(const UNLAction* interruptingAction)
+	{
+		return true;
+	}
+
+	virtual FNLActionResult OnResume(const UNLAction* resumedFromAction)
+	{
+		return Continue();
+	}
+
+	virtual bool OnRequestEvent(const FNLEventResponse& eventRequested, UNLAction* requester);
+
+	virtual bool OnRequestTakeover(const FNLEventResponse& eventRequested, UNLAction* requester, bool& keepChildActions)
+	{
+		return false;
+	}
+
+	// General events, see INLGeneralEvents. Received with ENLNativeEventSets::GENERAL.
+	virtual FNLEventResponse General_Message(UNLGeneralMessage* message) { return FNLEventResponse(); }
+
+	// Sensing events, see INLSensingEvents. Received with ENLNativeEventSets::SENSING.
+	virtual FNLEventResponse Sense_Sight(APawn* subject, bool indirect) { return FNLEventResponse(); }
+	virtual FNLEventResponse Sense_SightLost(APawn* subject) { return FNLEventResponse(); }
+	virtual FNLEventResponse Sense_Sound(APawn* otherActor, const FVector& location, float volume, int32 flags) { return FNLEventResponse(); }
+	virtual FNLEventResponse Sense_Contact(AActor* other, const FHitResult& hitResult) { return FNLEventResponse(); }
+
+	// Movement events, see INLMovementEvents. Received with ENLNativeEventSets::MOVEMENT.
+	virtual FNLEventResponse Movement_MoveTo(const AActor* goal, const FVector& pos, float range) { return FNLEventResponse(); }
+	virtual FNLEventResponse Movement_MoveToComplete(FAIRequestID requestID, const EPathFollowingResult::Type result) { return FNLEventResponse(); }
+
+	/**
+	 * Action results, see the UNLAction functions of the same name.
+	 * TAction can be a UNLAction class or a native action.
+	 */
+	static FNLActionResult Continue()
+	{
+		return FNLActionResult();
+	}
+
+	template<int32 N = 1>
+	static FNLActionResult Done(const TCHAR (&reason)[N] = TEXT(""))
+	{
+		return FNLActionResult(ENLActionChangeType::DONE, nullptr, NLMakeReason(reason));
+	}
+
+	template<int32 N = 1>
+	static FNLActionResult ChangeTo(TSubclassOf<UNLAction> action, UNLActionPayload* payload = nullptr, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		return FNLActionResult(ENLActionChangeType::CHANGE, action, NLMakeReason(reason), payload);
+	}
+
+	template<int32 N = 1>
+	static FNLActionResult SuspendFor(TSubclassOf<UNLAction> action, UNLActionPayload* payload = nullptr, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		return FNLActionResult(ENLActionChangeType::SUSPEND, action, NLMakeReason(reason), payload);
+	}
+
+	template<typename TAction>
+	static FNLActionResult ChangeTo()
+	{
+		return NLMakeActionResult<TAction>(ENLActionChangeType::CHANGE, NAME_None, FNLStructPayload());
+	}
+
+	template<typename TAction>
+	static FNLActionResult SuspendFor()
+	{
+		return NLMakeActionResult<TAction>(ENLActionChangeType::SUSPEND, NAME_None, FNLStructPayload());
+	}
+
+	template<typename TAction, typename TPayload, int32 N = 1>
+	static FNLActionResult ChangeTo(TPayload&& payload, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeActionResult<TAction>(ENLActionChangeType::CHANGE, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)));
+	}
+
+	template<typename TAction, typename TPayload, int32 N = 1>
+	static FNLActionResult SuspendFor(TPayload&& payload, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeActionResult<TAction>(ENLActionChangeType::SUSPEND, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)));
+	}
+
+	/**
+	 * Event responses, see the UNLAction functions of the same name.
+	 * TAction can be a UNLAction class or a native action.
+	 */
+	static FNLEventResponse TryContinue()
+	{
+		return FNLEventResponse();
+	}
+
+	template<int32 N = 1>
+	static FNLEventResponse TryDone(const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY, const TCHAR (&reason)[N] = TEXT(""))
+	{
+		return FNLEventResponse(ENLActionChangeType::DONE, priority, nullptr, NLMakeReason(reason));
+	}
+
+	template<typename TAction, typename TPayload, int32 N = 1>
+	static FNLEventResponse TryChangeTo(TPayload&& payload,
+										const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY,
+										const TCHAR (&reason)[N] = TEXT(""))
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeEventResponse<TAction>(ENLActionChangeType::CHANGE, priority, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)));
+	}
+
+	template<typename TAction, typename TPayload, int32 N = 1>
+	static FNLEventResponse TrySuspendFor(TPayload&& payload,
+										  const ENLEventRequestPriority priority = ENLEventRequestPriority::TRY,
+										  const TCHAR (&reason)[N] = TEXT(""), const ENLSuspendBehavior suspendBehavior = ENLSuspendBehavior::NORMAL)
+	{
+		NLCheckPayloadType<TAction, TPayload>();
+		return NLMakeEventResponse<TAction>(ENLActionChangeType::SUSPEND, priority, NLMakeReason(reason), FNLStructPayload::Make(Forward<TPayload>(payload)),
+											suspendBehavior);
+	}
+
+private:
+
+	// The type of this action, set by the arena
+	const FNLNativeActionType* NativeType;
+
+	// The host running this action, set when the host is bound
+	class UNLNativeActionHost* Host;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * Runs a native action on the action stack, forwarding the action calls and the events the native action handles.
+ * Hosts are created and reused by behaviors, see UNLBehavior::CreateAction.
+ */
+UCLASS(NotBlueprintable)
+class NEXTLIFE_API UNLNativeActionHost final : public UNLAction
+											 , public INLGeneralEvents
+											 , public INLSensingEvents
+											 , public INLMovementEvents
+{
+	GENERATED_BODY()
+public:
+	UNLNativeActionHost();
+
+	/// Behaviors bind and destroy our native actions
+	friend class UNLBehavior;
+
+	/// Gets the native action being run, null once it is done
+	FNLNativeAction* GetNativeAction() const
+	{
+		return NativeAction;
+	}
+
+	virtual FString GetShortDescription() const override;
+
+	virtual bool ListensTo(const UClass* eventInterface) const override;
+
+protected:
+
+	/**
+	 * Starts running a native action. The host must not be running one.
+	 */
+	void BindNativeAction(FNLNativeAction* nativeAction);
+
+	/**
+	 * Destroys the native action being run, if any
+	 */
+	void DestroyNativeAction(FNLNativeActionArena& arena);
+
+	virtual FNLActionResult OnStart_Implementation(UNLActionPayload* payload) override;
+	virtual FNLActionResult OnUpdate_Implementation(const float deltaSeconds) override;
+	virtual void OnDone_Implementation(const UNLAction* nextAction) override;
+	virtual bool OnSuspend_Implementation(const UNLAction* interruptingAction) override;
+	virtual FNLActionResult OnResume_Implementation(const UNLAction* resumedFromAction) override;
+	virtual bool OnRequestEvent_Implementation(const FNLEventResponse& eventRequested, UNLAction* requester) override;
+	virtual bool OnRequestTakeover_Implementation(const FNLEventResponse& eventRequested, UNLAction* requester, bool& keepChildActions) override;
+	virtual void OnReset_Implementation() override;
+
+	// INLGeneralEvents
+	virtual FNLEventResponse General_Message_Implementation(UNLGeneralMessage* message) override;
+
+	// INLSensingEvents
+	virtual FNLEventResponse Sense_Sight_Implementation(APawn* subject, bool indirect) override;
+	virtual FNLEventResponse Sense_SightLost_Implementation(APawn* subject) override;
+	virtual FNLEventResponse Sense_Sound_Implementation(APawn* otherActor, const FVector& location, float volume, int32 flags) override;
+	virtual FNLEventResponse Sense_Contact_Implementation(AActor* other, const FHitResult& hitResult) override;
+
+	// INLMovementEvents
+	virtual FNLEventResponse Movement_MoveTo_Implementation(const AActor* goal, const FVector& pos, float range) override;
+	virtual FNLEventResponse Movement_MoveToComplete_Implementation(FAIRequestID requestID, const EPathFollowingResult::Type result) override;
+
+private:
+
+	// The native action being run, owned by the behaviors arena
+	FNLNativeAction* NativeAction;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+*/
+template<typename TPayload>
+const TPayload* FNLNativeAction::GetStructPayload() const
+{
+	return Host ? Host->GetStructPayload<TPayload>() : nullptr;
+}
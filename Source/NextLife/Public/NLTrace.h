@@ -0,0 +1,38 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+// NextLife trace scopes show up in Unreal Insights as "NextLife <Label> <Class>" CPU events, so a capture shows which
+// behavior and action classes cost the most. Enable with -trace=cpu,nextlife.
+#ifndef NEXTLIFE_TRACE_ENABLED
+#define NEXTLIFE_TRACE_ENABLED (CPUPROFILERTRACE_ENABLED && !UE_BUILD_SHIPPING)
+#endif
+
+#if NEXTLIFE_TRACE_ENABLED
+
+UE_TRACE_CHANNEL_EXTERN(NextLifeChannel, NEXTLIFE_API);
+
+/**
+ * Emits a CPU event named after a label and the class of an object for the lifetime of the scope, when the NextLife
+ * and CPU trace channels are enabled. Event names are created once per label and class.
+ */
+struct NEXTLIFE_API FNLTraceScope
+{
+	FNLTraceScope(const TCHAR* label, const UObject* object);
+	~FNLTraceScope();
+
+private:
+	bool IsActive;
+};
+
+#define NEXTLIFE_TRACE_SCOPE(Label, Object) FNLTraceScope PREPROCESSOR_JOIN(nextLifeTraceScope, __LINE__)(TEXT(Label), Object)
+
+#else
+
+#define NEXTLIFE_TRACE_SCOPE(Label, Object)
+
+#endif
@@ -0,0 +1,132 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NLTypes.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * What a transition record describes
+ */
+enum class ENLTransitionRecordType : uint8
+{
+	// The behavior began, ToClass is its initial action
+	BehaviorBegin,
+	// The behavior was stopped and its action stack torn down
+	BehaviorStop,
+	// ApplyActionResult transitions. FromClass was the top action, ToClass is the new top action.
+	Change,
+	Suspend,
+	Done,
+	// An action took over a request, ending the actions above it. ToClass is the taking over action.
+	Takeover,
+	// All actions above a requesting action accepted its request and were ended. ToClass is the requesting action.
+	RequestAccepted,
+	// An event response was stored, replaced a lower priority one, was ignored or collided with a critical one.
+	// FromClass is the responding action, ToClass the requested action.
+	EventStored,
+	EventOverrode,
+	EventIgnored,
+	EventCollision,
+	// MaxTransitionsPerFrame was reached, the transition to ToClass was deferred
+	Deferred,
+
+	Count
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * A compact record of a single transition or event. Classes are ids from FNLTransitionRecorder::GetClassId.
+ */
+struct FNLTransitionRecord
+{
+	// World time and frame number the record was made
+	float Time;
+	uint32 Frame;
+
+	// The event for event records
+	FName EventName;
+
+	// The reason given for the transition or event response
+	FName Reason;
+
+	uint16 BehaviorClass;
+	uint16 FromClass;
+	uint16 ToClass;
+
+	// Stack depth of the top action after the record, -1 if the stack is empty
+	int16 StackDepth;
+
+	ENLTransitionRecordType Type;
+	ENLActionChangeType Change;
+	ENLEventRequestPriority Priority;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * A fixed size ring buffer of transition records kept by a brain (see UNextLifeBrainComponent::RecordTransitionHistory).
+ * Recording copies one small record with no string formatting, so it is cheap enough to leave on. Histories are
+ * written to a binary file by the NextLife.DumpTransitions console command, and turned back into readable action
+ * stack histories by NextLife.DecodeTransitions or the NLDecodeTransitions commandlet.
+ */
+class NEXTLIFE_API FNLTransitionRecorder
+{
+public:
+	// Class id used for no class
+	static const uint16 NoClass = 0;
+
+	FNLTransitionRecorder();
+
+	// Sets how many records are kept, clearing the history. Zero stops recording.
+	void SetCapacity(int32 capacity);
+
+	// True if records are being kept
+	bool IsRecording() const
+	{
+		return Records.Num() > 0;
+	}
+
+	// Adds a record, overwriting the oldest when full
+	void Record(const FNLTransitionRecord& record)
+	{
+		Records[Head] = record;
+		if(++Head == Records.Num())
+		{
+			Head = 0;
+		}
+		++TotalRecorded;
+	}
+
+	// Clears the history, keeping the capacity
+	void Reset();
+
+	// The number of records made since the history was cleared, including those overwritten
+	int64 GetTotalRecorded() const
+	{
+		return TotalRecorded;
+	}
+
+	// Outputs the kept records, oldest first
+	void GetRecords(TArray<FNLTransitionRecord>& recordsOut) const;
+
+	// Returns the id of a class used in records. Game thread only.
+	static uint16 GetClassId(const UClass* recordedClass);
+
+	// Returns the name of a recorded class id
+	static FString GetClassName(uint16 classId);
+
+	// Writes named histories to a binary file
+	static bool WriteFile(const FString& path, const TArray<TPair<FString, const FNLTransitionRecorder*>>& histories);
+
+	// Decodes a file written by WriteFile into readable action stack histories
+	static bool DecodeFile(const FString& path, FString& decodedOut);
+
+private:
+	TArray<FNLTransitionRecord> Records;
+
+	// Where the next record goes
+	int32 Head;
+
+	int64 TotalRecorded;
+};
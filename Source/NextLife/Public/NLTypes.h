@@ -4,6 +4,24 @@
 
 #include "NLTypes.generated.h"
 
+// Reasons given with action results and event responses are debug information. They are only kept in builds which
+// can log them, everywhere else they compile down to NAME_None so no names are looked up or strings created.
+#ifndef NEXTLIFE_WITH_REASONS
+#define NEXTLIFE_WITH_REASONS !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+#endif
+
+// Interns a reason for an action result or event response. Only takes string literals, a reason built at runtime would
+// add a name which is never freed each time (see UNLAction::MakeReason for reasons coming from Blueprint).
+template<int32 N>
+FORCEINLINE FName NLMakeReason(const TCHAR (&reason)[N])
+{
+#if NEXTLIFE_WITH_REASONS
+	return (N > 1 && reason[0]) ? FName(reason) : NAME_None;
+#else
+	return NAME_None;
+#endif
+}
+
 /**
 * Base action payload
 */
@@ -13,6 +31,132 @@ class NEXTLIFE_API UNLActionPayload : public UObject
 	GENERATED_BODY()
 };
 
+//----------------------------------------------------------------------------------------------------------------------
+/**
+ * A typed value payload which can be sent with action results and event responses without creating a UObject.
+ * Holds a copy of any USTRUCT. Small structs are stored inline, larger structs are allocated on the heap.
+ * Use UNLActionPayload instead when the payload has to be created in Blueprint.
+ */
+USTRUCT(BlueprintType)
+struct NEXTLIFE_API FNLStructPayload
+{
+	GENERATED_BODY()
+
+	// Structs up to this size (and alignment) are stored without a heap allocation
+	static constexpr int32 InlineSize = 32;
+	static constexpr int32 InlineAlignment = 16;
+
+	FNLStructPayload()
+		: ScriptStruct(nullptr)
+		, HeapMemory(nullptr)
+	{}
+
+	FNLStructPayload(const FNLStructPayload& other);
+	FNLStructPayload(FNLStructPayload&& other);
+	FNLStructPayload& operator=(const FNLStructPayload& other);
+	FNLStructPayload& operator=(FNLStructPayload&& other);
+
+	~FNLStructPayload()
+	{
+		Reset();
+	}
+
+	// Creates a payload holding a USTRUCT value, moving the value in
+	template<typename TStruct>
+	static FNLStructPayload Make(TStruct&& value)
+	{
+		typedef typename TDecay<TStruct>::Type FStructType;
+
+		FNLStructPayload payload;
+		payload.ScriptStruct = FStructType::StaticStruct();
+		new(payload.AllocateMemory()) FStructType(Forward<TStruct>(value));
+		return payload;
+	}
+
+	// Returns the held value if it is of the type (or derived from the type), null otherwise
+	template<typename TStruct>
+	const TStruct* Get() const
+	{
+		if(ScriptStruct && ScriptStruct->IsChildOf(TStruct::StaticStruct()))
+		{
+			return reinterpret_cast<const TStruct*>(GetMemory());
+		}
+		return nullptr;
+	}
+
+	// Returns the held value if it is of the type (or derived from the type), null otherwise
+	template<typename TStruct>
+	TStruct* GetMutable()
+	{
+		return const_cast<TStruct*>(static_cast<const FNLStructPayload*>(this)->Get<TStruct>());
+	}
+
+	// Does this payload hold a value?
+	FORCEINLINE bool IsValid() const
+	{
+		return ScriptStruct != nullptr;
+	}
+
+	// The type of the held value
+	FORCEINLINE const UScriptStruct* GetScriptStruct() const
+	{
+		return ScriptStruct;
+	}
+
+	// Sets the payload to a copy of a struct, or a default constructed struct if structMemory is null
+	void InitializeAs(const UScriptStruct* scriptStruct, const uint8* structMemory = nullptr);
+
+	// Destroys the held value
+	void Reset();
+
+	// Struct ops
+	bool Serialize(FArchive& ar);
+	void AddStructReferencedObjects(FReferenceCollector& collector);
+	bool Identical(const FNLStructPayload* other, uint32 portFlags) const;
+
+private:
+
+	// Does a struct of this type fit in the inline buffer
+	static bool FitsInline(const UScriptStruct* scriptStruct);
+
+	// Allocates uninitialized memory for the current ScriptStruct
+	uint8* AllocateMemory();
+
+	// Takes the value of another payload, leaving it empty. This payload must be empty.
+	void RelocateFrom(FNLStructPayload& other);
+
+	const uint8* GetMemory() const
+	{
+		return HeapMemory ? HeapMemory : reinterpret_cast<const uint8*>(&InlineMemory);
+	}
+
+	uint8* GetMemory()
+	{
+		return HeapMemory ? HeapMemory : reinterpret_cast<uint8*>(&InlineMemory);
+	}
+
+	// The type of the held value
+	const UScriptStruct* ScriptStruct;
+
+	// The held value when it is too large for the inline buffer
+	uint8* HeapMemory;
+
+	// The held value when it fits
+	TAlignedBytes<InlineSize, InlineAlignment> InlineMemory;
+};
+
+template<>
+struct TStructOpsTypeTraits<FNLStructPayload> : public TStructOpsTypeTraitsBase2<FNLStructPayload>
+{
+	enum
+	{
+		WithCopy = true,
+		WithSerializer = true,
+		WithAddStructReferencedObjects = true,
+		WithIdentical = true,
+	};
+};
+
 //----------------------------------------------------------------------------------------------------------------------
 /**
  * The different action changes which can occur, including a NONE which means no change (used to move on)
@@ -74,19 +218,37 @@ struct FNLEventResponse
 		: ChangeRequest(ENLActionChangeType::NONE)
 		, Priority(ENLEventRequestPriority::NONE)
 		, Payload(nullptr)
+		, NativeType(nullptr)
 		, SuspendBehavior(ENLSuspendBehavior::NORMAL)
 	{}
 
 	FNLEventResponse(ENLActionChangeType changeRequest,
 					 ENLEventRequestPriority priority,
 					 TSubclassOf<class UNLAction> action,
-					 const FString& reason,
+					 const FName reason,
 					 class UNLActionPayload* payload = nullptr,
 					 const ENLSuspendBehavior suspendBehavior = ENLSuspendBehavior::NORMAL)
 		: ChangeRequest(changeRequest)
 		, Priority(priority)
 		, Action(action)
 		, Payload(payload)
+		, NativeType(nullptr)
+		, Reason(reason)
+		, SuspendBehavior(suspendBehavior)
+	{}
+
+	FNLEventResponse(ENLActionChangeType changeRequest,
+					 ENLEventRequestPriority priority,
+					 TSubclassOf<class UNLAction> action,
+					 const FName reason,
+					 FNLStructPayload&& structPayload,
+					 const ENLSuspendBehavior suspendBehavior = ENLSuspendBehavior::NORMAL)
+		: ChangeRequest(changeRequest)
+		, Priority(priority)
+		, Action(action)
+		, Payload(nullptr)
+		, StructPayload(MoveTemp(structPayload))
+		, NativeType(nullptr)
 		, Reason(reason)
 		, SuspendBehavior(suspendBehavior)
 	{}
@@ -97,6 +259,15 @@ struct FNLEventResponse
 		return ChangeRequest == ENLActionChangeType::NONE;
 	}
 
+	// This response without its payloads, what it requests without copying what it carries
+	FNLEventResponse GetRequest() const
+	{
+		FNLEventResponse request(ChangeRequest, Priority, Action, Reason, nullptr, SuspendBehavior);
+		request.NativeType = NativeType;
+		request.EventName = EventName;
+		return request;
+	}
+
 	// True if this event does not cause destruction to the stack (appends only, no ends)
 	FORCEINLINE bool IsNonDestructive(const bool hasNoNextAction) const
 	{
@@ -129,9 +300,16 @@ struct FNLEventResponse
 	UPROPERTY(SaveGame)
 	class UNLActionPayload* Payload;
 
-	// The reason for this response
+	// The struct payload sent with this event, an alternative to Payload which doesn't create an object
 	UPROPERTY(SaveGame)
-	FString Reason;
+	FNLStructPayload StructPayload;
+
+	// The native action type to run when Action is the native action host (see NLNativeAction.h). Not saved.
+	const struct FNLNativeActionType* NativeType;
+
+	// The reason for this response, for debugging. Always None when NEXTLIFE_WITH_REASONS is off.
+	UPROPERTY(SaveGame)
+	FName Reason;
 
 	// The name of the event which caused this response
 	UPROPERTY(SaveGame)
@@ -143,3 +321,184 @@ struct FNLEventResponse
 	UPROPERTY(SaveGame)
 	ENLSuspendBehavior SuspendBehavior;
 };
+
+//----------------------------------------------------------------------------------------------------------------------
+/**
+* How an action decides on requests from actions below it (see FNLRequestEventPolicy and FNLRequestTakeoverPolicy)
+*/
+UENUM(BlueprintType)
+enum class ENLRequestPolicyMode : uint8
+{
+	/** Ask the action, calling its OnRequestEvent or OnRequestTakeover event */
+	CUSTOM,
+	/** Always accept */
+	ACCEPT,
+	/** Always refuse */
+	REJECT,
+	/** Accept the requests which pass the policy filter */
+	FILTER,
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/**
+* Which requests the policy filter of a request policy lets through
+*/
+USTRUCT(BlueprintType)
+struct FNLRequestPolicyFilter
+{
+	GENERATED_BODY()
+
+	FNLRequestPolicyFilter()
+		: MinPriority(ENLEventRequestPriority::IMPORTANT)
+		, AcceptChange(false)
+		, AcceptDone(false)
+		, AcceptSuspend(false)
+		, AcceptSuspendAppend(true)
+	{}
+
+	// Does a request pass the filter
+	FORCEINLINE bool Passes(const FNLEventResponse& request) const
+	{
+		if(request.Priority < MinPriority)
+		{
+			return false;
+		}
+
+		switch(request.ChangeRequest)
+		{
+			case ENLActionChangeType::CHANGE:
+				return AcceptChange;
+			case ENLActionChangeType::DONE:
+				return AcceptDone;
+			case ENLActionChangeType::SUSPEND:
+				return request.SuspendBehavior == ENLSuspendBehavior::APPEND ? AcceptSuspendAppend : AcceptSuspend;
+			default:
+				return false;
+		}
+	}
+
+	// The lowest priority accepted
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	ENLEventRequestPriority MinPriority;
+
+	// The change requests accepted, a normal suspend can end the actions above the requester
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	bool AcceptChange;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	bool AcceptDone;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	bool AcceptSuspend;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	bool AcceptSuspendAppend;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/**
+* Decides, without calling an event, if an action accepts the request of an action below it (see UNLAction::OnRequestEvent)
+* The default asks the action.
+*/
+USTRUCT(BlueprintType)
+struct FNLRequestEventPolicy
+{
+	GENERATED_BODY()
+
+	FNLRequestEventPolicy()
+		: Mode(ENLRequestPolicyMode::CUSTOM)
+	{}
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	ENLRequestPolicyMode Mode;
+
+	// The requests accepted in FILTER mode
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy", meta = (EditCondition = "Mode == ENLRequestPolicyMode::FILTER"))
+	FNLRequestPolicyFilter Filter;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/**
+* Decides, without calling an event, if an action takes over the request of an action below it for an action of its own
+* class (see UNLAction::OnRequestTakeover). The default asks the action.
+*/
+USTRUCT(BlueprintType)
+struct FNLRequestTakeoverPolicy
+{
+	GENERATED_BODY()
+
+	FNLRequestTakeoverPolicy()
+		: Mode(ENLRequestPolicyMode::CUSTOM)
+		, KeepChildActions(true)
+	{}
+
+	// Does the policy take over a request from a requester of a class
+	FORCEINLINE bool TakesOver(const FNLEventResponse& request, const UClass* requesterClass) const
+	{
+		if(RequesterClass && !requesterClass->IsChildOf(RequesterClass))
+		{
+			return false;
+		}
+		return Mode == ENLRequestPolicyMode::ACCEPT || (Mode == ENLRequestPolicyMode::FILTER && Filter.Passes(request));
+	}
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	ENLRequestPolicyMode Mode;
+
+	// The requests taken over in FILTER mode
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy", meta = (EditCondition = "Mode == ENLRequestPolicyMode::FILTER"))
+	FNLRequestPolicyFilter Filter;
+
+	// If set, only requests from actions of this class are taken over in ACCEPT and FILTER modes
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	TSubclassOf<class UNLAction> RequesterClass;
+
+	// If false, taking over a request ends the actions above the action taking it over
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Policy")
+	bool KeepChildActions;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/**
+* Identifies an agent of a NextLife crowd (see UNLCrowdSubsystem)
+* The serial tells apart agents which reused the same index, so handles of removed agents stay invalid.
+*/
+USTRUCT(BlueprintType)
+struct FNLCrowdAgentHandle
+{
+	GENERATED_BODY()
+
+	FNLCrowdAgentHandle()
+		: Index(INDEX_NONE)
+		, Serial(0)
+	{}
+
+	FNLCrowdAgentHandle(int32 index, int32 serial)
+		: Index(index)
+		, Serial(serial)
+	{}
+
+	// Was this handle given to an agent? The agent could have been removed since.
+	FORCEINLINE bool IsSet() const
+	{
+		return Index != INDEX_NONE;
+	}
+
+	FORCEINLINE bool operator==(const FNLCrowdAgentHandle& other) const
+	{
+		return Index == other.Index && Serial == other.Serial;
+	}
+
+	FORCEINLINE bool operator!=(const FNLCrowdAgentHandle& other) const
+	{
+		return !(*this == other);
+	}
+
+	// The agents index in the crowds agent arrays
+	UPROPERTY()
+	int32 Index;
+
+	// The serial of the agent at Index when the handle was made
+	UPROPERTY()
+	int32 Serial;
+};
@@ -6,9 +6,74 @@
 
 #include "EventSets/NLGeneralEvents.h"
 #include "EventSets/NLMovementEvents.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "NLTransitionRecorder.h"
+#include "NLEventRecorder.h"
 
 #include "NextLifeBrainComponent.generated.h"
 
+// The kinds of sensing events which can be queued
+enum class ENLQueuedSensingEventType : uint8
+{
+	Sight,
+	SightLost,
+	Sound,
+	Contact,
+};
+
+// A sensing event waiting to be delivered to the behaviors (see UNextLifeBrainComponent::QueueSensingEvents)
+struct FNLQueuedSensingEvent
+{
+	FNLQueuedSensingEvent()
+		: Type(ENLQueuedSensingEventType::Sight)
+		, Indirect(false)
+		, Location(FVector::ZeroVector)
+		, Volume(0.0f)
+		, Flags(0)
+		, ReceivedTime(0.0f)
+	{}
+
+	ENLQueuedSensingEventType Type;
+
+	// The sighted, lost, heard or contacted actor
+	TWeakObjectPtr<AActor> Subject;
+
+	// Sight
+	bool Indirect;
+
+	// Sound
+	FVector Location;
+	float Volume;
+	int32 Flags;
+
+	// Contact
+	FHitResult HitResult;
+
+	// When the event was received, used to hold back sight lost events
+	float ReceivedTime;
+};
+
+// A brain update rate used while the brains significance is within MaxSignificance (see UNextLifeBrainComponent::LODTiers)
+USTRUCT(BlueprintType)
+struct FNLBrainLODTier
+{
+	GENERATED_BODY()
+
+	FNLBrainLODTier()
+		: MaxSignificance(0.0f)
+		, UpdateInterval(0.0f)
+	{}
+
+	// This tier is used while the brains significance value is at most this. With the default significance function
+	// this is the distance to the closest player view point.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD", meta = (ClampMin = "0"))
+	float MaxSignificance;
+
+	// Seconds between brain updates in this tier. Zero updates every frame.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD", meta = (ClampMin = "0"))
+	float UpdateInterval;
+};
+
 /**
  * NextLife Brain Component
  * To use a NextLife style brain for your AI Controller
@@ -21,8 +86,70 @@ public:
 	UNextLifeBrainComponent();
 
 	// If true, all behavior state will be logged. Actions starting, updating, changing, suspending, ending, etc...
+	// This is verbose and slow, RecordTransitionHistory is a cheaper way to see what many AIs did.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain")
 	bool LogState;
+
+	// If true, action transitions and event responses are recorded into a fixed size history when logic starts.
+	// Dump histories with the NextLife.DumpTransitions console command. NextLife.RecordTransitions enables this for
+	// all brains.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Debug")
+	bool RecordTransitionHistory;
+
+	// The number of records kept in the transition history
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Debug", meta = (EditCondition = "RecordTransitionHistory", ClampMin = "1"))
+	int32 TransitionHistorySize;
+
+	// If true, the events delivered to this brain and its updates are recorded from when logic starts, for replay with
+	// the NLReplayEvents commandlet. Save recordings with the NextLife.SaveEvents console command.
+	// NextLife.RecordEventsOnStart enables this for all brains.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Debug")
+	bool RecordEvents;
+
+	// The most action transitions (CHANGE, SUSPEND and DONE) a behavior applies in a frame. A chain of actions changing
+	// straight away stops here and continues on the next update. Zero or less is unlimited.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain", meta = (ClampMin = "0"))
+	int32 MaxTransitionsPerFrame;
+
+	// If true, sensing events (Sense_Sight, Sense_SightLost, Sense_Sound, Sense_Contact) are queued and delivered to
+	// behaviors in one batch each tick, right before behaviors apply pending events. Repeated events about the same
+	// subject within a frame are coalesced into one. Sensing events are always queued while the tick manager is overloaded.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Sensing")
+	bool QueueSensingEvents;
+
+	// When queueing sensing events, damps sight flicker for a subject. Sight events for a subject are delivered at most
+	// once per interval, and a sight lost event is held back for the interval, being dropped if the subject is seen again.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Sensing", meta = (EditCondition = "QueueSensingEvents", ClampMin = "0"))
+	float SightFlickerInterval;
+
+	// If true, this brain is ticked by the worlds NextLife tick manager along with all other brains instead of through
+	// its own component tick. The component tick is used as a fallback when this is false or no manager is available.
+	// Off by default, the manager ticks brains from a tick function of its own, so the components tick group and tick
+	// prerequisites don't apply to them.
+	// Update rate tiers and the frame budget only apply to brains ticked by the manager.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Brain")
+	bool UseTickManager;
+
+	// Seconds between re-evaluating ShouldChooseBehavior for all behaviors. Zero re-evaluates every update. Negative only
+	// re-evaluates when selection is invalidated: behaviors being added, removed or ending, logic starting or
+	// resuming, a SelectionBlackboardKeys value changing or InvalidateBehaviorSelection being called.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Selection")
+	float SelectionReevaluationInterval;
+
+	// Blackboard keys whose values changing invalidates behavior selection
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Selection")
+	TArray<FName> SelectionBlackboardKeys;
+
+	// When the tick manager has a frame budget, brains with higher priority are updated first and lower priority
+	// brains are deferred to the next frame when the budget runs out
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|Scheduling")
+	int32 SchedulingPriority;
+
+	// Update rate tiers, from most to least significant, used when ticked by the tick manager. The first tier whose
+	// MaxSignificance covers the brains significance is used, the last tier is used beyond that. Behaviors receive the
+	// real time elapsed since the brains last update. Empty updates every frame.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Brain|LOD")
+	TArray<FNLBrainLODTier> LODTiers;
 	
 	// Add a behavior to this brain
 	UFUNCTION(BlueprintCallable, Category = "NextLife|Brain")
@@ -34,7 +161,32 @@ public:
 
 	UFUNCTION(BlueprintNativeEvent, Category = "NextLife|Brain")
 	bool ShouldChooseBehavior(class UNLBehavior* behaviorToAssess);
-	virtual bool ShouldChooseBehavior_Implementation(class UNLBehavior* behaviorToAssess) { return true; }
+	virtual bool ShouldChooseBehavior_Implementation(class UNLBehavior* behaviorToAssess);
+
+	// True if this brain is ticked by a tick manager which is overloaded. Low priority behaviors aren't chosen and
+	// sensing events are queued while overloaded.
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	bool IsSchedulerOverloaded() const;
+
+	// Makes the brain re-evaluate ShouldChooseBehavior for all behaviors on its next update
+	UFUNCTION(BlueprintCallable, Category = "NextLife|Brain")
+	void InvalidateBehaviorSelection()
+	{
+		SelectionIsDirty = true;
+	}
+
+	// The behaviors of this brain, in the order they were added
+	const TArray<class UNLBehavior*>& GetBehaviors() const
+	{
+		return Behaviors;
+	}
+
+	// Returns the behavior of a class or null. A brain has at most one behavior of each class.
+	class UNLBehavior* FindBehavior(const UClass* behaviorClass) const
+	{
+		const int32* behaviorIndex = BehaviorIndexByClass.Find(behaviorClass);
+		return behaviorIndex ? Behaviors[*behaviorIndex] : nullptr;
+	}
 
 	UFUNCTION(BlueprintCallable, Category = "NextLife|Brain")
 	void GetCurrentActiveBehaviors(TArray<class UNLBehavior*>& behaviorsOut) const;
@@ -42,6 +194,23 @@ public:
 	// Ticks all behaviors currently active
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
 
+	virtual void OnUnregister() override;
+
+	// Chooses and runs behaviors for this frame. Used by the component tick when not ticked by the tick manager.
+	void TickBrain(float deltaTime);
+
+	// Chooses behaviors to run this frame, stopping any behaviors which should no longer be running.
+	// The behaviors which should be run are output in the order they should run. deltaTime is the time the behaviors
+	// will be run with.
+	void PrepareBehaviorsToRun(TArray<class UNLBehavior*>& behaviorsOut, float deltaTime);
+
+	// Begins or runs a behavior chosen by PrepareBehaviorsToRun
+	void RunChosenBehavior(class UNLBehavior* behavior, float deltaTime);
+
+	// Returns true if a behavior chosen by PrepareBehaviorsToRun can still be run. Logic could have been stopped, or
+	// the behavior removed, by a behavior which ran before it.
+	bool CanRunChosenBehavior(const class UNLBehavior* behavior) const;
+
 	/** Starts brain logic. If brain is already running, will not do anything. */
 	virtual void StartLogic() override;
 
@@ -66,6 +235,116 @@ public:
 	virtual bool IsRunning() const override;
 	virtual bool IsPaused() const override;
 
+	// Advances this brains LOD timer by a frame. Returns true if the brain should update this frame, outputting the
+	// time elapsed since its last update and how long the update has been deferred past its due time. Without useTiers
+	// the brain is due every frame.
+	bool AdvanceLOD(float deltaTime, float significance, bool useTiers, float& elapsedTimeOut, float& deferredTimeOut);
+
+	// Puts back the elapsed and deferred time of an update the tick manager couldn't fit in the frame budget, making
+	// the brain due again next frame. The deferred time keeps growing until the brain updates.
+	void DeferLODUpdate(float elapsedTime, float deferredTime);
+
+	// The LOD tier this brain was last in, INDEX_NONE if it has no tiers or hasn't been ticked by the tick manager
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetCurrentLODTier() const
+	{
+		return CurrentLODTier;
+	}
+
+	// The transition history, null if this brain isn't recording
+	FNLTransitionRecorder* GetTransitionRecorder()
+	{
+		return TransitionRecorder.IsRecording() ? &TransitionRecorder : nullptr;
+	}
+
+	const FNLTransitionRecorder* GetTransitionRecorder() const
+	{
+		return TransitionRecorder.IsRecording() ? &TransitionRecorder : nullptr;
+	}
+
+	// Starts recording the events delivered to this brain, discarding any recording in progress
+	void StartEventRecording()
+	{
+		EventRecorder.Start(*this);
+	}
+
+	// Stops recording events, discarding the recording
+	void StopEventRecording()
+	{
+		EventRecorder.Stop();
+	}
+
+	bool IsRecordingEvents() const
+	{
+		return EventRecorder.IsRecording();
+	}
+
+	const FNLEventRecorder& GetEventRecorder() const
+	{
+		return EventRecorder;
+	}
+
+	// The name of the pawn, or controller without a pawn, used to identify this brain in logs and debug files
+	FString GetDebugName() const;
+
+	// Called by behaviors after applying a chain of action transitions
+	void RecordTransitions(int32 chainLength);
+
+	// Called by behaviors when MaxTransitionsPerFrame deferred a transition to the next update
+	void RecordTransitionDeferral()
+	{
+		++TransitionDeferrals;
+	}
+
+	// The number of action transitions applied by this brains behaviors during the current frame
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetTransitionsThisFrame() const
+	{
+		return TransitionFrame == GFrameCounter ? TransitionsThisFrame : 0;
+	}
+
+	// The most action transitions applied by this brains behaviors in a single frame
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetPeakTransitionsPerFrame() const
+	{
+		return PeakTransitionsPerFrame;
+	}
+
+	// The longest chain of action transitions applied from a single action result
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetLongestTransitionChain() const
+	{
+		return LongestTransitionChain;
+	}
+
+	// The number of times MaxTransitionsPerFrame deferred transitions to the next update
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetTransitionDeferrals() const
+	{
+		return TransitionDeferrals;
+	}
+
+	// The number of sensing events received while queueing sensing events
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetSensingEventsReceived() const
+	{
+		return SensingEventsReceived;
+	}
+
+	// The number of queued sensing events dropped because they were coalesced with another event or rate limited
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetSensingEventsCoalesced() const
+	{
+		return SensingEventsCoalesced;
+	}
+
+	// The number of queued sensing events delivered to behaviors
+	UFUNCTION(BlueprintPure, Category = "NextLife|Brain")
+	int32 GetSensingEventsDelivered() const
+	{
+		return SensingEventsDelivered;
+	}
+
 	/**
 	* INLGeneralEvents Implementation
 	*/
@@ -87,22 +366,103 @@ public:
 	
 protected:
 
-	// Called when choosing behaviors to run this frame. By default, uses the supplied conditional delegate to determine which behaviors to run.
-	// You can override this to control which behaviors are choosen to run with more complex logic.
-	void ChooseBehaviors(TArray<int32>& behaviorsOut);
+	// Called when behavior selection is re-evaluated. Uses ShouldChooseBehavior to determine which behaviors to run,
+	// stopping running behaviors which are no longer chosen.
+	void ChooseBehaviors();
+
+	// Starts or stops observing SelectionBlackboardKeys
+	void SetSelectionBlackboardObservers(bool observe);
+
+	EBlackboardNotificationResult OnSelectionBlackboardKeyChanged(const UBlackboardComponent& blackboard, FBlackboard::FKey keyId);
 
 	UFUNCTION()
 	void OnBehaviorComplete(class UNLBehavior* completeBehavior);
+
+	// Registers or unregisters this brain with the worlds tick manager, toggling the component tick as the fallback
+	void SetTickManagerRegistration(bool registered);
+
+	// Resets the LOD state, picking the frame offset for this brain
+	void ResetLOD();
+
+	// Queues a sensing event, coalescing it with an already queued event about the same subject
+	void QueueSensingEvent(FNLQueuedSensingEvent&& sensingEvent);
+
+	// Delivers queued sensing events to all running behaviors
+	void DeliverQueuedSensingEvents();
+
+	// Sends a sensing event to all running behaviors
+	void DispatchSensingEvent(const FNLQueuedSensingEvent& sensingEvent);
 	
+	// Removes the behavior of a class from Behaviors, returning it or null if there was none
+	class UNLBehavior* RemoveBehaviorOfClass(const UClass* behaviorClass);
+
 	UPROPERTY(BlueprintReadOnly, Category = "NextLife|Brain", Transient)
 	TArray<class UNLBehavior*> Behaviors;
-	
-	UPROPERTY(Transient)
-	TArray<TSubclassOf<class UNLBehavior>> ActiveBehaviorClasses;
+
+	// The index into Behaviors of the behavior of each class
+	TMap<const UClass*, int32> BehaviorIndexByClass;
+
+	// The behaviors chosen by the last selection, indexed as Behaviors
+	TBitArray<> ChosenBehaviors;
+
+	// Behaviors chosen to run by TickBrain, reused each tick
+	TArray<class UNLBehavior*> BehaviorsToRun;
+
+	// True when behavior selection needs re-evaluating
+	bool SelectionIsDirty;
+
+	// World time of the last selection
+	float LastSelectionTime;
+
+	// True while observing SelectionBlackboardKeys
+	bool IsObservingBlackboard;
 
 	UPROPERTY(SaveGame)
 	bool AreBehaviorsPaused;
 
 	UPROPERTY(SaveGame)
 	bool LogicIsStarted;
+
+	// True if this brain is currently being ticked by the tick manager
+	bool IsRegisteredWithTickManager;
+
+	// LOD state. Time since the last update, time until the next update and a fixed offset spreading brains in the
+	// same tier across frames.
+	int32 CurrentLODTier;
+	float LODElapsedTime;
+	float LODTimeUntilUpdate;
+	float LODPhase;
+
+	// Time the current update has been deferred by the frame budget past its due time, while IsLODUpdateDeferred
+	float LODDeferredTime;
+	bool IsLODUpdateDeferred;
+
+	// Sensing events waiting to be delivered, and the batch being delivered
+	TArray<FNLQueuedSensingEvent> QueuedSensingEvents;
+	TArray<FNLQueuedSensingEvent> DeliveringSensingEvents;
+
+	// Sight lost events held back by SightFlickerInterval
+	TArray<FNLQueuedSensingEvent> HeldSightLostEvents;
+
+	// When a sight event was last delivered for each subject the behaviors see. Destroyed subjects are pruned when
+	// events are delivered, everything is forgotten when logic stops.
+	TMap<TWeakObjectPtr<AActor>, float> LastSightDeliveryTimes;
+
+	// Queued sensing event stats
+	int32 SensingEventsReceived;
+	int32 SensingEventsCoalesced;
+	int32 SensingEventsDelivered;
+
+	// Records transitions when RecordTransitionHistory is set
+	FNLTransitionRecorder TransitionRecorder;
+
+	// Records events when RecordEvents is set or NextLife.RecordEvents is used
+	FNLEventRecorder EventRecorder;
+
+	// Transition stats
+	uint64 TransitionFrame;
+	int32 TransitionsThisFrame;
+	int32 PeakTransitionsPerFrame;
+	int32 LongestTransitionChain;
+	int32 TransitionDeferrals;
 };
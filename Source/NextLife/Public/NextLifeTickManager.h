@@ -0,0 +1,269 @@
+// Copyright 2020-2021 Solar Storm Interactive. All Rights Reserved.
+
+#pragma once
+
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "NLAction.h"
+
+#include "NextLifeTickManager.generated.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * The single tick function used by the NextLife tick manager to tick all registered brains
+ */
+USTRUCT()
+struct FNextLifeTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	FNextLifeTickFunction()
+		: Manager(nullptr)
+	{}
+
+	// The manager which owns this tick function
+	class UNextLifeTickManager* Manager;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FNextLifeTickFunction> : public TStructOpsTypeTraitsBase2<FNextLifeTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * NextLife Tick Manager
+ * Ticks every registered NextLife brain in a world from a single tick function instead of one component tick per brain.
+ * Behaviors chosen to run are batched by behavior class so the same behavior and action code runs back to back.
+ * Brains register themselves on StartLogic and unregister on StopLogic (see UNextLifeBrainComponent::UseTickManager).
+ * Brains with LOD tiers are updated less often the less significant they are (see UNextLifeBrainComponent::LODTiers).
+ * With a frame budget (NextLife.Budget.Ms) brains are updated by priority until the budget runs out and the rest are
+ * deferred to the next frame, unless they have been deferred past their due time for NextLife.Budget.MaxStaleness.
+ */
+UCLASS()
+class NEXTLIFE_API UNextLifeTickManager : public UWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+	UNextLifeTickManager();
+
+	virtual void Deinitialize() override;
+
+	// Adds a brain to be ticked by this manager
+	void RegisterBrain(class UNextLifeBrainComponent* brain);
+
+	// Removes a brain from this manager, it will no longer be ticked by it
+	void UnregisterBrain(class UNextLifeBrainComponent* brain);
+
+	// Ticks all registered brains. Called from the manager tick function.
+	void TickBrains(float deltaTime);
+
+	// The number of brains which were ticked during the last manager tick
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetLastTickBrainCount() const
+	{
+		return LastTickBrainCount;
+	}
+
+	// The number of behaviors which were run during the last manager tick
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetLastTickBehaviorCount() const
+	{
+		return LastTickBehaviorCount;
+	}
+
+	// The number of action updates which ran on worker threads during the last manager tick
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetLastTickParallelUpdateCount() const
+	{
+		return LastTickParallelUpdateCount;
+	}
+
+	// The total time, in milliseconds, the last manager tick took to tick all brains
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	float GetLastTickTimeMs() const
+	{
+		return LastTickTimeMs;
+	}
+
+	// The number of brains which skipped updating during the last manager tick because of their LOD tier
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetLastTickLODSkippedBrainCount() const
+	{
+		return LastTickLODSkippedBrainCount;
+	}
+
+	// The number of running brains in each LOD tier during the last manager tick, indexed by tier. Brains without LOD
+	// tiers are counted in tier 0.
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	const TArray<int32>& GetLastTickLODTierBrainCounts() const
+	{
+		return LastTickLODTierBrainCounts;
+	}
+
+	// Returns how significant a brain is for LOD, lower is more significant. Uses the significance function if one is
+	// set, otherwise the distance from the brains pawn to the closest player view point.
+	float GetBrainSignificance(const class UNextLifeBrainComponent* brain) const;
+
+	// Replaces the function used to measure brain significance for LOD. An empty function restores the default.
+	void SetSignificanceFunction(TFunction<float(const class UNextLifeBrainComponent*)> significanceFunction)
+	{
+		SignificanceFunction = MoveTemp(significanceFunction);
+	}
+
+	// The player view points gathered this tick, used by the default significance function
+	const TArray<FTransform>& GetViewPoints() const
+	{
+		return ViewPoints;
+	}
+
+	// The number of due brains deferred to the next frame during the last manager tick because the frame budget ran out
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetLastTickDeferredBrainCount() const
+	{
+		return LastTickDeferredBrainCount;
+	}
+
+	// The number of brains updated during the last manager tick which had reached the maximum staleness. These are
+	// updated even when the frame budget has run out.
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetLastTickStaleBrainCount() const
+	{
+		return LastTickStaleBrainCount;
+	}
+
+	// The total number of brain updates deferred since the manager was created
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int64 GetTotalDeferrals() const
+	{
+		return TotalDeferrals;
+	}
+
+	// True while the frame budget has been unable to keep up for several frames (see NextLife.Budget.OverloadFrames)
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	bool IsSchedulerOverloaded() const
+	{
+		return IsOverloaded;
+	}
+
+	// The number of brains currently registered
+	UFUNCTION(BlueprintPure, Category = "NextLife|TickManager")
+	int32 GetRegisteredBrainCount() const
+	{
+		return Brains.Num() - PendingRemovals;
+	}
+
+protected:
+
+	// A chosen behavior and the brain which is running it
+	struct FBehaviorRun
+	{
+		class UNextLifeBrainComponent* Brain;
+		class UNLBehavior* Behavior;
+		float DeltaTime;
+	};
+
+	// A brain due to update this frame
+	struct FDueBrain
+	{
+		class UNextLifeBrainComponent* Brain;
+		float DeltaTime;
+		float DeferredTime;
+		bool Stale;
+	};
+
+	// All the chosen behaviors of a single behavior class for this frame
+	struct FBehaviorBatch
+	{
+		UClass* BehaviorClass;
+		TArray<FBehaviorRun> Runs;
+	};
+
+	// An action update, possibly run off the game thread, with the result waiting to be applied
+	struct FPendingUpdate
+	{
+		class UNextLifeBrainComponent* Brain;
+		class UNLBehavior* Behavior;
+		class UNLAction* UpdatedAction;
+		float DeltaTime;
+		bool OffGameThread;
+		FNLActionResult Result;
+	};
+
+	// Makes every registered brain re-evaluate behavior selection
+	void InvalidateBehaviorSelections();
+
+	// Chooses the behaviors of a range of due brains, batching them by behavior class
+	void GatherBatches(int32 dueStart, int32 dueEnd);
+
+	// Runs the gathered batches on the game thread one behavior after another
+	void RunBatches();
+
+	// Runs the gathered batches updating thread safe actions in parallel, then merges results on the game thread
+	void RunBatchesParallel();
+
+	// Gathers the view points of all local and remote players
+	void GatherViewPoints();
+
+	// The default significance, the distance to the closest view point. Brains behind every view are pushed further
+	// away by NextLife.LOD.OutOfViewScale.
+	float GetDefaultSignificance(const class UNextLifeBrainComponent* brain) const;
+
+	// Removes brains which were unregistered while ticking
+	void CompactBrains();
+
+	// The registered brains. Entries can be null while ticking if a brain unregistered during the tick.
+	UPROPERTY(Transient)
+	TArray<class UNextLifeBrainComponent*> Brains;
+
+	// The tick function which ticks all brains
+	FNextLifeTickFunction TickFunction;
+
+	// Brains due to update this frame, reused each frame
+	TArray<FDueBrain> DueBrains;
+
+	// Batches by behavior class, reused each frame to avoid reallocating
+	TArray<FBehaviorBatch> Batches;
+	TMap<UClass*, int32> BatchIndexByClass;
+
+	// Scratch array for gathering a brains chosen behaviors
+	TArray<class UNLBehavior*> ScratchBehaviors;
+
+	// Measures brain significance for LOD, the default is used when not set
+	TFunction<float(const class UNextLifeBrainComponent*)> SignificanceFunction;
+
+	// Player view points for this tick
+	TArray<FTransform> ViewPoints;
+
+	// Updates for the parallel path, reused each frame
+	TArray<FPendingUpdate> PendingUpdates;
+
+	// True while brains are being ticked
+	bool IsTicking;
+
+	// The number of brain entries nulled out while ticking which need removing
+	int32 PendingRemovals;
+
+	// Stats from the last tick
+	int32 LastTickBrainCount;
+	int32 LastTickBehaviorCount;
+	int32 LastTickParallelUpdateCount;
+	int32 LastTickLODSkippedBrainCount;
+	int32 LastTickDeferredBrainCount;
+	int32 LastTickStaleBrainCount;
+	int64 TotalDeferrals;
+	TArray<int32> LastTickLODTierBrainCounts;
+	float LastTickTimeMs;
+
+	// Overload tracking
+	int32 ConsecutiveDeferredFrames;
+	int32 ConsecutiveRecoveredFrames;
+	bool IsOverloaded;
+};